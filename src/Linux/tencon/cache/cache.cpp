@@ -0,0 +1,243 @@
+/*
+*  Result cache for repeated frames
+*/
+
+#include "cache.h"
+
+using namespace iy;
+
+static const uint64_t XXH_P1 = 11400714785074694791ULL;
+static const uint64_t XXH_P2 = 14029467366897019727ULL;
+static const uint64_t XXH_P3 = 1609587929392839161ULL;
+static const uint64_t XXH_P4 = 9650029242287828579ULL;
+static const uint64_t XXH_P5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const uchar *p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const uchar *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * XXH_P2;
+	return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val)
+{
+	acc ^= xxh_round(0, val);
+	return acc * XXH_P1 + XXH_P4;
+}
+
+// XXH64 of the reference implementation (little endian loads)
+uint64_t ResultCache::xxhash64(const void *data, size_t len, uint64_t seed)
+{
+	const uchar *p = (const uchar *)data;
+	const uchar *end = p + len;
+	uint64_t h;
+
+	if (len >= 32)
+	{
+		uint64_t v1 = seed + XXH_P1 + XXH_P2;
+		uint64_t v2 = seed + XXH_P2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - XXH_P1;
+
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = xxh_round(v1, read64(p));
+			v2 = xxh_round(v2, read64(p + 8));
+			v3 = xxh_round(v3, read64(p + 16));
+			v4 = xxh_round(v4, read64(p + 24));
+		}
+
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxh_merge(h, v1);
+		h = xxh_merge(h, v2);
+		h = xxh_merge(h, v3);
+		h = xxh_merge(h, v4);
+	}
+	else h = seed + XXH_P5;
+
+	h += len;
+
+	for (; p + 8 <= end; p += 8)
+	{
+		h ^= xxh_round(0, read64(p));
+		h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= read32(p) * XXH_P1;
+		h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+		p += 4;
+	}
+	for (; p < end; p++)
+	{
+		h ^= (*p) * XXH_P5;
+		h = rotl64(h, 11) * XXH_P1;
+	}
+
+	// avalanche
+	h ^= h >> 33;
+	h *= XXH_P2;
+	h ^= h >> 29;
+	h *= XXH_P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+CacheKey ResultCache::fingerprint(const cv::Mat &gray)
+{
+	CacheKey key;
+	key.width = gray.cols;
+	key.height = gray.rows;
+	key.exact = 0;
+	key.dhash = 0;
+
+	if (gray.empty()) return key;
+
+	// exact: every row chained through the seed, continuous or not, so an
+	// ROI view hashes like its copy
+	uint64_t h = ((uint64_t)gray.cols << 32) | (uint32_t)gray.rows;
+	for (int y = 0; y < gray.rows; y++)
+		h = xxhash64(gray.ptr<uchar>(y), gray.cols, h);
+	key.exact = h;
+
+	// perceptual: mean of 9x8 cells from at most 16x16 samples each, then one
+	// bit per cell telling whether it is brighter than its right neighbour
+	const int nCol = 9, nRow = 8, nSample = 16;
+	int mean[nRow][nCol];
+	for (int r = 0; r < nRow; r++)
+	{
+		const int y0 = gray.rows * r / nRow, y1 = gray.rows * (r + 1) / nRow;
+		const int sy = std::max(1, (y1 - y0) / nSample);
+
+		for (int c = 0; c < nCol; c++)
+		{
+			const int x0 = gray.cols * c / nCol, x1 = gray.cols * (c + 1) / nCol;
+			const int sx = std::max(1, (x1 - x0) / nSample);
+
+			int sum = 0, n = 0;
+			for (int y = y0; y < y1; y += sy)
+			{
+				const uchar *row = gray.ptr<uchar>(y);
+				for (int x = x0; x < x1; x += sx, n++) sum += row[x];
+			}
+			mean[r][c] = n ? sum / n : 0;
+		}
+	}
+
+	for (int r = 0; r < nRow; r++)
+		for (int c = 0; c < nCol - 1; c++)
+			key.dhash = (key.dhash << 1) | (uint64_t)(mean[r][c] > mean[r][c + 1]);
+
+	return key;
+}
+
+bool ResultCache::find(const CacheKey &key, int need, CacheResult &res)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::list<CacheEntry>::iterator hit = lru.end();
+
+	std::unordered_map<uint64_t, std::list<CacheEntry>::iterator>::iterator it = index.find(key.exact);
+	if (it != index.end() && it->second->key.width == key.width && it->second->key.height == key.height
+		&& (it->second->res.valid & need) == need)
+	{
+		hit = it->second;
+		cstats.nHits++;
+	}
+	else if (maxDistance > 0)
+	{
+		// closest difference hash of a frame with the same size
+		int best = maxDistance + 1;
+		for (std::list<CacheEntry>::iterator e = lru.begin(); e != lru.end(); e++)
+		{
+			if (e->key.width != key.width || e->key.height != key.height || (e->res.valid & need) != need) continue;
+
+			int dist = __builtin_popcountll(e->key.dhash ^ key.dhash);
+			if (dist < best)
+			{
+				best = dist;
+				hit = e;
+			}
+		}
+		if (hit != lru.end()) cstats.nNearHits++;
+	}
+
+	if (hit == lru.end())
+	{
+		cstats.nMisses++;
+		return false;
+	}
+
+	lru.splice(lru.begin(), lru, hit);
+	res = hit->res;
+	return true;
+}
+
+void ResultCache::insert(const CacheKey &key, const CacheResult &res)
+{
+	if (maxEntries == 0) return;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	std::unordered_map<uint64_t, std::list<CacheEntry>::iterator>::iterator it = index.find(key.exact);
+	if (it != index.end())
+	{
+		// same frame, new results join the stored ones
+		CacheResult &dst = it->second->res;
+		if (res.valid & IY_CACHE_GALLO) dst.gallo = res.gallo;
+		if (res.valid & IY_CACHE_SOROS) dst.soros = res.soros;
+		if (res.valid & IY_CACHE_YUN) dst.yun = res.yun;
+		dst.valid |= res.valid;
+		it->second->key = key;
+
+		lru.splice(lru.begin(), lru, it->second);
+		return;
+	}
+
+	CacheEntry entry;
+	entry.key = key;
+	entry.res = res;
+	lru.push_front(entry);
+	index[key.exact] = lru.begin();
+
+	while (lru.size() > maxEntries)
+	{
+		index.erase(lru.back().key.exact);
+		lru.pop_back();
+		cstats.nEvictions++;
+	}
+}
+
+void ResultCache::clear()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	lru.clear();
+	index.clear();
+}
+
+CacheStats ResultCache::getStats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	CacheStats st = cstats;
+	st.nEntries = lru.size();
+	return st;
+}
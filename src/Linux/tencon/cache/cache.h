@@ -0,0 +1,95 @@
+/*
+*  Result cache for repeated frames
+*
+*   Frames are keyed by an exact xxHash64 of the pixels and a 64 bit
+*   difference hash of a 9x8 downsample. An exact hit returns the stored
+*   results; with maxDistance > 0 a frame of the same size whose difference
+*   hash is at most maxDistance bits away is a near hit. The cache holds at
+*   most maxEntries frames and drops the least recently used one. Results
+*   depend on the detector params, the cache has to be cleared when they
+*   change. All calls are thread safe.
+*/
+
+#ifndef IY_CACHE_H
+#define IY_CACHE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/method.h"
+#include "yun/yun.h"
+
+namespace iy{
+	enum
+	{
+		IY_CACHE_GALLO = 1 << IY_GALLO,
+		IY_CACHE_SOROS = 1 << IY_SOROS,
+		IY_CACHE_YUN = 1 << IY_YUN
+	};
+
+	typedef struct
+	{
+		uint64_t exact;         // xxHash64 of the pixels, row by row
+		uint64_t dhash;         // brighter-than-right-neighbour bits of a 9x8 downsample
+		int width, height;
+	} CacheKey;
+
+	typedef struct
+	{
+		int valid;              // IY_CACHE_* of the results held
+		cv::Rect gallo, soros;
+		YunResult yun;
+	} CacheResult;
+
+	typedef struct
+	{
+		uint64_t nHits, nNearHits, nMisses;
+		uint64_t nEvictions;
+		size_t nEntries;
+	} CacheStats;
+
+	class ResultCache{
+	private:
+		typedef struct
+		{
+			CacheKey key;
+			CacheResult res;
+		} CacheEntry;
+
+		size_t maxEntries;
+		int maxDistance;
+
+		std::mutex lock;
+		std::list<CacheEntry> lru;   // most recently used first
+		std::unordered_map<uint64_t, std::list<CacheEntry>::iterator> index;   // by exact hash
+		CacheStats cstats;
+
+	public:
+		ResultCache(size_t maxEntry = 256, int maxDist = 0) {
+			maxEntries = maxEntry;
+			maxDistance = maxDist;
+			memset(&cstats, 0, sizeof(cstats));
+		}
+		~ResultCache() {}
+
+		static CacheKey fingerprint(const cv::Mat &gray);
+		static uint64_t xxhash64(const void *data, size_t len, uint64_t seed);
+
+		// true if a stored frame matches key and holds every result in need (IY_CACHE_*)
+		bool find(const CacheKey &key, int need, CacheResult &res);
+
+		// stores res, or adds its results to the ones of the same frame
+		void insert(const CacheKey &key, const CacheResult &res);
+
+		void clear();
+		CacheStats getStats();
+	};
+}
+
+#endif
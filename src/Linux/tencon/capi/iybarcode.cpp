@@ -0,0 +1,168 @@
+/*
+*  C interface of the 1D barcode localization library
+*
+*   etc: not include barcode recognition process.
+*        only localization method! *
+*/
+
+#include "iybarcode.h"
+
+#include <new>
+
+#include "common/method.h"
+#include "gallo/gallo.h"
+#include "soros/soros.h"
+#include "yun/yun.h"
+
+// the C enum can not use the shared ids, it has to keep their values
+static_assert((int)IY_METHOD_GALLO == iy::IY_GALLO && (int)IY_METHOD_SOROS == iy::IY_SOROS &&
+	(int)IY_METHOD_YUN == iy::IY_YUN, "iy_method follows the method ids");
+
+struct iy_detector
+{
+	iy_method method;
+	int winSz;
+
+	iy::Gallo gallo;
+	iy::Soros soros;
+	iy::Yun yun;
+	iy::YunResult result;   // reused by every call
+};
+
+// one region into whichever buffer the caller passed
+static void write_rect(iy_rect *out, iy_box *boxes, int capacity, int *count, const cv::Rect &rt, const cv::RotatedRect &box, int orientation)
+{
+	if (*count < capacity)
+	{
+		if (out)
+		{
+			iy_rect &dst = out[*count];
+			dst.x = rt.x;
+			dst.y = rt.y;
+			dst.width = rt.width;
+			dst.height = rt.height;
+			dst.orientation = orientation;
+		}
+		else
+		{
+			iy_box &dst = boxes[*count];
+			dst.cx = box.center.x;
+			dst.cy = box.center.y;
+			dst.width = box.size.width;
+			dst.height = box.size.height;
+			dst.angle = box.angle;
+			dst.orientation = orientation;
+		}
+	}
+	(*count)++;
+}
+
+// Gallo and Soros have no orientation, their box is the upright rectangle
+static cv::RotatedRect upright(const cv::Rect &rt)
+{
+	return cv::RotatedRect(cv::Point2f(rt.x + rt.width * 0.5f, rt.y + rt.height * 0.5f), cv::Size2f((float)rt.width, (float)rt.height), 0);
+}
+
+int iy_abi_version(void)
+{
+	return IY_ABI_VERSION;
+}
+
+iy_detector *iy_create(iy_method method)
+{
+	if (method != IY_METHOD_GALLO && method != IY_METHOD_SOROS && method != IY_METHOD_YUN)
+		return NULL;
+
+	try{
+		iy_detector *det = new iy_detector;
+		det->method = method;
+		det->winSz = (method == IY_METHOD_YUN) ? det->yun.getParams().winSz : 20;
+		return det;
+	}
+	catch (...)
+	{
+		return NULL;
+	}
+}
+
+void iy_destroy(iy_detector *det)
+{
+	delete det;
+}
+
+iy_status iy_set_window(iy_detector *det, int win_sz)
+{
+	if (det == NULL || win_sz <= 0) return IY_ERR_ARGUMENT;
+
+	det->winSz = win_sz;
+	if (det->method == IY_METHOD_YUN)
+	{
+		iy::YunParams pam = det->yun.getParams();
+		pam.winSz = win_sz;
+		det->yun.setParams(pam);
+	}
+	return IY_OK;
+}
+
+static iy_status detect(iy_detector *det, const unsigned char *gray,
+	int width, int height, int stride,
+	iy_rect *out, iy_box *boxes, int capacity, int *count)
+{
+	if (det == NULL || gray == NULL || count == NULL) return IY_ERR_ARGUMENT;
+	if (width <= 0 || height <= 0 || stride < width || capacity < 0) return IY_ERR_ARGUMENT;
+	if (out == NULL && boxes == NULL && capacity > 0) return IY_ERR_ARGUMENT;
+
+	*count = 0;
+
+	try{
+		// header only, the caller keeps ownership of the pixels
+		cv::Mat src(height, width, CV_8UC1, const_cast<unsigned char *>(gray), (size_t)stride);
+
+		switch (det->method)
+		{
+		case IY_METHOD_GALLO:
+		{
+			cv::Rect rt = det->gallo.process(src, det->winSz);
+			if (rt.area() > 0) write_rect(out, boxes, capacity, count, rt, upright(rt), -1);
+			break;
+		}
+		case IY_METHOD_SOROS:
+		{
+			cv::Rect rt = det->soros.process(src, true, det->winSz);
+			if (rt.area() > 0) write_rect(out, boxes, capacity, count, rt, upright(rt), -1);
+			break;
+		}
+		case IY_METHOD_YUN:
+		{
+			det->yun.process(src, det->result);
+			for (size_t i = 0; i < det->result.size(); i++)
+				write_rect(out, boxes, capacity, count, det->result.roi[i], det->result.box[i], det->result.orientation[i]);
+			break;
+		}
+		}
+	}
+	catch (std::bad_alloc &)
+	{
+		return IY_ERR_MEMORY;
+	}
+	catch (...)
+	{
+		return IY_ERR_INTERNAL;
+	}
+
+	return IY_OK;
+}
+
+iy_status iy_detect(iy_detector *det, const unsigned char *gray,
+	int width, int height, int stride,
+	iy_rect *out, int capacity, int *count)
+{
+	return detect(det, gray, width, height, stride, out, NULL, capacity, count);
+}
+
+iy_status iy_detect_boxes(iy_detector *det, const unsigned char *gray,
+	int width, int height, int stride,
+	iy_box *out, int capacity, int *count)
+{
+	return detect(det, gray, width, height, stride, NULL, out, capacity, count);
+}
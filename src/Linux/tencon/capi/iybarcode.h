@@ -0,0 +1,87 @@
+/*
+*  C interface of the 1D barcode localization library
+*
+*   A stable C ABI over the Gallo, Soros and Yun detectors. The caller owns
+*   the gray image and the result buffer; no exception crosses this boundary,
+*   every failure is reported through an iy_status code.
+*
+*   etc: not include barcode recognition process.
+*        only localization method! *
+*/
+
+#ifndef IY_BARCODE_CAPI_H
+#define IY_BARCODE_CAPI_H
+
+#define IY_API __attribute__((visibility("default")))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IY_ABI_VERSION 1
+
+typedef struct iy_detector iy_detector;
+
+typedef enum
+{
+	IY_METHOD_GALLO = 0,
+	IY_METHOD_SOROS = 1,
+	IY_METHOD_YUN = 2
+} iy_method;
+
+typedef enum
+{
+	IY_OK = 0,
+	IY_ERR_ARGUMENT = -1,
+	IY_ERR_MEMORY = -2,
+	IY_ERR_INTERNAL = -3
+} iy_status;
+
+typedef struct
+{
+	int x, y, width, height;
+	int orientation;  /* Yun orientation bin, -1 for Gallo/Soros */
+} iy_rect;
+
+/* oriented region: center, width across the bars, height along them and
+   the angle of the bar normal in degrees (0 and the upright rectangle
+   for Gallo/Soros) */
+typedef struct
+{
+	float cx, cy, width, height;
+	float angle;
+	int orientation;  /* Yun orientation bin, -1 for Gallo/Soros */
+} iy_box;
+
+/* ABI version the library was built with (IY_ABI_VERSION) */
+IY_API int iy_abi_version(void);
+
+/* returns NULL on failure */
+IY_API iy_detector *iy_create(iy_method method);
+IY_API void iy_destroy(iy_detector *det);
+
+/* smoothing window of the detector (Gallo/Soros WinSz, Yun winSz) */
+IY_API iy_status iy_set_window(iy_detector *det, int win_sz);
+
+/*
+*  gray   : 8-bit single channel image, row pitch of stride bytes
+*  out    : caller buffer of capacity entries (may be NULL if capacity is 0)
+*  count  : number of regions found, may exceed capacity; only
+*           min(count, capacity) entries are written. 0 when nothing is
+*           found: Gallo and Soros give at most one region, Yun one per
+*           barcode
+*/
+IY_API iy_status iy_detect(iy_detector *det, const unsigned char *gray,
+	int width, int height, int stride,
+	iy_rect *out, int capacity, int *count);
+
+/* iy_detect with oriented boxes, a tight crop for 45 degree codes */
+IY_API iy_status iy_detect_boxes(iy_detector *det, const unsigned char *gray,
+	int width, int height, int stride,
+	iy_box *out, int capacity, int *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,142 @@
+/*
+*  Image helpers shared by the detectors
+*/
+
+#include "imgproc.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+using namespace iy;
+
+int iy::calc_otsu(const int *hist, int total)
+{
+	// same threshold cv::threshold(THRESH_OTSU) finds on the 8-bit map
+	const double scale = 1.0 / total;
+
+	double mu = 0;
+	for (int i = 0; i < 256; i++) mu += i * (double)hist[i];
+	mu *= scale;
+
+	double mu1 = 0, q1 = 0;
+	double max_sigma = 0;
+	int max_val = 0;
+
+	for (int i = 0; i < 256; i++)
+	{
+		double p_i = hist[i] * scale;
+		mu1 *= q1;
+		q1 += p_i;
+		double q2 = 1.0 - q1;
+
+		if (std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1.0 - FLT_EPSILON)
+			continue;
+
+		mu1 = (mu1 + i * p_i) / q1;
+		double mu2 = (mu - q1 * mu1) / q2;
+		double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+		if (sigma > max_sigma)
+		{
+			max_sigma = sigma;
+			max_val = i;
+		}
+	}
+
+	return max_val;
+}
+
+cv::Point iy::find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz, int *hist)
+{
+	cv::Point max_pt;
+	find_max_points_with_smooth(&src, &smooth_map, 1, WinSz, hist, &max_pt);
+	return max_pt;
+}
+
+void iy::find_max_points_with_smooth(cv::Mat *src, cv::Mat *smooth_map, int nMaps, int WinSz, int *hist, cv::Point *max_pt)
+{
+	const cv::Size imSz = src[0].size();
+
+	const int nSize = WinSz * WinSz;
+	const int cSize = (WinSz / 2) + 1;
+	const int max_height = imSz.height - cSize;
+	const int max_width = imSz.width - cSize;
+
+	// row stripes in parallel; every stripe keeps its own maximum and
+	// histogram per map, merged in stripe order so the first maximum still wins
+	const int nStripes = std::max(1, std::min(cv::getNumThreads(), imSz.height));
+	std::vector<int> stripe_hist(nStripes * nMaps * 256, 0);
+	std::vector<float> stripe_max(nStripes * nMaps, 0.0f);
+	std::vector<cv::Point> stripe_pt(nStripes * nMaps, cv::Point(0, 0));
+
+	cv::parallel_for_(cv::Range(0, nStripes), [&](const cv::Range &range)
+	{
+		for (int s = range.start; s < range.end; s++)
+		{
+			std::vector<float> mean_max(nMaps, 0.0f);
+			std::vector<cv::Point> pt(nMaps, cv::Point(0, 0));
+
+			for (int h = imSz.height * s / nStripes; h < imSz.height * (s + 1) / nStripes; h++)
+			{
+				int temp_top = h - cSize;
+				int ntop = (temp_top > max_height) ? max_height : temp_top;
+				int temp_bottom = h + cSize;
+				int nbottom = (temp_bottom >= imSz.height - 1) ? imSz.height - 1 : temp_bottom;
+
+				for (int w = 0; w < imSz.width; w++)
+				{
+					int temp_left = w - cSize;
+					int nleft = (temp_left > max_width) ? max_width : temp_left;
+					int temp_right = w + cSize;
+					int nright = (temp_right >= imSz.width - 1) ? imSz.width - 1 : temp_right;
+
+					// same window for every map
+					for (int k = 0; k < nMaps; k++)
+					{
+						const cv::Mat &iMap = src[k];
+
+						// local mean
+						float n1 = (nleft > 0 && ntop > 0) ? iMap.at<float>(ntop, nleft - 1) : 0;
+						float n2 = (nleft > 0) ? iMap.at<float>(nbottom, nleft - 1) : 0;
+						float n3 = (ntop > 0) ? iMap.at<float>(ntop, nright) : 0;
+
+						float sum = iMap.at<float>(nbottom, nright) - n3 - n2 + n1;
+						float mean = sum / nSize;
+
+						if (mean > mean_max[k])
+						{
+							mean_max[k] = mean;
+							pt[k] = cv::Point(w, h);
+						}
+
+						uchar val = (mean > 255) ? 255 : mean;
+						smooth_map[k].at<uchar>(h, w) = val;
+						stripe_hist[(s * nMaps + k) * 256 + val]++;
+					}
+				}
+			}
+
+			for (int k = 0; k < nMaps; k++)
+			{
+				stripe_max[s * nMaps + k] = mean_max[k];
+				stripe_pt[s * nMaps + k] = pt[k];
+			}
+		}
+	});
+
+	for (int k = 0; k < nMaps; k++)
+	{
+		float mean_max = 0.0f;
+		max_pt[k] = cv::Point(0, 0);
+		for (int s = 0; s < nStripes; s++)
+		{
+			const int id = s * nMaps + k;
+			if (stripe_max[id] > mean_max)
+			{
+				mean_max = stripe_max[id];
+				max_pt[k] = stripe_pt[id];
+			}
+			for (int i = 0; i < 256; i++) hist[k * 256 + i] += stripe_hist[id * 256 + i];
+		}
+	}
+}
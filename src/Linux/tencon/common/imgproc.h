@@ -0,0 +1,24 @@
+/*
+*  Image helpers shared by the detectors
+*
+*   calc_otsu() is the threshold cv::threshold(THRESH_OTSU) would pick, from
+*   a 256 bin histogram the caller already counted. find_max_points_with_smooth()
+*   takes the WinSz x WinSz box mean of one or more integral images (CV_32F,
+*   same size) in parallel row stripes, writes it to an 8-bit map per image,
+*   adds its histogram to hist (256 bins per image) and returns the first
+*   position of its maximum in raster order, whatever the stripe count.
+*/
+
+#ifndef IY_COMMON_IMGPROC_H
+#define IY_COMMON_IMGPROC_H
+
+#include <opencv2/opencv.hpp>
+
+namespace iy{
+	int calc_otsu(const int *hist, int total);
+
+	cv::Point find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz, int *hist);
+	void find_max_points_with_smooth(cv::Mat *src, cv::Mat *smooth_map, int nMaps, int WinSz, int *hist, cv::Point *max_pt);
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+*  Ids of the localization methods
+*
+*   One id per detector, in the order Gallo, Soros, Yun. The daemon requests
+*   (IY_REQ_*), the result cache bits (IY_CACHE_*, 1 << id), the ensemble
+*   (IY_ENSEMBLE_*) and the frame traces are defined from them; the C API
+*   (iy_method) is checked against them where it is implemented.
+*/
+
+#ifndef IY_COMMON_METHOD_H
+#define IY_COMMON_METHOD_H
+
+namespace iy{
+	enum
+	{
+		IY_GALLO = 0,
+		IY_SOROS,
+		IY_YUN,
+		IY_NUM_METHODS
+	};
+}
+
+#endif
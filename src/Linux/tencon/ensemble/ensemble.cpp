@@ -0,0 +1,271 @@
+/*
+*  Gallo, Soros and Yun run concurrently on one frame, regions fused by vote
+*/
+
+#include "ensemble.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <iostream>
+#include <mutex>
+
+using namespace iy;
+
+// one frame in flight, shared with the tasks that may outlive process()
+struct Ensemble::Job
+{
+	cv::Mat gray;
+	YunToken token;
+
+	std::mutex lock;
+	std::condition_variable cond;
+	int nLeft;                               // tasks not returned yet (lock)
+	int finished;                            // (lock)
+	bool isStop;                             // tasks not started yet skip the frame (lock)
+	cv::Rect rt[IY_ENSEMBLE_YUN];            // Gallo, Soros (lock)
+	std::vector<YunCandidate> candidates;    // Yun (lock)
+	double ms[IY_NUM_METHODS];               // (lock)
+};
+
+Ensemble::Ensemble(EnsembleParams pams)
+{
+	pool = NULL;
+	setParams(pams);
+}
+
+Ensemble::~Ensemble()
+{
+	wait();
+}
+
+void Ensemble::setParams(EnsembleParams pams)
+{
+	wait();
+	pam = pams;
+
+	if (pam.pool != NULL)
+	{
+		ownPool.reset();
+		pool = pam.pool;
+	}
+	else
+	{
+		if (!ownPool)
+		{
+			PoolParams ppam;
+			ppam.nWorkers = IY_NUM_METHODS;
+			ppam.nNodes = 1;
+			ppam.affinity = IY_AFFINITY_NONE;
+			ownPool.reset(new ThreadPool(ppam));
+		}
+		pool = ownPool.get();
+	}
+}
+
+void Ensemble::wait()
+{
+	if (!pending) return;
+
+	std::unique_lock<std::mutex> lock(pending->lock);
+	pending->cond.wait(lock, [&]() { return pending->nLeft == 0; });
+	lock.unlock();
+
+	pending.reset();
+}
+
+void Ensemble::run(Job &job, int method)
+{
+	{
+		std::lock_guard<std::mutex> lock(job.lock);
+		if (job.isStop)
+		{
+			job.nLeft--;
+			job.cond.notify_all();
+			return;
+		}
+	}
+
+	cv::Rect rt;
+	std::vector<YunCandidate> candidates;
+	bool isDone = true;
+	const int64_t t0 = cv::getTickCount();
+
+	try
+	{
+		if (method == IY_ENSEMBLE_GALLO) rt = gallo.process(job.gray, pam.WinSz, pam.isSteerable);
+		else if (method == IY_ENSEMBLE_SOROS) rt = soros.process(job.gray, true, pam.WinSz);
+		else
+		{
+			bool isPartial;
+			candidates = yun.process(job.gray, job.token, isPartial);
+			isDone = !isPartial;   // cancelled: its blobs were not all verified
+		}
+	}
+	catch (std::exception &e)
+	{
+		std::cerr << "warning! ensemble method " << method << " failed: " << e.what() << std::endl;
+		isDone = false;
+	}
+
+	const double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+
+	std::lock_guard<std::mutex> lock(job.lock);
+	if (isDone)
+	{
+		if (method == IY_ENSEMBLE_YUN) job.candidates.swap(candidates);
+		else job.rt[method] = rt;
+		job.ms[method] = ms;
+		job.finished |= 1 << method;
+	}
+	job.nLeft--;
+	job.cond.notify_all();
+}
+
+// Yun's regions first, then every Soros and Gallo region joins the region it
+// overlaps most (one vote per detector and region) or starts one of its own.
+// The order is fixed, so the result does not depend on which detector was first.
+void Ensemble::fuse(const Job &job, std::vector<EnsembleRegion> &regions) const
+{
+	regions.clear();
+
+	if (job.finished & (1 << IY_ENSEMBLE_YUN))
+	{
+		for (size_t i = 0; i < job.candidates.size(); i++)
+		{
+			const YunCandidate &c = job.candidates[i];
+			if (!c.isBarcode) continue;
+
+			EnsembleRegion r;
+			r.roi = c.roi;
+			r.box = c.box;
+			r.votes = 1;
+			r.methods = 1 << IY_ENSEMBLE_YUN;
+			r.score = c.score;
+			regions.push_back(r);
+		}
+	}
+
+	static const int order[2] = { IY_ENSEMBLE_SOROS, IY_ENSEMBLE_GALLO };
+	for (int k = 0; k < 2; k++)
+	{
+		const int m = order[k];
+		const cv::Rect &rt = job.rt[m];
+		if (!(job.finished & (1 << m)) || rt.area() <= 0) continue;
+
+		int best = -1;
+		double bestIou = pam.iouT;
+		for (size_t i = 0; i < regions.size(); i++)
+		{
+			if (regions[i].methods & (1 << m)) continue;
+
+			const double inter = (regions[i].roi & rt).area();
+			const double iou = inter / (regions[i].roi.area() + rt.area() - inter);
+			if (iou >= bestIou)
+			{
+				bestIou = iou;
+				best = (int)i;
+			}
+		}
+
+		if (best >= 0)
+		{
+			regions[best].votes++;
+			regions[best].methods |= 1 << m;
+			continue;
+		}
+
+		EnsembleRegion r;
+		r.roi = rt;
+		r.box = cv::RotatedRect(cv::Point2f(rt.x + rt.width * 0.5f, rt.y + rt.height * 0.5f),
+			cv::Size2f((float)rt.width, (float)rt.height), 0);
+		r.votes = 1;
+		r.methods = 1 << m;
+		r.score = 0;
+		regions.push_back(r);
+	}
+
+	// at most one vote per detector that runs
+	int nMethods = 0;
+	for (int m = 0; m < IY_NUM_METHODS; m++)
+		if (pam.methods & (1 << m)) nMethods++;
+	const int minVotes = std::max(1, std::min(pam.minVotes, nMethods));
+
+	size_t n = 0;
+	for (size_t i = 0; i < regions.size(); i++)
+		if (regions[i].votes >= minVotes) regions[n++] = regions[i];
+	regions.resize(n);
+
+	std::stable_sort(regions.begin(), regions.end(), [](const EnsembleRegion &a, const EnsembleRegion &b) {
+		return a.votes > b.votes || (a.votes == b.votes && a.score > b.score);
+	});
+}
+
+void Ensemble::process(cv::Mat &gray_src, EnsembleResult &result)
+{
+	wait();
+
+	// an early return leaves detectors running on the frame: they get a copy
+	std::shared_ptr<Job> job = std::make_shared<Job>();
+	job->gray = pam.isEarly ? gray_src.clone() : gray_src;
+	job->nLeft = 0;
+	job->finished = 0;
+	job->isStop = false;
+	for (int m = 0; m < IY_NUM_METHODS; m++)
+	{
+		job->ms[m] = -1;
+		if (pam.methods & (1 << m)) job->nLeft++;
+	}
+
+	// slowest first, so it never waits behind the others for a worker
+	static const int order[IY_NUM_METHODS] = { IY_ENSEMBLE_SOROS, IY_ENSEMBLE_YUN, IY_ENSEMBLE_GALLO };
+
+	std::unique_lock<std::mutex> lock(job->lock);
+	if (ThreadPool::worker_id() >= 0)
+	{
+		// a pool worker waiting for other tasks could wait forever: one after another
+		lock.unlock();
+		for (int k = 0; k < IY_NUM_METHODS; k++)
+		{
+			if (!(pam.methods & (1 << order[k]))) continue;
+
+			run(*job, order[k]);
+			if (!pam.isEarly) continue;
+
+			fuse(*job, result.regions);
+			if (!result.regions.empty()) break;
+		}
+		lock.lock();
+	}
+	else
+	{
+		pending = job;
+		for (int k = 0; k < IY_NUM_METHODS; k++)
+		{
+			if (!(pam.methods & (1 << order[k]))) continue;
+
+			const int m = order[k];
+			pool->submit([this, job, m]() { run(*job, m); });
+		}
+
+		job->cond.wait(lock, [&]() {
+			if (job->nLeft == 0) return true;
+			if (!pam.isEarly) return false;
+
+			fuse(*job, result.regions);
+			return !result.regions.empty();
+		});
+	}
+
+	fuse(*job, result.regions);
+	result.finished = job->finished;
+	result.isEarly = job->nLeft > 0;
+	for (int m = 0; m < IY_NUM_METHODS; m++) result.ms[m] = job->ms[m];
+
+	// the rest of the frame is of no use any more
+	if (result.isEarly)
+	{
+		job->isStop = true;
+		job->token.cancel();
+	}
+}
@@ -0,0 +1,102 @@
+/*
+*  Gallo, Soros and Yun run concurrently on one frame, regions fused by vote
+*
+*   The three detectors are started together on a thread pool and share the
+*   frame. A region found by one detector counts as a vote for every region of
+*   another detector it overlaps by at least iouT; regions with minVotes votes
+*   are returned. With isEarly the call returns as soon as one region has its
+*   votes: Yun is cancelled through its token, a Gallo or Soros pass that is
+*   still running finishes in the background and is discarded. That pass
+*   reads a copy of the frame taken by process(), so the caller's buffer is
+*   free again once process() returns, with or without isEarly.
+*/
+
+#ifndef IY_ENSEMBLE_H
+#define IY_ENSEMBLE_H
+
+#include <opencv2/opencv.hpp>
+#include <memory>
+#include <vector>
+
+#include "common/method.h"
+#include "gallo/gallo.h"
+#include "soros/soros.h"
+#include "yun/yun.h"
+#include "pool/pool.h"
+
+namespace iy{
+	enum
+	{
+		IY_ENSEMBLE_GALLO = IY_GALLO,
+		IY_ENSEMBLE_SOROS = IY_SOROS,
+		IY_ENSEMBLE_YUN = IY_YUN
+	};
+
+	typedef struct
+	{
+		int methods;            // mask of (1 << IY_ENSEMBLE_*) to run
+		int minVotes;           // detectors that must agree on a region (at most the ones run)
+		double iouT;            // intersection over union of two regions of the same barcode
+		bool isEarly;           // return once a region has minVotes, cancel the slower detectors
+		int WinSz;              // Gallo and Soros window
+		bool isSteerable;       // Gallo with steerable gradients
+		ThreadPool *pool;       // runs the detectors (NULL: three workers of its own)
+	} EnsembleParams;
+
+	typedef struct
+	{
+		cv::Rect roi;           // of the most precise detector that found it: Yun, Soros, Gallo
+		cv::RotatedRect box;    // Yun's oriented box, roi as an upright box otherwise
+		int votes;
+		int methods;            // mask of the detectors that found it
+		double score;           // Yun's score, 0 without a Yun vote
+	} EnsembleRegion;
+
+	typedef struct
+	{
+		std::vector<EnsembleRegion> regions;   // votes >= minVotes, most votes first
+		int finished;                          // detectors that completed before the return
+		bool isEarly;                          // returned before all detectors completed
+		double ms[IY_NUM_METHODS];             // run time per detector, -1 if not completed
+	} EnsembleResult;
+
+	class Ensemble{
+	private:
+		struct Job;
+
+		EnsembleParams pam;
+		std::unique_ptr<ThreadPool> ownPool;
+		ThreadPool *pool;
+
+		// one detector per method, used by at most one job at a time
+		Gallo gallo;
+		Soros soros;
+		Yun yun;
+
+		std::shared_ptr<Job> pending;   // last job, until all of its detectors returned
+
+		Ensemble(const Ensemble &);
+		Ensemble &operator=(const Ensemble &);
+
+		void run(Job &job, int method);
+		void fuse(const Job &job, std::vector<EnsembleRegion> &regions) const;
+
+	public:
+		explicit Ensemble(EnsembleParams pams);
+		~Ensemble();   // waits for detectors still running
+
+		EnsembleParams getParams() const { return pam; }
+		void setParams(EnsembleParams pams);
+
+		// the detectors, for their own params (not while a job is running, see wait())
+		Yun &getYun() { return yun; }
+
+		// gray_src is read until the call returns (copied first with isEarly)
+		void process(cv::Mat &gray_src, EnsembleResult &result);
+
+		// blocks until the detectors of the last process() call have returned
+		void wait();
+	};
+}
+
+#endif
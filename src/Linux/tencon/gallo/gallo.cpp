@@ -17,27 +17,57 @@
 
 using namespace iy;
 
-cv::Rect Gallo::process(cv::Mat &gray_src, int WinSz/*=20*/)
+cv::Rect Gallo::process(cv::Mat &gray_src, int WinSz/*=20*/, bool isSteerable/*=false*/)
+{
+    return detect(gray_src, 1, WinSz, isSteerable);
+}
+
+bool Gallo::preview(cv::Mat &gray_src, cv::Rect &roi, int stride/*=4*/, int WinSz/*=20*/, bool isSteerable/*=false*/)
+{
+    if(stride < 1) stride = 1;
+    
+    // window in grid cells, region back in source pixels
+    cv::Rect rt = detect(gray_src, stride, std::max(3, WinSz / stride), isSteerable);
+    roi = cv::Rect(rt.x * stride, rt.y * stride, rt.width * stride, rt.height * stride) & cv::Rect(0, 0, gray_src.cols, gray_src.rows);
+    
+    return roi.area() > 0;
+}
+
+cv::Rect Gallo::detect(cv::Mat &gray_src, int stride, int WinSz, bool isSteerable)
 {
     cv::Rect result(0,0,0,0);
     
     try{
-       // gradirnt map
-       cv::Mat hGrad = calc_gradient(gray_src);
+       cv::Mat sMap(gray_src.rows / stride, gray_src.cols / stride, CV_8UC1); 
+       int hist[256] = { 0 };
+       cv::Point cp;
        
-       // integral map
-       cv::Mat iMap = calc_integral_image(hGrad);
-       
-       // find max point with box filter
-       cv::Mat sMap(hGrad.size(), CV_8UC1); 
-       cv::Point cp = find_max_point_with_smooth(iMap, sMap, WinSz);
+       if(isSteerable)
+       {
+           // oriented contrast maps from one dx/dy pass
+           cv::Mat d1, d2;
+           calc_steerable_gradient(gray_src, d1, d2, stride);
+           
+           // box filter of both, dominant orientation energy per window
+           cp = find_max_point_steerable(d1, d2, sMap, WinSz, hist);
+       }
+       else
+       {
+           // gradirnt map
+           cv::Mat hGrad = calc_gradient(gray_src, stride);
+           
+           // integral map
+           cv::Mat iMap = calc_integral_image(hGrad);
+           
+           // find max point with box filter, histogram of the smoothed map on the way
+           cp = find_max_point_with_smooth(iMap, sMap, WinSz, hist);
+       }
     
-       // global binzrization
-       cv::Mat bMap(hGrad.size(), CV_8UC1);
-       cv::threshold(sMap, bMap, 50, 255, cv::THRESH_OTSU);
+       // global binzrization, applied on the fly by box_detection
+       int thr = calc_otsu(hist, sMap.rows * sMap.cols);
        
        // box detection       
-       result = box_detection(bMap, cp);
+       result = box_detection(sMap, cp, thr);
     }
     catch(cv::Exception &e)
     {
@@ -49,27 +79,82 @@ cv::Rect Gallo::process(cv::Mat &gray_src, int WinSz/*=20*/)
     return result;
 }
 
-cv::Mat Gallo::calc_gradient(cv::Mat &src)
+// sobel on every stride-th pixel, read from src without a resized copy: cell
+// (h, w) is centred on (w * stride + stride / 2, h * stride + stride / 2) with
+// taps stride / 2 apart, so every bar edge falls into the span of one cell
+// (stride 1: the plain 3x3 sobel)
+cv::Mat Gallo::calc_gradient(cv::Mat &src, int stride)
 {
     assert(src.channels() == 1);
     
-    const cv::Size imSz = src.size();    
-    cv::Mat result(imSz, CV_8UC1);
+    const cv::Size imSz(src.cols / stride, src.rows / stride);
+    const int off = stride / 2;
+    const int r = std::max(1, stride / 2);
+    cv::Mat result(imSz, CV_8UC1, cv::Scalar(0));
     
-    for(int h = 1; h < imSz.height - 1; h++)
+    for(int h = 0; h < imSz.height; h++)
     {
-        for(int w = 1; w < imSz.width - 1; w++)
+        const int y = h * stride + off;
+        if(y - r < 0 || y + r >= src.rows) continue;
+        
+        const uchar *p0 = src.ptr<uchar>(y - r);
+        const uchar *p1 = src.ptr<uchar>(y);
+        const uchar *p2 = src.ptr<uchar>(y + r);
+        uchar *q = result.ptr<uchar>(h);
+        
+        for(int w = 0; w < imSz.width; w++)
         {
-            int dx = src.at<uchar>(h-1,w-1) + 2*src.at<uchar>(h,w-1) + src.at<uchar>(h+1,w-1) - 
-                     src.at<uchar>(h-1,w+1) - 2*src.at<uchar>(h,w+1) - src.at<uchar>(h+1,w+1);
+            const int x = w * stride + off;
+            if(x - r < 0 || x + r >= src.cols) continue;
+            
+            int dx = p0[x-r] + 2*p1[x-r] + p2[x-r] - p0[x+r] - 2*p1[x+r] - p2[x+r];
             
-            result.at<uchar>(h,w) = std::abs(dx); 
+            q[w] = std::abs(dx); 
         }
     }    
     
     return result;   
 }
 
+void Gallo::calc_steerable_gradient(cv::Mat &src, cv::Mat &d1, cv::Mat &d2, int stride)
+{
+    assert(src.channels() == 1);
+    
+    // grid of calc_gradient
+    const cv::Size imSz(src.cols / stride, src.rows / stride);
+    const int off = stride / 2;
+    const int r = std::max(1, stride / 2);
+    d1 = cv::Mat(imSz, CV_16SC1, cv::Scalar(0));
+    d2 = cv::Mat(imSz, CV_16SC1, cv::Scalar(0));
+    
+    // plain integer row loops, vectorized by the compiler
+    for(int h = 0; h < imSz.height; h++)
+    {
+        const int y = h * stride + off;
+        if(y - r < 0 || y + r >= src.rows) continue;
+        
+        const uchar *p0 = src.ptr<uchar>(y - r);
+        const uchar *p1 = src.ptr<uchar>(y);
+        const uchar *p2 = src.ptr<uchar>(y + r);
+        short *q1 = d1.ptr<short>(h);
+        short *q2 = d2.ptr<short>(h);
+        
+        for(int w = 0; w < imSz.width; w++)
+        {
+            const int x = w * stride + off;
+            if(x - r < 0 || x + r >= src.cols) continue;
+            
+            int dx = p0[x-r] + 2*p1[x-r] + p2[x-r] - p0[x+r] - 2*p1[x+r] - p2[x+r];
+            int dy = p0[x-r] + 2*p0[x] + p0[x+r] - p2[x-r] - 2*p2[x] - p2[x+r];
+            
+            // projections on 0/90 and 45/135 degrees, each minus its orthogonal one
+            // (the second pair is left scaled by sqrt(2))
+            q1[w] = (short)(std::abs(dx) - std::abs(dy));
+            q2[w] = (short)(std::abs(dx + dy) - std::abs(dx - dy));
+        }
+    }
+}
+
 cv::Mat Gallo::calc_integral_image(cv::Mat &src)
 {
     assert(src.channels() == 1);
@@ -96,53 +181,109 @@ cv::Mat Gallo::calc_integral_image(cv::Mat &src)
     return result;    
 }
 
-cv::Point Gallo::find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz)
+cv::Point Gallo::find_max_point_steerable(cv::Mat &d1, cv::Mat &d2, cv::Mat &smooth_map, int WinSz, int *hist)
 {
-    const cv::Size imSz = src.size(); 
-    cv::Point max_pt(0, 0);
+    const cv::Size imSz = d1.size();
     
-    const int nSize = WinSz * WinSz;
-    const int cSize = (WinSz / 2) + 1;
-    const int max_height =  imSz.height - cSize;
-    const int max_width = imSz.width - cSize;
-    float mean_max = 0.0f;
+    // (2r+1)^2 window; mean halved so strong bars stay below 255
+    const int r = WinSz / 2;
+    const float scale = 0.5f / ((2*r + 1) * (2*r + 1));
     
-    for(int h = 0; h < imSz.height; h++)
+    // row stripes in parallel as in find_max_points_with_smooth, box sums by
+    // running column sums instead of integral images
+    const int nStripes = std::max(1, std::min(cv::getNumThreads(), imSz.height));
+    std::vector<int> stripe_hist(nStripes * 256, 0);
+    std::vector<float> stripe_max(nStripes, 0.0f);
+    std::vector<cv::Point> stripe_pt(nStripes, cv::Point(0, 0));
+    
+    cv::parallel_for_(cv::Range(0, nStripes), [&](const cv::Range &range)
     {
-        int temp_top = h - cSize;
-        int ntop = (temp_top > max_height) ? max_height : temp_top;
-        int temp_bottom = h + cSize;
-        int nbottom = (temp_bottom >= imSz.height-1) ? imSz.height-1 : temp_bottom; 
+        std::vector<int> col1(imSz.width), col2(imSz.width);
         
-        for(int w = 0; w < imSz.width; w++)
+        for(int s = range.start; s < range.end; s++)
         {
-            int temp_left = w - cSize;
-            int nleft = (temp_left > max_width) ? max_width : temp_left;
-            int temp_right = w + cSize;
-            int nright = (temp_right >= imSz.width-1) ? imSz.width-1 : temp_right; 
+            int *sHist = &stripe_hist[s * 256];
+            float mag_max = 0.0f;
+            cv::Point max_pt(0, 0);
             
-            // local mean
-            float n1 = (nleft > 0 && ntop > 0) ? src.at<float>(ntop, nleft-1): 0;
-            float n2 = (nleft > 0) ? src.at<float>(nbottom, nleft-1): 0;
-            float n3 = (ntop > 0) ? src.at<float>(ntop, nright): 0;
+            const int hBegin = imSz.height * s / nStripes;
+            const int hEnd = imSz.height * (s + 1) / nStripes;
             
-            float sum = src.at<float>(nbottom, nright) - n3 - n2 + n1;
-            float mean = sum / nSize;
+            // column sums over rows [hBegin - r, hBegin + r]
+            std::fill(col1.begin(), col1.end(), 0);
+            std::fill(col2.begin(), col2.end(), 0);
+            for(int y = std::max(0, hBegin - r); y <= std::min(imSz.height - 1, hBegin + r); y++)
+            {
+                const short *q1 = d1.ptr<short>(y);
+                const short *q2 = d2.ptr<short>(y);
+                for(int w = 0; w < imSz.width; w++) { col1[w] += q1[w]; col2[w] += q2[w]; }
+            }
             
-            if(mean > mean_max){
-                mean_max = mean;
-                max_pt.x = w;
-                max_pt.y = h;
+            for(int h = hBegin; h < hEnd; h++)
+            {
+                // slide down one row
+                if(h > hBegin)
+                {
+                    if(h + r < imSz.height)
+                    {
+                        const short *q1 = d1.ptr<short>(h + r);
+                        const short *q2 = d2.ptr<short>(h + r);
+                        for(int w = 0; w < imSz.width; w++) { col1[w] += q1[w]; col2[w] += q2[w]; }
+                    }
+                    if(h - r - 1 >= 0)
+                    {
+                        const short *q1 = d1.ptr<short>(h - r - 1);
+                        const short *q2 = d2.ptr<short>(h - r - 1);
+                        for(int w = 0; w < imSz.width; w++) { col1[w] -= q1[w]; col2[w] -= q2[w]; }
+                    }
+                }
+                
+                int sum1 = 0, sum2 = 0;
+                for(int w = 0; w < std::min(r, imSz.width); w++) { sum1 += col1[w]; sum2 += col2[w]; }
+                
+                uchar *sRow = smooth_map.ptr<uchar>(h);
+                for(int w = 0; w < imSz.width; w++)
+                {
+                    if(w + r < imSz.width) { sum1 += col1[w + r]; sum2 += col2[w + r]; }
+                    if(w - r - 1 >= 0)     { sum1 -= col1[w - r - 1]; sum2 -= col2[w - r - 1]; }
+                    
+                    // contrast of the window along its dominant orientation
+                    float m1 = sum1 * scale;
+                    float m2 = sum2 * scale * 0.70710678f;
+                    float mag = std::sqrt(m1*m1 + m2*m2);
+                    
+                    if(mag > mag_max){
+                        mag_max = mag;
+                        max_pt.x = w;
+                        max_pt.y = h;
+                    }
+                    
+                    uchar val = (mag > 255) ? 255 : mag;
+                    sRow[w] = val;
+                    sHist[val]++;
+                }
             }
             
-            smooth_map.at<uchar>(h,w) = (mean > 255) ? 255 : mean;
+            stripe_max[s] = mag_max;
+            stripe_pt[s] = max_pt;
+        }
+    });
+    
+    cv::Point max_pt(0, 0);
+    float mag_max = 0.0f;
+    for(int s = 0; s < nStripes; s++)
+    {
+        if(stripe_max[s] > mag_max){
+            mag_max = stripe_max[s];
+            max_pt = stripe_pt[s];
         }
+        for(int i = 0; i < 256; i++) hist[i] += stripe_hist[s * 256 + i];
     }
     
     return max_pt;
 }
 
-cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp)
+cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp, int thr)
 {
     cv::Rect result(0,0,0,0);
     
@@ -151,7 +292,7 @@ cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp)
     // lfet
     for(int w = cp.x; w >= 0; w--)
     {
-        if(src.at<uchar>(cp.y, w) < 128)
+        if(src.at<uchar>(cp.y, w) <= thr)
         {
             result.x = w;
             break;
@@ -161,7 +302,7 @@ cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp)
     // right
     for(int w = cp.x; w < imSz.width; w++)
     {
-        if(src.at<uchar>(cp.y, w) < 128)
+        if(src.at<uchar>(cp.y, w) <= thr)
         {
             result.width = w - result.x;
             break;
@@ -171,7 +312,7 @@ cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp)
     // up
     for(int h = cp.y; h >= 0; h--)
     {
-        if(src.at<uchar>(h, cp.x) < 128)
+        if(src.at<uchar>(h, cp.x) <= thr)
         {
             result.y = h;
             break;
@@ -181,7 +322,7 @@ cv::Rect Gallo::box_detection(cv::Mat &src, cv::Point cp)
     //down
     for(int h = cp.y; h < imSz.height; h++)
     {
-        if(src.at<uchar>(h, cp.x) < 128)
+        if(src.at<uchar>(h, cp.x) <= thr)
         {
             result.height = h - result.y;
             break;
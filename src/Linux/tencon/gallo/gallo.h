@@ -13,19 +13,37 @@
  *        only localization method! *    
  */
 
+#ifndef IY_GALLO_H
+#define IY_GALLO_H
+
 #include <opencv2/opencv.hpp>
+#include <cfloat>
+
+#include "common/imgproc.h"
 
 namespace iy{
     class Gallo {
     private:        
-        cv::Mat calc_gradient(cv::Mat &src);
+        // stride > 1: gradients on a coarse grid, read straight from the source
+        cv::Mat calc_gradient(cv::Mat &src, int stride = 1);
         cv::Mat calc_integral_image(cv::Mat &src);
-        cv::Point find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz);
-        cv::Rect box_detection(cv::Mat &src, cv::Point cp);
+        
+        // steerable mode: oriented contrast for any bar direction
+        void calc_steerable_gradient(cv::Mat &src, cv::Mat &d1, cv::Mat &d2, int stride = 1);
+        cv::Point find_max_point_steerable(cv::Mat &d1, cv::Mat &d2, cv::Mat &smooth_map, int WinSz, int *hist);
+        cv::Rect box_detection(cv::Mat &src, cv::Point cp, int thr);
+        cv::Rect detect(cv::Mat &gray_src, int stride, int WinSz, bool isSteerable);
     public:
         Gallo(){}   
         ~Gallo(){}  
         
-        cv::Rect process(cv::Mat &gray_src, int WinSz = 20);
+        // isSteerable: bars at any angle in one pass (default: vertical bars, |dx| only)
+        cv::Rect process(cv::Mat &gray_src, int WinSz = 20, bool isSteerable = false);
+        
+        // presence check on a stride 2 or 4 grid, all stages at the reduced size;
+        // roi is coarse (grid cells in source pixels), true if a region was found
+        bool preview(cv::Mat &gray_src, cv::Rect &roi, int stride = 4, int WinSz = 20, bool isSteerable = false);
     };
-};
\ No newline at end of file
+};
+
+#endif
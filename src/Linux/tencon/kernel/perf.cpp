@@ -0,0 +1,177 @@
+/*
+*  Hardware performance counters (Linux perf_event_open)
+*/
+
+#include "perf.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace iy;
+
+static const char *perf_names[IY_NUM_PERF] = { "cycles", "instructions", "l1d-misses", "llc-misses", "branch-misses" };
+
+PerfCounters::PerfCounters()
+{
+	memset(base, 0, sizeof(base));
+
+#ifdef __linux__
+	static const uint32_t types[IY_NUM_PERF] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+	};
+	static const uint64_t configs[IY_NUM_PERF] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int e = 0; e < IY_NUM_PERF; e++)
+	{
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[e];
+		attr.config = configs[e];
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		// calling thread on any cpu, counting from now on
+		fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		if (fd[e] < 0)
+		{
+			if (!error.empty()) error += ", ";
+			error += std::string(perf_names[e]) + ": " + strerror(errno);
+		}
+	}
+#else
+	for (int e = 0; e < IY_NUM_PERF; e++) fd[e] = -1;
+	error = "perf_event_open is only available on linux";
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+	for (int e = 0; e < IY_NUM_PERF; e++)
+		if (fd[e] >= 0) close(fd[e]);
+#endif
+}
+
+int PerfCounters::valid() const
+{
+	int bits = 0;
+	for (int e = 0; e < IY_NUM_PERF; e++)
+		if (fd[e] >= 0) bits |= 1 << e;
+	return bits;
+}
+
+bool PerfCounters::read_counter(int e, uint64_t val[3])
+{
+#ifdef __linux__
+	return fd[e] >= 0 && read(fd[e], val, 3 * sizeof(uint64_t)) == (ssize_t)(3 * sizeof(uint64_t));
+#else
+	(void)e;
+	(void)val;
+	return false;
+#endif
+}
+
+void PerfCounters::start()
+{
+	for (int e = 0; e < IY_NUM_PERF; e++)
+		if (!read_counter(e, base[e])) memset(base[e], 0, sizeof(base[e]));
+}
+
+void PerfCounters::stop(PerfStats &st, double mpix)
+{
+	for (int e = 0; e < IY_NUM_PERF; e++)
+	{
+		uint64_t val[3];
+		if (!read_counter(e, val)) continue;
+
+		const double count = (double)(val[0] - base[e][0]);
+		const double enabled = (double)(val[1] - base[e][1]);
+		const double running = (double)(val[2] - base[e][2]);
+
+		// multiplexed: the counter only ran for part of the interval
+		if (running <= 0) continue;
+		st.count[e] += (running < enabled) ? count * enabled / running : count;
+		st.valid |= 1 << e;
+	}
+
+	st.mpix += mpix;
+	st.nRuns++;
+}
+
+const char *PerfCounters::name(int e)
+{
+	return (e >= 0 && e < IY_NUM_PERF) ? perf_names[e] : "?";
+}
+
+void PerfCounters::clear(PerfStats &st)
+{
+	memset(&st, 0, sizeof(PerfStats));
+}
+
+void PerfCounters::add(PerfStats &dst, const PerfStats &src)
+{
+	for (int e = 0; e < IY_NUM_PERF; e++) dst.count[e] += src.count[e];
+	dst.valid |= src.valid;
+	dst.mpix += src.mpix;
+	dst.nRuns += src.nRuns;
+}
+
+// 1234567 -> "1.23M"
+static std::string compact(double v)
+{
+	static const char *suffix[] = { "", "k", "M", "G", "T" };
+
+	int i = 0;
+	while (v >= 1000 && i < 4) { v /= 1000; i++; }
+
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(v < 10 ? 2 : (v < 100 ? 1 : 0)) << v << suffix[i];
+	return os.str();
+}
+
+void PerfCounters::print_header(std::ostream &out, const char *label)
+{
+	out << std::left << std::setw(16) << label << std::right
+		<< std::setw(7) << "runs" << std::setw(9) << "Mpx"
+		<< std::setw(12) << "cycles/Mpx" << std::setw(12) << "instr/Mpx" << std::setw(6) << "IPC"
+		<< std::setw(12) << "L1D/Mpx" << std::setw(12) << "LLC/Mpx" << std::setw(12) << "branch/Mpx" << std::endl;
+}
+
+void PerfCounters::print(std::ostream &out, const std::string &label, const PerfStats &st)
+{
+	out << std::left << std::setw(16) << label << std::right
+		<< std::setw(7) << st.nRuns << std::setw(9) << compact(st.mpix);
+
+	for (int e = 0; e < IY_NUM_PERF; e++)
+	{
+		const bool isValid = (st.valid & (1 << e)) && st.mpix > 0;
+		out << std::setw(12) << (isValid ? compact(st.count[e] / st.mpix) : std::string("-"));
+
+		if (e == IY_PERF_INSTRUCTIONS)
+		{
+			const int need = (1 << IY_PERF_CYCLES) | (1 << IY_PERF_INSTRUCTIONS);
+			std::ostringstream ipc;
+			if ((st.valid & need) == need && st.count[IY_PERF_CYCLES] > 0)
+				ipc << std::fixed << std::setprecision(2) << st.count[IY_PERF_INSTRUCTIONS] / st.count[IY_PERF_CYCLES];
+			else ipc << "-";
+			out << std::setw(6) << ipc.str();
+		}
+	}
+	out << std::endl;
+}
@@ -0,0 +1,77 @@
+/*
+*  Hardware performance counters (Linux perf_event_open)
+*
+*   A PerfCounters object opens cycles, instructions, L1 data read misses,
+*   last level cache misses and branch misses for the thread that created
+*   it, user space only. start()/stop() bracket the work to measure and add
+*   the events in between to a PerfStats, scaled up when the kernel had to
+*   multiplex the counters. A counter that can not be opened (no PMU in a
+*   VM, perf_event_paranoid, another OS) is left out and reported as
+*   missing; without any counter start()/stop() do nothing. Work that the
+*   thread hands to others (cv::parallel_for_, a pool) is not counted; run
+*   with cv::setNumThreads(1) to keep it on the measured thread.
+*/
+
+#ifndef IY_KERNEL_PERF_H
+#define IY_KERNEL_PERF_H
+
+#include <ostream>
+#include <string>
+#include <stdint.h>
+
+namespace iy{
+	enum
+	{
+		IY_PERF_CYCLES = 0,
+		IY_PERF_INSTRUCTIONS,
+		IY_PERF_L1D_MISSES,          // L1 data cache read misses
+		IY_PERF_LLC_MISSES,          // last level cache misses
+		IY_PERF_BRANCH_MISSES,
+		IY_NUM_PERF
+	};
+
+	typedef struct
+	{
+		double count[IY_NUM_PERF];   // summed events
+		int valid;                   // bit (1 << IY_PERF_*) per counter that was read
+		double mpix;                 // megapixels the events were spent on
+		uint64_t nRuns;
+	} PerfStats;
+
+	class PerfCounters{
+	private:
+		int fd[IY_NUM_PERF];
+		uint64_t base[IY_NUM_PERF][3];   // value, time enabled, time running at start()
+		std::string error;
+
+		PerfCounters(const PerfCounters &);
+		PerfCounters &operator=(const PerfCounters &);
+
+		bool read_counter(int e, uint64_t val[3]);
+
+	public:
+		PerfCounters();
+		~PerfCounters();
+
+		// bits of the counters that are open, 0 if none could be
+		int valid() const;
+
+		// why counters are missing, empty if all are open
+		const std::string &getError() const { return error; }
+
+		void start();
+
+		// adds the events since start() and mpix megapixels to st
+		void stop(PerfStats &st, double mpix);
+
+		static const char *name(int e);
+		static void clear(PerfStats &st);
+		static void add(PerfStats &dst, const PerfStats &src);
+
+		// one row per call, events per megapixel; missing counters are printed as "-"
+		static void print_header(std::ostream &out, const char *label);
+		static void print(std::ostream &out, const std::string &label, const PerfStats &st);
+	};
+}
+
+#endif
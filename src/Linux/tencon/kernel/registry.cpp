@@ -0,0 +1,254 @@
+/*
+*  Kernel registry: reference and optimized variants of the detector stages
+*/
+
+#include "registry.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace iy;
+
+static const char *kernel_names[IY_NUM_KERNELS] = { "orientation", "saliency", "integral", "smooth", "ccl", "ando" };
+static const char *variant_names[IY_NUM_VARIANTS] = { "reference", "optimized" };
+
+// kernel time of this thread, taken by take_thread_ms()
+static thread_local double tl_ms[IY_NUM_KERNELS];
+
+KernelRegistry::KernelRegistry()
+{
+	for (int k = 0; k < IY_NUM_KERNELS; k++) variant[k] = IY_VARIANT_OPTIMIZED;
+	isVerify = false;
+	isCounters = false;
+	resetStats();
+
+	const char *spec = getenv("IY_KERNELS");
+	if (spec && !configure(spec)) std::cerr << "warning! IY_KERNELS: unknown kernel or variant in " << spec << std::endl;
+
+	const char *verify = getenv("IY_KERNEL_VERIFY");
+	if (verify && atoi(verify) != 0) isVerify = true;
+}
+
+KernelRegistry &KernelRegistry::get()
+{
+	static KernelRegistry registry;
+	return registry;
+}
+
+const char *KernelRegistry::kernel_name(int k)
+{
+	return (k >= 0 && k < IY_NUM_KERNELS) ? kernel_names[k] : "?";
+}
+
+const char *KernelRegistry::variant_name(int v)
+{
+	return (v >= 0 && v < IY_NUM_VARIANTS) ? variant_names[v] : "?";
+}
+
+static int find_name(const std::string &name, const char **names, int n)
+{
+	for (int i = 0; i < n; i++)
+		if (name == names[i]) return i;
+	return -1;
+}
+
+bool KernelRegistry::configure(const std::string &spec)
+{
+	bool isOk = true;
+	std::stringstream ss(spec);
+	std::string item;
+
+	while (std::getline(ss, item, ','))
+	{
+		if (item.empty()) continue;
+
+		size_t eq = item.find('=');
+		if (eq == std::string::npos)
+		{
+			// one variant for every kernel
+			int v = find_name(item, variant_names, IY_NUM_VARIANTS);
+			if (v < 0) { isOk = false; continue; }
+			for (int k = 0; k < IY_NUM_KERNELS; k++) variant[k] = v;
+		}
+		else
+		{
+			int k = find_name(item.substr(0, eq), kernel_names, IY_NUM_KERNELS);
+			int v = find_name(item.substr(eq + 1), variant_names, IY_NUM_VARIANTS);
+			if (k < 0 || v < 0) { isOk = false; continue; }
+			variant[k] = v;
+		}
+	}
+
+	return isOk;
+}
+
+// opened on the first counted call of a thread, closed when it exits
+static PerfCounters &thread_counters()
+{
+	thread_local PerfCounters counters;
+	return counters;
+}
+
+KernelTick KernelRegistry::tick()
+{
+	KernelTick t;
+	t.isCounting = counters();
+	if (t.isCounting) thread_counters().start();
+	t.t0 = cv::getTickCount();
+	return t;
+}
+
+void KernelRegistry::record(int k, int v, const KernelTick &t0, size_t pixels)
+{
+	const double ms = (cv::getTickCount() - t0.t0) * 1000.0 / cv::getTickFrequency();
+
+	PerfStats perf;
+	PerfCounters::clear(perf);
+	if (t0.isCounting) thread_counters().stop(perf, pixels * 1e-6);
+	tl_ms[k] += ms;
+
+	std::lock_guard<std::mutex> lock(sLock);
+	stats[k].nCalls[v]++;
+	stats[k].ms[v] += ms;
+	if (t0.isCounting) PerfCounters::add(stats[k].perf[v], perf);
+}
+
+void KernelRegistry::take_thread_ms(double ms[IY_NUM_KERNELS])
+{
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		ms[k] = tl_ms[k];
+		tl_ms[k] = 0;
+	}
+}
+
+void KernelRegistry::verified(int k, const std::string &where)
+{
+	std::lock_guard<std::mutex> lock(sLock);
+	stats[k].nChecks++;
+	if (where.empty()) return;
+
+	if (stats[k].nMismatches++ == 0)
+	{
+		stats[k].first = where;
+		std::cerr << "warning! " << kernel_names[k] << " variants disagree: " << where << std::endl;
+	}
+}
+
+KernelStats KernelRegistry::getStats(int k)
+{
+	std::lock_guard<std::mutex> lock(sLock);
+	return stats[k];
+}
+
+void KernelRegistry::resetStats()
+{
+	std::lock_guard<std::mutex> lock(sLock);
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		for (int v = 0; v < IY_NUM_VARIANTS; v++)
+		{
+			stats[k].nCalls[v] = 0;
+			stats[k].ms[v] = 0;
+			PerfCounters::clear(stats[k].perf[v]);
+		}
+		stats[k].nChecks = stats[k].nMismatches = 0;
+		stats[k].first.clear();
+	}
+}
+
+// reference unless the optimized variant ran, never disagreed and was faster
+static int fastest(const KernelStats &st)
+{
+	const int ref = IY_VARIANT_REFERENCE, opt = IY_VARIANT_OPTIMIZED;
+
+	if (st.nCalls[opt] == 0 || st.nMismatches > 0) return ref;
+	if (st.nCalls[ref] == 0) return (st.nChecks > 0) ? opt : -1;
+	return (st.ms[opt] / st.nCalls[opt] < st.ms[ref] / st.nCalls[ref]) ? opt : ref;
+}
+
+void KernelRegistry::report(std::ostream &out)
+{
+	out << "kernel       variant     calls   mean ms  checks  mismatches" << std::endl;
+	out << std::fixed << std::setprecision(3);
+
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		KernelStats st = getStats(k);
+		const int best = fastest(st);
+
+		for (int v = 0; v < IY_NUM_VARIANTS; v++)
+		{
+			if (st.nCalls[v] == 0) continue;
+
+			out << std::left << std::setw(13) << kernel_names[k] << std::setw(10) << variant_names[v]
+				<< (v == selected(k) ? "*" : " ") << std::right
+				<< std::setw(7) << st.nCalls[v]
+				<< std::setw(10) << st.ms[v] / st.nCalls[v];
+			if (v == IY_VARIANT_OPTIMIZED)
+				out << std::setw(8) << st.nChecks << std::setw(12) << st.nMismatches;
+			if (v == best && st.nCalls[IY_VARIANT_REFERENCE] && st.nCalls[IY_VARIANT_OPTIMIZED])
+				out << "  fastest";
+			out << std::endl;
+		}
+		if (st.nMismatches > 0) out << "  first mismatch: " << st.first << std::endl;
+	}
+
+	out << "(* selected)" << std::endl;
+	out.unsetf(std::ios::floatfield);
+}
+
+void KernelRegistry::report_counters(std::ostream &out)
+{
+	PerfCounters::print_header(out, "kernel");
+
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		KernelStats st = getStats(k);
+		for (int v = 0; v < IY_NUM_VARIANTS; v++)
+		{
+			if (st.perf[v].nRuns == 0) continue;
+			PerfCounters::print(out, std::string(kernel_names[k]) + (v == IY_VARIANT_REFERENCE ? " ref" : " opt"), st.perf[v]);
+		}
+	}
+}
+
+void KernelRegistry::select_fastest()
+{
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		int best = fastest(getStats(k));
+		if (best >= 0) variant[k] = best;
+	}
+}
+
+std::string iy::diff_maps(const cv::Mat &a, const cv::Mat &b, const char *name)
+{
+	std::ostringstream os;
+
+	if (a.size() != b.size() || a.type() != b.type())
+	{
+		os << name << ": " << a.cols << "x" << a.rows << " vs " << b.cols << "x" << b.rows;
+		return os.str();
+	}
+
+	const size_t esz = a.elemSize();
+	for (int y = 0; y < a.rows; y++)
+	{
+		const uchar *pa = a.ptr<uchar>(y);
+		const uchar *pb = b.ptr<uchar>(y);
+		if (memcmp(pa, pb, a.cols * esz) == 0) continue;
+
+		int x = 0;
+		while (memcmp(pa + x * esz, pb + x * esz, esz) == 0) x++;
+
+		os << name << " at (" << x << ", " << y << "): ";
+		if (a.depth() == CV_8U) os << (int)pa[x * esz] << " vs " << (int)pb[x * esz];
+		else if (a.depth() == CV_32S) os << a.ptr<int>(y)[x] << " vs " << b.ptr<int>(y)[x];
+		else os << "bytes differ";
+		return os.str();
+	}
+
+	return std::string();
+}
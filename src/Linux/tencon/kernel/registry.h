@@ -0,0 +1,122 @@
+/*
+*  Kernel registry: reference and optimized variants of the detector stages
+*
+*   Every registered stage has a scalar reference implementation and an
+*   optimized one. The variant in use is picked per stage at runtime, from
+*   IY_KERNELS ("reference", "optimized" or a list such as
+*   "smooth=reference,ccl=optimized") or through set_variant(). With
+*   verification on (IY_KERNEL_VERIFY=1 or set_verify()) both variants run on
+*   every call, the result of the selected one is used and the first
+*   mismatching pixel or rectangle is recorded. Both ways the time of every
+*   variant that ran is summed, so report() can show the fastest correct one
+*   per host. With counters on (set_counters()) every call is also wrapped
+*   in the hardware counters of its thread, see report_counters(). The
+*   registry is process wide and thread safe.
+*/
+
+#ifndef IY_KERNEL_REGISTRY_H
+#define IY_KERNEL_REGISTRY_H
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <stdint.h>
+
+#include "perf.h"
+
+namespace iy{
+	enum
+	{
+		IY_KERNEL_ORIENTATION = 0,   // Yun: gradient orientation and magnitude
+		IY_KERNEL_SALIENCY,          // Yun: block orientation entropy
+		IY_KERNEL_INTEGRAL,          // Yun: integral of the saliency map
+		IY_KERNEL_SMOOTH,            // Yun: box mean and its histogram
+		IY_KERNEL_CCL,               // Yun: labelling of the salient edges
+		IY_KERNEL_ANDO,              // Soros: structure tensor saliency
+		IY_NUM_KERNELS
+	};
+
+	enum
+	{
+		IY_VARIANT_REFERENCE = 0,
+		IY_VARIANT_OPTIMIZED,
+		IY_NUM_VARIANTS
+	};
+
+	typedef struct
+	{
+		uint64_t nCalls[IY_NUM_VARIANTS];
+		double ms[IY_NUM_VARIANTS];      // summed time per variant
+		uint64_t nChecks, nMismatches;   // verified calls, calls where the variants disagreed
+		std::string first;               // first mismatch
+		PerfStats perf[IY_NUM_VARIANTS]; // hardware counters per variant (counters on)
+	} KernelStats;
+
+	typedef struct
+	{
+		int64_t t0;                      // tick count before the variant ran
+		bool isCounting;                 // counters of the thread were started
+	} KernelTick;
+
+	class KernelRegistry{
+	private:
+		std::atomic<int> variant[IY_NUM_KERNELS];
+		std::atomic<bool> isVerify;
+		std::atomic<bool> isCounters;
+
+		std::mutex sLock;
+		KernelStats stats[IY_NUM_KERNELS];
+
+		KernelRegistry();
+
+	public:
+		static KernelRegistry &get();
+
+		static const char *kernel_name(int k);
+		static const char *variant_name(int v);
+		static int other(int v) { return (v == IY_VARIANT_REFERENCE) ? IY_VARIANT_OPTIMIZED : IY_VARIANT_REFERENCE; }
+
+		int selected(int k) const { return variant[k].load(std::memory_order_relaxed); }
+		bool verify() const { return isVerify.load(std::memory_order_relaxed); }
+		void set_variant(int k, int v) { variant[k] = v; }
+		void set_verify(bool is) { isVerify = is; }
+		bool counters() const { return isCounters.load(std::memory_order_relaxed); }
+		void set_counters(bool is) { isCounters = is; }
+
+		// "reference", "optimized" or "name=variant,..."; false on an unknown name
+		bool configure(const std::string &spec);
+
+		// taken before a variant runs, starts the counters of the calling thread
+		KernelTick tick();
+
+		// time (and counters) since t0, spent on a frame of pixels pixels
+		void record(int k, int v, const KernelTick &t0, size_t pixels);
+
+		// kernel time of the calling thread since the last call, the sums restart;
+		// brackets one frame for a trace
+		static void take_thread_ms(double ms[IY_NUM_KERNELS]);
+
+		// outcome of one verified call, where is empty when both variants agreed
+		void verified(int k, const std::string &where);
+
+		KernelStats getStats(int k);
+		void resetStats();
+
+		// per variant mean time and mismatches, the fastest correct variant marked
+		void report(std::ostream &out);
+
+		// per variant events per megapixel, from the calls made with counters on
+		void report_counters(std::ostream &out);
+
+		// select the fastest variant that never disagreed with the reference
+		void select_fastest();
+	};
+
+	// first differing pixel of two maps of the same type, empty if they are equal
+	std::string diff_maps(const cv::Mat &a, const cv::Mat &b, const char *name);
+}
+
+#endif
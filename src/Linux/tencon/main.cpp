@@ -5,11 +5,366 @@
 #include "gallo/gallo.h"
 #include "soros/soros.h"
 #include "yun/yun.h"
+#include "ensemble/ensemble.h"
+#include "trace/trace.h"
+#include "server/server.h"
+#include "pipeline/pipeline.h"
+#include "pool/pool.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <signal.h>
 
 // key
 const char* keys = 
     "{h        help |                      | print help message                            }"
-    "{file          | /file/dir/file_name  | test image file(.bmp .jpg .png)               }";
+    "{file          | /file/dir/file_name  | test image file(.bmp .jpg .png)               }"
+    "{bench         | 0                    | run each method N times and print the mean time}"
+    "{generic       |                      | use the generic Yun kernels (no specialization)}"
+    "{cascade       |                      | reject Yun blobs by aspect, purity and density  }"
+    "{steer         |                      | Gallo with steerable gradients (any bar angle)  }"
+    "{kernels       |                      | kernel variants, e.g. optimized or ccl=reference}"
+    "{verify        |                      | run reference and optimized kernels and compare }"
+    "{counters      |                      | bench/batch: hardware counters per stage and kernel}"
+    "{serve         |                      | run as daemon on this unix socket path        }"
+    "{workers       | 0                    | daemon detection threads (0: all cores)       }"
+    "{queue         | 64                   | daemon queue depth before requests are busy   }"
+    "{numa          | none                 | daemon/bench: bind threads to numa nodes (none, node, cpu)}"
+    "{threads       | 0                    | bench: scaling over pool workers up to N (0: off)}"
+    "{preview       | 0                    | presence check on a stride 2 or 4 grid (0: off)}"
+    "{ensemble      | 0                    | methods run concurrently, N must agree on a region (0: off)}"
+    "{tile          | 0                    | Yun on tiles within this many MB (0: off)     }"
+    "{overlap       | 256                  | pixels shared by neighbouring tiles           }"
+    "{list          |                      | batch: text file with one image path per line }"
+    "{out           |                      | batch: JSON lines output file (default stdout)}"
+    "{stages        | 2,1,1,1,2            | batch: threads of decode,gray,gallo,soros,yun }"
+    "{affinity      |                      | batch: cpu list per stage, e.g. 0-1;2;3;4;5-7;0}"
+    "{depth         | 16                   | batch: queue capacity between two stages      }"
+    "{cache         | 0                    | daemon/batch: cache results of N frames       }"
+    "{near          | 0                    | cache: hash bits a near duplicate may differ in}"
+    "{trace         |                      | daemon/batch: write frames of slow detections to this directory}"
+    "{slow          | 100                  | trace: detections slower than this many ms    }"
+    "{replay        |                      | rerun a trace --bench times (at least once), with --kernels and --counters}";
+
+static iy::Server *g_server = NULL;
+
+static void on_signal(int)
+{
+	if (g_server) g_server->stop();
+}
+
+// mean time of N detections per method, in milliseconds, and their hardware counters
+static void run_benchmark(cv::Mat &frame_gray, int N, bool isSteer, bool useCounters, iy::Gallo &mGallo, iy::Soros &mSoros, iy::Yun &mYun)
+{
+	cv::TickMeter tm;
+	const double mpix = frame_gray.total() * 1e-6;
+
+	std::unique_ptr<iy::PerfCounters> counters;
+	iy::PerfStats perf[3];
+	if (useCounters) counters.reset(new iy::PerfCounters());
+	for (int m = 0; m < 3; m++) iy::PerfCounters::clear(perf[m]);
+
+	tm.reset();
+	for (int i = 0; i < N; i++)
+	{
+		if (counters) counters->start();
+		tm.start(); mGallo.process(frame_gray, 20, isSteer); tm.stop();
+		if (counters) counters->stop(perf[0], mpix);
+	}
+	std::cout << "gallo: " << tm.getTimeMilli() / N << " ms" << std::endl;
+
+	tm.reset();
+	for (int i = 0; i < N; i++)
+	{
+		if (counters) counters->start();
+		tm.start(); mSoros.process(frame_gray, 20); tm.stop();
+		if (counters) counters->stop(perf[1], mpix);
+	}
+	std::cout << "soros: " << tm.getTimeMilli() / N << " ms" << std::endl;
+
+	iy::YunResult yres;
+	tm.reset();
+	for (int i = 0; i < N; i++)
+	{
+		if (counters) counters->start();
+		tm.start(); mYun.process(frame_gray, yres); tm.stop();
+		if (counters) counters->stop(perf[2], mpix);
+	}
+	std::cout << "yun  : " << tm.getTimeMilli() / N << " ms" << std::endl;
+
+	if (counters)
+	{
+		static const char *names[3] = { "gallo", "soros", "yun" };
+
+		if (!counters->getError().empty()) std::cout << "counters missing: " << counters->getError() << std::endl;
+		if (counters->valid())
+		{
+			iy::PerfCounters::print_header(std::cout, "method");
+			for (int m = 0; m < 3; m++) iy::PerfCounters::print(std::cout, names[m], perf[m]);
+			iy::KernelRegistry::get().report_counters(std::cout);
+		}
+	}
+
+	// where the blobs of all runs went
+	iy::YunCascadeStats st = mYun.getCascadeStats();
+	if (mYun.getParams().useCascade && st.nBlobs > 0)
+	{
+		std::cout << "yun cascade: " << st.nBlobs << " blobs, rejected "
+			<< 100.0 * st.nAspect / st.nBlobs << "% aspect, "
+			<< 100.0 * st.nPurity / st.nBlobs << "% purity, "
+			<< 100.0 * st.nDensity / st.nBlobs << "% density; "
+			<< st.nVerified << " verified, " << st.nBarcode << " barcodes" << std::endl;
+	}
+}
+
+// full detection against the preview on a stride grid, mean of N runs per method
+static void run_preview(cv::Mat &frame_gray, int N, int stride, bool isSteer, iy::Gallo &mGallo, iy::Soros &mSoros, iy::Yun &mYun)
+{
+	static const char *names[3] = { "gallo", "soros", "yun" };
+	cv::TickMeter tm;
+	double full[3], fast[3];
+	bool isFound[3];
+	cv::Rect roi;
+	iy::YunResult yres;
+
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); mGallo.process(frame_gray, 20, isSteer); tm.stop(); }
+	full[0] = tm.getTimeMilli() / N;
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); isFound[0] = mGallo.preview(frame_gray, roi, stride, 20, isSteer); tm.stop(); }
+	fast[0] = tm.getTimeMilli() / N;
+
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); mSoros.process(frame_gray, true, 20); tm.stop(); }
+	full[1] = tm.getTimeMilli() / N;
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); isFound[1] = mSoros.preview(frame_gray, roi, stride, true, 20); tm.stop(); }
+	fast[1] = tm.getTimeMilli() / N;
+
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); mYun.process(frame_gray, yres); tm.stop(); }
+	full[2] = tm.getTimeMilli() / N;
+	tm.reset();
+	for (int i = 0; i < N; i++) { tm.start(); isFound[2] = mYun.preview(frame_gray, stride, yres); tm.stop(); }
+	fast[2] = tm.getTimeMilli() / N;
+
+	const std::streamsize prec = std::cout.precision();
+	std::cout << "preview on a stride " << stride << " grid" << std::endl;
+	std::cout << "method" << std::setw(11) << "full ms" << std::setw(12) << "preview ms"
+		<< std::setw(9) << "speedup" << std::setw(7) << "found" << std::endl;
+	for (int m = 0; m < 3; m++)
+	{
+		std::cout << std::left << std::setw(6) << names[m] << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(11) << full[m] << std::setw(12) << fast[m]
+			<< std::setw(8) << std::setprecision(1) << full[m] / std::max(fast[m], 1e-6) << "x"
+			<< std::setw(7) << (isFound[m] ? "yes" : "no") << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+	std::cout.precision(prec);
+}
+
+// the three methods one after another against the ensemble, with and without early return
+static void run_ensemble(cv::Mat &frame_gray, int N, int minVotes, bool isSteer, iy::Gallo &mGallo, iy::Soros &mSoros, iy::Yun &mYun)
+{
+	cv::TickMeter tm;
+	iy::YunResult yres;
+
+	tm.reset();
+	for (int i = 0; i < N; i++)
+	{
+		tm.start();
+		mGallo.process(frame_gray, 20, isSteer);
+		mSoros.process(frame_gray, true, 20);
+		mYun.process(frame_gray, yres);
+		tm.stop();
+	}
+	std::cout << "sequential    : " << tm.getTimeMilli() / N << " ms" << std::endl;
+
+	iy::EnsembleParams epam;
+	epam.methods = (1 << iy::IY_NUM_METHODS) - 1;
+	epam.minVotes = minVotes;
+	epam.iouT = 0.3;
+	epam.WinSz = 20;
+	epam.isSteerable = isSteer;
+	epam.pool = NULL;
+
+	for (int e = 0; e < 2; e++)
+	{
+		epam.isEarly = (e == 1);
+		iy::Ensemble ensemble(epam);
+		ensemble.getYun().setParams(mYun.getParams());
+
+		iy::EnsembleResult eres;
+		int nEarly = 0;
+		tm.reset();
+		for (int i = 0; i < N; i++)
+		{
+			// latency of the answer, the discarded detectors finish outside the
+			// timer: a single frame, not the rate of back to back frames
+			tm.start(); ensemble.process(frame_gray, eres); tm.stop();
+			ensemble.wait();
+			if (eres.isEarly) nEarly++;
+		}
+		std::cout << (epam.isEarly ? "ensemble early: " : "ensemble      : ") << tm.getTimeMilli() / N
+			<< (epam.isEarly ? " ms single-shot latency, " : " ms, ")
+			<< eres.regions.size() << " regions with " << minVotes << " votes";
+		if (epam.isEarly) std::cout << ", " << nEarly << "/" << N << " returned early";
+		std::cout << std::endl;
+	}
+}
+
+// frames per second of all three methods on 1, 2, 4 .. maxThreads pool workers
+static void run_scaling(cv::Mat &frame_gray, int N, int maxThreads, int affinity, bool isSteer)
+{
+	// everything a worker touches per frame, made by the worker itself
+	typedef struct
+	{
+		cv::Mat gray;
+		iy::Gallo gallo;
+		iy::Soros soros;
+		iy::Yun yun;
+		iy::YunResult yres;
+	} Workspace;
+
+	std::cout << "threads  nodes      fps  speedup  efficiency  stolen" << std::endl;
+
+	double fps1 = 0;
+	for (int t = 1; ; t = std::min(2 * t, maxThreads))
+	{
+		iy::PoolParams ppam;
+		ppam.nWorkers = t;
+		ppam.nNodes = 0;
+		ppam.affinity = affinity;
+		iy::ThreadPool pool(ppam);
+
+		std::vector<std::unique_ptr<Workspace> > ws(t);
+		auto run = [&](int w, size_t) {
+			if (!ws[w])
+			{
+				ws[w].reset(new Workspace());
+				frame_gray.copyTo(ws[w]->gray);
+			}
+			ws[w]->gallo.process(ws[w]->gray, 20, isSteer);
+			ws[w]->soros.process(ws[w]->gray, 20);
+			ws[w]->yun.process(ws[w]->gray, ws[w]->yres);
+		};
+
+		pool.parallel_for(t, run);   // warm up the workspaces
+
+		int64_t t0 = cv::getTickCount();
+		pool.parallel_for((size_t)N * t, run);
+		const double sec = (cv::getTickCount() - t0) / cv::getTickFrequency();
+
+		uint64_t stolen = 0;
+		std::vector<iy::PoolStats> ps = pool.getStats();
+		for (size_t w = 0; w < ps.size(); w++) stolen += ps[w].nStolen;
+
+		const double fps = N * t / sec;
+		if (t == 1) fps1 = fps;
+		std::cout << std::setw(7) << t << std::setw(7) << pool.num_nodes()
+			<< std::fixed << std::setprecision(1) << std::setw(9) << fps
+			<< std::setprecision(2) << std::setw(9) << fps / fps1
+			<< std::setw(12) << fps / fps1 / t << std::setw(8) << stolen << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+
+		if (t >= maxThreads) break;
+	}
+}
+
+// a recorded slow detection run again with its frame, params and kernel variants
+static int run_replay(const std::string &path, int N, bool keepKernels, bool useCounters)
+{
+	static const char *names[iy::IY_NUM_METHODS] = { "gallo", "soros", "yun" };
+
+	iy::FrameTrace trace;
+	if (!iy::read_trace(path, trace))
+	{
+		std::cerr << "error! read trace" << std::endl;
+		return -1;
+	}
+
+	// variants given on the command line win over the recorded ones
+	iy::KernelRegistry &kernels = iy::KernelRegistry::get();
+	if (!keepKernels)
+		for (int k = 0; k < iy::IY_NUM_KERNELS; k++) kernels.set_variant(k, trace.variant[k]);
+
+	iy::Gallo gallo;
+	iy::Soros soros;
+	iy::Yun yun;
+	yun.setParams(trace.yun);
+	iy::YunResult yres;
+	cv::Rect rt;
+
+	std::unique_ptr<iy::PerfCounters> counters;
+	iy::PerfStats perf;
+	if (useCounters) counters.reset(new iy::PerfCounters());
+	iy::PerfCounters::clear(perf);
+
+	double kms[iy::IY_NUM_KERNELS], sum[iy::IY_NUM_KERNELS] = { 0 };
+	double total = 0;
+	iy::KernelRegistry::take_thread_ms(kms);
+	for (int i = 0; i < N; i++)
+	{
+		if (counters) counters->start();
+		const int64_t t0 = cv::getTickCount();
+		if (trace.method == iy::IY_GALLO) rt = gallo.process(trace.gray, trace.WinSz, trace.isSteerable);
+		else if (trace.method == iy::IY_SOROS) rt = soros.process(trace.gray, true, trace.WinSz);
+		else yun.process(trace.gray, yres);
+		total += (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+		if (counters) counters->stop(perf, trace.gray.total() * 1e-6);
+
+		iy::KernelRegistry::take_thread_ms(kms);
+		for (int k = 0; k < iy::IY_NUM_KERNELS; k++) sum[k] += kms[k];
+	}
+
+	std::cout << "trace: " << names[trace.method] << " " << trace.gray.cols << "x" << trace.gray.rows
+		<< ", " << N << " runs" << std::endl;
+	std::cout << "stage        variant     recorded     replay" << std::endl;
+	std::cout << std::fixed << std::setprecision(2);
+
+	double kRecorded = 0, kReplay = 0;
+	for (int k = 0; k < iy::IY_NUM_KERNELS; k++)
+	{
+		if (trace.kernel_ms[k] <= 0 && sum[k] <= 0) continue;
+
+		std::cout << std::left << std::setw(13) << iy::KernelRegistry::kernel_name(k)
+			<< std::setw(10) << iy::KernelRegistry::variant_name(kernels.selected(k)) << std::right
+			<< std::setw(10) << trace.kernel_ms[k] << std::setw(11) << sum[k] / N << std::endl;
+		kRecorded += trace.kernel_ms[k];
+		kReplay += sum[k] / N;
+	}
+	std::cout << std::left << std::setw(23) << "other" << std::right
+		<< std::setw(10) << trace.ms - kRecorded << std::setw(11) << total / N - kReplay << std::endl;
+	std::cout << std::left << std::setw(23) << "total" << std::right
+		<< std::setw(10) << trace.ms << std::setw(11) << total / N << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+
+	if (trace.method == iy::IY_YUN) std::cout << yres.size() << " barcodes" << std::endl;
+	else std::cout << "region " << rt.x << "," << rt.y << " " << rt.width << "x" << rt.height << std::endl;
+
+	if (counters)
+	{
+		if (!counters->getError().empty()) std::cout << "counters missing: " << counters->getError() << std::endl;
+		if (counters->valid())
+		{
+			iy::PerfCounters::print_header(std::cout, "method");
+			iy::PerfCounters::print(std::cout, names[trace.method], perf);
+			kernels.report_counters(std::cout);
+		}
+	}
+	if (kernels.verify()) kernels.report(std::cout);
+
+	return 0;
+}
+
+static int parse_affinity(const std::string &name)
+{
+	if (name == "node") return iy::IY_AFFINITY_NODE;
+	if (name == "cpu") return iy::IY_AFFINITY_CPU;
+	return iy::IY_AFFINITY_NONE;
+}
 
 int main(int argc, char* argv[])
 {
@@ -21,6 +376,92 @@ int main(int argc, char* argv[])
 		return 0;
     }
 	
+	if (cmd.has("serve"))
+	{
+		iy::ServerParams pam;
+		pam.path = cmd.get<std::string>("serve");
+		pam.nWorkers = cmd.get<int>("workers");
+		pam.maxQueue = cmd.get<int>("queue");
+		pam.cacheSize = std::max(0, cmd.get<int>("cache"));
+		pam.cacheDistance = cmd.get<int>("near");
+		pam.affinity = parse_affinity(cmd.get<std::string>("numa"));
+		if (cmd.has("trace")) pam.trace.dir = cmd.get<std::string>("trace");
+		pam.trace.thresholdMs = cmd.get<double>("slow");
+		pam.trace.maxTraces = 100;
+
+		iy::Server server;
+		g_server = &server;
+		signal(SIGINT, on_signal);
+		signal(SIGTERM, on_signal);
+		signal(SIGPIPE, SIG_IGN);
+
+		return server.run(pam) ? 0 : -1;
+	}
+
+	// the counters follow one thread: parallel loops stay on the thread that
+	// calls them, so their work is counted too (and timed serially)
+	if (cmd.has("counters"))
+	{
+		cv::setNumThreads(1);
+		std::cerr << "counters: OpenCV parallel loops run on the calling thread" << std::endl;
+	}
+
+	if (cmd.has("list"))
+	{
+		std::ifstream lf(cmd.get<std::string>("list").c_str());
+		if (!lf)
+		{
+			std::cerr << "error! read list" << std::endl;
+			return -1;
+		}
+
+		std::vector<std::string> files;
+		std::string line;
+		while (std::getline(lf, line))
+			if (!line.empty()) files.push_back(line);
+
+		iy::PipelineParams pam;
+		std::stringstream ts(cmd.get<std::string>("stages"));
+		std::stringstream as(cmd.get<std::string>("affinity"));
+		for (int s = 0; s < iy::IY_NUM_STAGES; s++)
+		{
+			std::string field;
+			pam.stage[s].nThreads = std::getline(ts, field, ',') ? atoi(field.c_str()) : 1;
+			if (std::getline(as, field, ';')) pam.stage[s].cpus = iy::Pipeline::parse_cpulist(field);
+		}
+		pam.depth = cmd.get<int>("depth");
+		pam.cacheSize = std::max(0, cmd.get<int>("cache"));
+		pam.cacheDistance = cmd.get<int>("near");
+		pam.useCounters = cmd.has("counters");
+		if (cmd.has("trace")) pam.trace.dir = cmd.get<std::string>("trace");
+		pam.trace.thresholdMs = cmd.get<double>("slow");
+		pam.trace.maxTraces = 100;
+
+		iy::Pipeline pipeline;
+		bool isOk;
+		if (cmd.has("out"))
+		{
+			std::ofstream of(cmd.get<std::string>("out").c_str());
+			isOk = pipeline.run(files, of, pam);
+		}
+		else isOk = pipeline.run(files, std::cout, pam);
+
+		pipeline.print_stats(std::cerr);
+		return isOk ? 0 : -1;
+	}
+
+	iy::KernelRegistry &kernels = iy::KernelRegistry::get();
+	if (cmd.has("kernels") && !kernels.configure(cmd.get<std::string>("kernels")))
+	{
+		std::cerr << "error! unknown kernel or variant" << std::endl;
+		return -1;
+	}
+	if (cmd.has("verify")) kernels.set_verify(true);
+	if (cmd.has("counters")) kernels.set_counters(true);
+
+	if (cmd.has("replay"))
+		return run_replay(cmd.get<std::string>("replay"), std::max(1, cmd.get<int>("bench")), cmd.has("kernels"), cmd.has("counters"));
+
 	std::string fn = cmd.get<std::string>("file");
 	
 	iy::Gallo mGallo;
@@ -37,22 +478,126 @@ int main(int argc, char* argv[])
 
 	cv::cvtColor(frame, frame_gray, cv::COLOR_BGR2GRAY);
 
-	cv::Rect g_rt = mGallo.process(frame_gray, 20);
-	cv::rectangle(frame, g_rt, cv::Scalar(0, 255, 0), 2);
+	if (cmd.has("generic"))
+	{
+		iy::YunParams pam = mYun.getParams();
+		pam.useSpecialized = false;
+		mYun.setParams(pam);
+	}
 
-	cv::Rect s_rt = mSoros.process(frame_gray, 20);
-	cv::rectangle(frame, s_rt, cv::Scalar(255,0,0), 2);
+	if (cmd.has("cascade"))
+	{
+		iy::YunParams pam = mYun.getParams();
+		pam.useCascade = true;
+		mYun.setParams(pam);
+	}
+
+	int bench = cmd.get<int>("bench");
+	if (bench > 0)
+	{
+		run_benchmark(frame_gray, bench, cmd.has("steer"), cmd.has("counters"), mGallo, mSoros, mYun);
+		if (cmd.get<int>("preview") > 0)
+			run_preview(frame_gray, bench, cmd.get<int>("preview"), cmd.has("steer"), mGallo, mSoros, mYun);
+		if (cmd.get<int>("ensemble") > 0)
+			run_ensemble(frame_gray, bench, cmd.get<int>("ensemble"), cmd.has("steer"), mGallo, mSoros, mYun);
+		if (cmd.get<int>("threads") > 0)
+			run_scaling(frame_gray, bench, cmd.get<int>("threads"), parse_affinity(cmd.get<std::string>("numa")), cmd.has("steer"));
+		if (kernels.verify()) kernels.report(std::cout);
+		return 0;
+	}
+
+	iy::YunResult list_barcode;
+
+	int tileMB = cmd.get<int>("tile");
+	if (tileMB > 0)
+	{
+		// very large images: the single box methods would need full frame maps
+		iy::YunTileParams tpam;
+		tpam.maxBytes = (size_t)tileMB << 20;
+		tpam.overlap = cmd.get<int>("overlap");
+		tpam.nThreads = 0;
+
+		// with an affinity the tiles run on a pool spread over the numa nodes
+		std::unique_ptr<iy::ThreadPool> pool;
+		const int affinity = parse_affinity(cmd.get<std::string>("numa"));
+		if (affinity != iy::IY_AFFINITY_NONE)
+		{
+			iy::PoolParams ppam;
+			ppam.nWorkers = 0;
+			ppam.nNodes = 0;
+			ppam.affinity = affinity;
+			pool.reset(new iy::ThreadPool(ppam));
+		}
+		tpam.pool = pool.get();
+		list_barcode.assign(mYun.process_tiled(frame_gray, tpam));
+
+		cv::Rect s_rt = mSoros.process_tiled(frame_gray, tpam.maxBytes);
+		cv::rectangle(frame, s_rt, cv::Scalar(255, 0, 0), 2);
+	}
+	else if (cmd.get<int>("preview") > 0)
+	{
+		// coarse regions only, is there any barcode at all
+		const int stride = cmd.get<int>("preview");
+		cv::Rect g_rt, s_rt;
+		bool isFound = mGallo.preview(frame_gray, g_rt, stride, 20, cmd.has("steer"));
+		cv::rectangle(frame, g_rt, cv::Scalar(0, 255, 0), 1);
+
+		isFound |= mSoros.preview(frame_gray, s_rt, stride);
+		cv::rectangle(frame, s_rt, cv::Scalar(255, 0, 0), 1);
+
+		isFound |= mYun.preview(frame_gray, stride, list_barcode);
+		std::cout << "preview: " << (isFound ? "barcode" : "no barcode") << std::endl;
+	}
+	else if (cmd.get<int>("ensemble") > 0)
+	{
+		// fused regions only, thicker with more votes
+		iy::EnsembleParams epam;
+		epam.methods = (1 << iy::IY_NUM_METHODS) - 1;
+		epam.minVotes = cmd.get<int>("ensemble");
+		epam.iouT = 0.3;
+		epam.isEarly = true;
+		epam.WinSz = 20;
+		epam.isSteerable = cmd.has("steer");
+		epam.pool = NULL;
+
+		iy::Ensemble ensemble(epam);
+		ensemble.getYun().setParams(mYun.getParams());
+
+		iy::EnsembleResult eres;
+		ensemble.process(frame_gray, eres);
+		for (size_t i = 0; i < eres.regions.size(); i++)
+		{
+			cv::rectangle(frame, eres.regions[i].roi, cv::Scalar(255, 0, 255), eres.regions[i].votes);
+			const cv::Rect &rt = eres.regions[i].roi;
+			std::cout << "region " << rt.x << "," << rt.y << " " << rt.width << "x" << rt.height << ": " << eres.regions[i].votes << " votes" << std::endl;
+		}
+		std::cout << "ensemble: " << (eres.isEarly ? "early return" : "all methods") << std::endl;
+	}
+	else
+	{
+		cv::Rect g_rt = mGallo.process(frame_gray, 20, cmd.has("steer"));
+		cv::rectangle(frame, g_rt, cv::Scalar(0, 255, 0), 2);
+
+		cv::Rect s_rt = mSoros.process(frame_gray, 20);
+		cv::rectangle(frame, s_rt, cv::Scalar(255,0,0), 2);
+
+		mYun.process(frame_gray, list_barcode);
+	}
+
+	if (kernels.verify()) kernels.report(std::cout);
 
-	std::vector<iy::YunCandidate> list_barcode = mYun.process(frame_gray);
 	if (!list_barcode.empty())
 	{
-		for (std::vector<iy::YunCandidate>::iterator it = list_barcode.begin(); it < list_barcode.end(); it++)
+		for (size_t i = 0; i < list_barcode.size(); i++)
 		{
-			if (it->isBarcode)
-			{
-				cv::Rect y_rt = it->roi;
-				cv::rectangle(frame, y_rt, cv::Scalar(0, 255, 255), 2);
-			}
+			cv::Rect y_rt = list_barcode.roi[i];
+			cv::rectangle(frame, y_rt, cv::Scalar(0, 255, 255), 2);
+
+			// the oriented box the decoder would crop
+			cv::Point2f pts[4];
+			list_barcode.box[i].points(pts);
+			for (int k = 0; k < 4; k++)
+				cv::line(frame, pts[k], pts[(k + 1) % 4], cv::Scalar(0, 0, 255), 1);
 		}
 
 		list_barcode.clear();
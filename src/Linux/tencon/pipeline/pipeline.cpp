@@ -0,0 +1,385 @@
+/*
+*  Batch pipeline: decode -> gray -> Gallo -> Soros -> Yun -> output
+*/
+
+#include "pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+using namespace iy;
+
+static const char *stage_name[IY_NUM_STAGES] = { "decode", "gray", "gallo", "soros", "yun", "output" };
+
+static double elapsed_ms(int64_t t0)
+{
+	return (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+}
+
+// spin briefly, then sleep; stages are never parked on a lock
+static void backoff(int n)
+{
+	if (n < 64) std::this_thread::yield();
+	else std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+// Yun barcodes add their oriented box
+static void json_rect(std::ostringstream &os, const cv::Rect &rt, int orientation, const cv::RotatedRect *box = NULL)
+{
+	os << "{\"x\":" << rt.x << ",\"y\":" << rt.y << ",\"w\":" << rt.width << ",\"h\":" << rt.height
+		<< ",\"orientation\":" << orientation;
+	if (box)
+	{
+		os << ",\"box\":{\"cx\":" << box->center.x << ",\"cy\":" << box->center.y
+			<< ",\"w\":" << box->size.width << ",\"h\":" << box->size.height << ",\"angle\":" << box->angle << "}";
+	}
+	os << "}";
+}
+
+static void json_string(std::ostringstream &os, const std::string &str)
+{
+	os << "\"";
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		if (str[i] == '"' || str[i] == '\\') os << "\\";
+		os << str[i];
+	}
+	os << "\"";
+}
+
+bool Pipeline::run(const std::vector<std::string> &files, std::ostream &out, PipelineParams pams)
+{
+	pam = pams;
+	if (pam.depth <= 0) pam.depth = 1;
+	pam.stage[IY_STAGE_DECODE].nThreads = std::max(1, pam.stage[IY_STAGE_DECODE].nThreads);
+	pam.stage[IY_STAGE_GRAY].nThreads = std::max(1, pam.stage[IY_STAGE_GRAY].nThreads);
+	pam.stage[IY_STAGE_OUTPUT].nThreads = 1;   // ordered writer
+
+	active.clear();
+	for (int s = 0; s < IY_NUM_STAGES; s++)
+		if (pam.stage[s].nThreads > 0) active.push_back(s);
+
+	links.clear();
+	links.resize(active.size());
+	for (size_t i = 1; i < active.size(); i++)
+	{
+		const int nProd = pam.stage[active[i - 1]].nThreads;
+		const int nCons = pam.stage[active[i]].nThreads;
+
+		Link *link = new Link();
+		if (nProd == 1 && nCons == 1) link->spsc.reset(new SpscQueue<PipeFrame *>(pam.depth));
+		else link->mpmc.reset(new MpmcQueue<PipeFrame *>(pam.depth));
+		link->producers = nProd;
+		links[i].reset(link);
+	}
+
+	for (int s = 0; s < IY_NUM_STAGES; s++)
+	{
+		memset(&stats[s], 0, sizeof(StageStats));
+		stats[s].nThreads = pam.stage[s].nThreads;
+	}
+	perfError.clear();
+	for (size_t i = 1; i < active.size(); i++)
+		stats[active[i]].capacity = links[i]->spsc ? links[i]->spsc->capacity() : links[i]->mpmc->capacity();
+
+	cacheNeed = 0;
+	if (pam.stage[IY_STAGE_GALLO].nThreads > 0) cacheNeed |= IY_CACHE_GALLO;
+	if (pam.stage[IY_STAGE_SOROS].nThreads > 0) cacheNeed |= IY_CACHE_SOROS;
+	if (pam.stage[IY_STAGE_YUN].nThreads > 0) cacheNeed |= IY_CACHE_YUN;
+
+	if (pam.cacheSize > 0 && cacheNeed != 0) cache.reset(new ResultCache(pam.cacheSize, pam.cacheDistance));
+	else cache.reset();
+
+	if (!pam.trace.dir.empty()) tracer.reset(new TraceRecorder(pam.trace));
+	else tracer.reset();
+
+	paths = &files;
+	next = 0;
+	os = &out;
+
+	int64_t t0 = cv::getTickCount();
+
+	std::vector<std::thread> pool;
+	for (size_t i = 0; i < active.size(); i++)
+		for (int t = 0; t < pam.stage[active[i]].nThreads; t++)
+			pool.push_back(std::thread(&Pipeline::stage, this, (int)i, t));
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+
+	wall_ms = elapsed_ms(t0);
+	out.flush();
+
+	return out.good();
+}
+
+void Pipeline::stage(int idx, int tid)
+{
+	const int s = active[idx];
+	pin(s, tid);
+
+	// detectors of this thread, only the one of the stage is used
+	Gallo gallo;
+	Soros soros;
+	Yun yun;
+
+	Link *in = (idx > 0) ? links[idx].get() : NULL;
+	Link *out = (idx + 1 < (int)active.size()) ? links[idx + 1].get() : NULL;
+
+	StageStats local;
+	memset(&local, 0, sizeof(StageStats));
+
+	// counters count the thread that opened them
+	std::unique_ptr<PerfCounters> counters;
+	if (pam.useCounters) counters.reset(new PerfCounters());
+
+	// output stage: frames held back until their predecessors are written
+	std::map<int, PipeFrame *> pending;
+	int nextSeq = 0;
+
+	for (;;)
+	{
+		PipeFrame *item;
+		if (in == NULL)
+		{
+			int i = next++;
+			if (i >= (int)paths->size()) break;
+
+			item = new PipeFrame();
+			item->seq = i;
+			item->isCached = false;
+			item->path = (*paths)[i];
+		}
+		else if (!pull(*in, item, local.wait_ms, local.depth_sum)) break;
+
+		double mpix = (item->frame.empty() ? item->gray.total() : item->frame.total()) * 1e-6;
+		if (counters) counters->start();
+		int64_t t0 = cv::getTickCount();
+
+		if (s == IY_STAGE_DECODE)
+		{
+			item->frame = cv::imread(item->path);
+			mpix = item->frame.total() * 1e-6;
+		}
+		else if (s == IY_STAGE_GRAY)
+		{
+			if (!item->frame.empty()) cv::cvtColor(item->frame, item->gray, cv::COLOR_BGR2GRAY);
+			item->frame.release();
+
+			if (cache && !item->gray.empty()) lookup(*item);
+		}
+		else if (s == IY_STAGE_OUTPUT)
+		{
+			if (cache && !item->gray.empty() && !item->isCached) store(*item);
+
+			pending[item->seq] = item;
+			while (!pending.empty() && pending.begin()->first == nextSeq)
+			{
+				PipeFrame *done = pending.begin()->second;
+				*os << serialize(*done) << "\n";
+				delete done;
+				pending.erase(pending.begin());
+				nextSeq++;
+			}
+			item = NULL;
+		}
+		else if (!item->gray.empty() && !item->isCached)
+		{
+			detect(s, *item, gallo, soros, yun);
+		}
+
+		double ms = elapsed_ms(t0);
+		if (counters) counters->stop(local.perf, mpix);
+		local.nItems++;
+		local.busy_ms += ms;
+		local.max_ms = std::max(local.max_ms, ms);
+
+		if (out) push(*out, item, local.wait_ms);
+	}
+
+	if (out) out->producers.fetch_sub(1, std::memory_order_release);
+
+	std::lock_guard<std::mutex> lock(sLock);
+	stats[s].nItems += local.nItems;
+	stats[s].busy_ms += local.busy_ms;
+	stats[s].wait_ms += local.wait_ms;
+	stats[s].max_ms = std::max(stats[s].max_ms, local.max_ms);
+	stats[s].depth_sum += local.depth_sum;
+	PerfCounters::add(stats[s].perf, local.perf);
+	if (counters && perfError.empty()) perfError = counters->getError();
+}
+
+bool Pipeline::pull(Link &in, PipeFrame *&item, double &wait_ms, double &depth_sum)
+{
+	depth_sum += in.spsc ? in.spsc->size() : in.mpmc->size();
+
+	int64_t t0 = cv::getTickCount();
+	for (int n = 0; ; n++)
+	{
+		// read before the last try, so a frame pushed just before the producers left is not lost
+		const bool isDrained = in.producers.load(std::memory_order_acquire) == 0;
+
+		if (in.spsc ? in.spsc->pop(item) : in.mpmc->pop(item)) break;
+		if (isDrained)
+		{
+			wait_ms += elapsed_ms(t0);
+			return false;
+		}
+		backoff(n);
+	}
+
+	wait_ms += elapsed_ms(t0);
+	return true;
+}
+
+void Pipeline::push(Link &out, PipeFrame *item, double &wait_ms)
+{
+	int64_t t0 = cv::getTickCount();
+	for (int n = 0; !(out.spsc ? out.spsc->push(item) : out.mpmc->push(item)); n++) backoff(n);
+	wait_ms += elapsed_ms(t0);
+}
+
+void Pipeline::detect(int s, PipeFrame &item, Gallo &gallo, Soros &soros, Yun &yun)
+{
+	const int64_t t0 = tracer ? tracer->begin() : 0;
+
+	if (s == IY_STAGE_GALLO) item.gallo = gallo.process(item.gray, 20);
+	else if (s == IY_STAGE_SOROS) item.soros = soros.process(item.gray, true, 20);
+	else if (s == IY_STAGE_YUN) yun.process(item.gray, item.yun);
+
+	if (tracer) tracer->end(t0, IY_GALLO + (s - IY_STAGE_GALLO), item.gray, yun.getParams(), 20, false);
+}
+
+void Pipeline::lookup(PipeFrame &item)
+{
+	item.key = ResultCache::fingerprint(item.gray);
+
+	CacheResult res;
+	if (!cache->find(item.key, cacheNeed, res)) return;
+
+	item.gallo = res.gallo;
+	item.soros = res.soros;
+	item.yun = res.yun;
+	item.isCached = true;
+}
+
+void Pipeline::store(const PipeFrame &item)
+{
+	CacheResult res;
+	res.valid = cacheNeed;
+	res.gallo = item.gallo;
+	res.soros = item.soros;
+	res.yun = item.yun;
+	cache->insert(item.key, res);
+}
+
+std::string Pipeline::serialize(const PipeFrame &item)
+{
+	std::ostringstream js;
+	js << "{\"seq\":" << item.seq << ",\"file\":";
+	json_string(js, item.path);
+
+	if (item.gray.empty())
+	{
+		js << ",\"status\":\"error\"}";
+		return js.str();
+	}
+
+	js << ",\"status\":\"ok\"";
+	if (pam.stage[IY_STAGE_GALLO].nThreads > 0)
+	{
+		js << ",\"gallo\":";
+		json_rect(js, item.gallo, -1);
+	}
+	if (pam.stage[IY_STAGE_SOROS].nThreads > 0)
+	{
+		js << ",\"soros\":";
+		json_rect(js, item.soros, -1);
+	}
+	if (pam.stage[IY_STAGE_YUN].nThreads > 0)
+	{
+		js << ",\"yun\":[";
+		for (size_t i = 0; i < item.yun.size(); i++)
+		{
+			if (i > 0) js << ",";
+			json_rect(js, item.yun.roi[i], item.yun.orientation[i], &item.yun.box[i]);
+		}
+		js << "]";
+	}
+	if (cache) js << ",\"cached\":" << (item.isCached ? "true" : "false");
+	js << "}";
+
+	return js.str();
+}
+
+void Pipeline::pin(int s, int tid)
+{
+	const std::vector<int> &cpus = pam.stage[s].cpus;
+	if (cpus.empty()) return;
+
+	const int cpu = cpus[tid % cpus.size()];
+	if (!bind_thread(std::vector<int>(1, cpu)))
+		std::cerr << "warning! can not pin " << stage_name[s] << " to cpu " << cpu << std::endl;
+}
+
+void Pipeline::print_stats(std::ostream &out)
+{
+	out << "stage   threads  frames   busy%   mean ms   max ms   wait ms  queue" << std::endl;
+	out << std::fixed;
+
+	for (int s = 0; s < IY_NUM_STAGES; s++)
+	{
+		const StageStats &st = stats[s];
+		if (st.nThreads <= 0) continue;
+
+		const double busy = (wall_ms > 0) ? 100.0 * st.busy_ms / (st.nThreads * wall_ms) : 0;
+		const double mean = st.nItems ? st.busy_ms / st.nItems : 0;
+
+		out << std::left << std::setw(8) << stage_name[s] << std::right
+			<< std::setw(7) << st.nThreads
+			<< std::setw(8) << st.nItems
+			<< std::setprecision(1) << std::setw(8) << busy
+			<< std::setprecision(2) << std::setw(10) << mean
+			<< std::setw(9) << st.max_ms
+			<< std::setprecision(1) << std::setw(10) << st.wait_ms / st.nThreads;
+
+		// mean fill of the input queue
+		if (st.capacity && st.nItems)
+			out << "  " << std::setprecision(1) << st.depth_sum / st.nItems << "/" << st.capacity;
+		out << std::endl;
+	}
+
+	const uint64_t nFrames = stats[IY_STAGE_OUTPUT].nItems;
+	out << std::setprecision(1) << nFrames << " frames in " << wall_ms << " ms";
+	if (wall_ms > 0) out << " (" << nFrames * 1000.0 / wall_ms << " fps)";
+	out << std::endl;
+
+	if (cache)
+	{
+		CacheStats cs = cache->getStats();
+		out << "cache: " << cs.nHits << " hits, " << cs.nNearHits << " near hits, " << cs.nMisses << " misses, "
+			<< cs.nEvictions << " evictions" << std::endl;
+	}
+	if (tracer) out << "traces: " << tracer->count() << " slow detections written to " << pam.trace.dir << std::endl;
+	out.unsetf(std::ios::floatfield);
+
+	if (pam.useCounters)
+	{
+		int valid = 0;
+		for (int s = 0; s < IY_NUM_STAGES; s++) valid |= stats[s].perf.valid;
+
+		if (!perfError.empty()) out << "counters missing: " << perfError << std::endl;
+		if (valid)
+		{
+			PerfCounters::print_header(out, "stage");
+			for (int s = 0; s < IY_NUM_STAGES; s++)
+				if (stats[s].nThreads > 0) PerfCounters::print(out, stage_name[s], stats[s].perf);
+		}
+	}
+}
+
+std::vector<int> Pipeline::parse_cpulist(const std::string &list)
+{
+	return iy::parse_cpulist(list);
+}
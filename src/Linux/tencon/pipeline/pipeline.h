@@ -0,0 +1,152 @@
+/*
+*  Batch pipeline: decode -> gray -> Gallo -> Soros -> Yun -> output
+*
+*   Every stage runs on its own threads and hands frames to the next one
+*   through a bounded lock-free queue (SPSC when both sides have a single
+*   thread, MPMC otherwise), so decoding overlaps detection and a slow stage
+*   only back-pressures its producers. Detector stages own per-thread
+*   instances; a detector stage with no threads is skipped. The output stage
+*   writes one JSON line per image in input order. With a result cache the
+*   gray stage looks every frame up and the detector stages pass hits through.
+*   With counters on, every stage thread reads the hardware counters around
+*   each frame. With a trace directory, detections slower than the threshold
+*   are written to it as frame traces.
+*/
+
+#ifndef IY_PIPELINE_H
+#define IY_PIPELINE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "queue.h"
+#include "cache/cache.h"
+#include "trace/trace.h"
+#include "kernel/perf.h"
+#include "pool/pool.h"
+#include "gallo/gallo.h"
+#include "soros/soros.h"
+#include "yun/yun.h"
+
+namespace iy{
+	enum
+	{
+		IY_STAGE_DECODE = 0,
+		IY_STAGE_GRAY,
+		IY_STAGE_GALLO,
+		IY_STAGE_SOROS,
+		IY_STAGE_YUN,
+		IY_STAGE_OUTPUT,
+		IY_NUM_STAGES
+	};
+
+	typedef struct
+	{
+		int nThreads;              // 0 skips a detector stage; output always runs one thread
+		std::vector<int> cpus;     // cores the threads are pinned to, round robin (empty: not pinned)
+	} StageParams;
+
+	typedef struct
+	{
+		StageParams stage[IY_NUM_STAGES];
+		int depth;                 // capacity of every queue between two stages
+		size_t cacheSize;          // frames whose results are cached (0: no cache)
+		int cacheDistance;         // difference hash bits a near duplicate may differ in (0: exact only)
+		bool useCounters;          // hardware counters per stage
+		TraceParams trace;         // detections slower than trace.thresholdMs go to trace.dir (empty: off)
+	} PipelineParams;
+
+	typedef struct
+	{
+		int nThreads;
+		uint64_t nItems;
+		double busy_ms;            // time spent on frames, summed over threads
+		double wait_ms;            // time spent waiting for input or for room downstream
+		double max_ms;             // slowest frame
+		double depth_sum;          // input queue depth, sampled on every pull
+		size_t capacity;           // input queue capacity (0: no input queue)
+		PerfStats perf;            // hardware counters of the frames (counters on)
+	} StageStats;
+
+	class Pipeline{
+	private:
+		typedef struct
+		{
+			int seq;
+			std::string path;
+			cv::Mat frame, gray;
+			cv::Rect gallo, soros;
+			YunResult yun;
+			CacheKey key;
+			bool isCached;         // results taken from the cache
+		} PipeFrame;
+
+		// queue in front of a stage, flavour picked from the thread counts
+		typedef struct
+		{
+			std::unique_ptr<SpscQueue<PipeFrame *> > spsc;
+			std::unique_ptr<MpmcQueue<PipeFrame *> > mpmc;
+			std::atomic<int> producers;   // upstream threads still running
+		} Link;
+
+		PipelineParams pam;
+		std::vector<int> active;                    // stages that run, in order
+		std::vector<std::unique_ptr<Link> > links;  // links[i] feeds active[i] (links[0] unused)
+
+		const std::vector<std::string> *paths;
+		std::atomic<int> next;
+		std::ostream *os;
+
+		std::unique_ptr<ResultCache> cache;
+		int cacheNeed;                              // IY_CACHE_* of the detector stages that run
+		std::unique_ptr<TraceRecorder> tracer;
+
+		std::mutex sLock;
+		StageStats stats[IY_NUM_STAGES];
+		double wall_ms;
+		std::string perfError;                      // counters a stage thread could not open
+
+		void stage(int idx, int tid);
+		bool pull(Link &in, PipeFrame *&item, double &wait_ms, double &depth_sum);
+		void push(Link &out, PipeFrame *item, double &wait_ms);
+		void detect(int s, PipeFrame &item, Gallo &gallo, Soros &soros, Yun &yun);
+		void lookup(PipeFrame &item);
+		void store(const PipeFrame &item);
+		std::string serialize(const PipeFrame &item);
+		void pin(int s, int tid);
+
+	public:
+		Pipeline() {
+			static const int nDefault[IY_NUM_STAGES] = { 2, 1, 1, 1, 2, 1 };
+			for (int s = 0; s < IY_NUM_STAGES; s++) pam.stage[s].nThreads = nDefault[s];
+			pam.depth = 16;
+			pam.cacheSize = 0;
+			pam.cacheDistance = 0;
+			pam.useCounters = false;
+			pam.trace.thresholdMs = 100;
+			pam.trace.maxTraces = 100;
+			cacheNeed = 0;
+			paths = NULL;
+			os = NULL;
+			wall_ms = 0;
+		}
+		~Pipeline() {}
+
+		// runs all images through the stages, blocks until the last line is written
+		bool run(const std::vector<std::string> &files, std::ostream &out, PipelineParams pams);
+
+		// per stage occupancy and latency of the last run
+		void print_stats(std::ostream &out);
+
+		// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+		static std::vector<int> parse_cpulist(const std::string &list);
+	};
+}
+
+#endif
@@ -0,0 +1,146 @@
+/*
+*  Bounded lock-free queues between pipeline stages
+*
+*   SpscQueue: one producer and one consumer, a ring with acquire/release
+*   head and tail. MpmcQueue: any number of producers and consumers, the
+*   bounded queue of D. Vyukov (a sequence number per cell). Both carry small
+*   trivially copyable items (frame pointers), never block and round the
+*   capacity up to a power of two; waiting is left to the caller.
+*/
+
+#ifndef IY_PIPELINE_QUEUE_H
+#define IY_PIPELINE_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IY_CACHE_LINE 64
+
+namespace iy{
+	static inline size_t queue_capacity(size_t n)
+	{
+		size_t cap = 2;
+		while (cap < n) cap <<= 1;
+		return cap;
+	}
+
+	template<typename T>
+	class SpscQueue{
+	private:
+		std::unique_ptr<T[]> ring;
+		size_t mask;
+
+		// producer and consumer indices on their own cache lines
+		char pad0[IY_CACHE_LINE];
+		std::atomic<size_t> tail;   // next slot to push
+		char pad1[IY_CACHE_LINE];
+		std::atomic<size_t> head;   // next slot to pop
+		char pad2[IY_CACHE_LINE];
+
+	public:
+		explicit SpscQueue(size_t n) : ring(new T[queue_capacity(n)]), mask(queue_capacity(n) - 1), tail(0), head(0) {}
+
+		bool push(const T &val)
+		{
+			const size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) > mask) return false;
+
+			ring[t & mask] = val;
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(T &val)
+		{
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire)) return false;
+
+			val = ring[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+		size_t capacity() const { return mask + 1; }
+	};
+
+	template<typename T>
+	class MpmcQueue{
+	private:
+		typedef struct
+		{
+			std::atomic<size_t> seq;   // == position: free for that push, == position + 1: filled
+			T val;
+		} Cell;
+
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+
+		char pad0[IY_CACHE_LINE];
+		std::atomic<size_t> enq;
+		char pad1[IY_CACHE_LINE];
+		std::atomic<size_t> deq;
+		char pad2[IY_CACHE_LINE];
+
+	public:
+		explicit MpmcQueue(size_t n) : cells(new Cell[queue_capacity(n)]), mask(queue_capacity(n) - 1), enq(0), deq(0)
+		{
+			for (size_t i = 0; i <= mask; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		bool push(const T &val)
+		{
+			Cell *cell;
+			size_t pos = enq.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell = &cells[pos & mask];
+				const intptr_t diff = (intptr_t)cell->seq.load(std::memory_order_acquire) - (intptr_t)pos;
+				if (diff == 0)
+				{
+					if (enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (diff < 0) return false;   // full
+				else pos = enq.load(std::memory_order_relaxed);
+			}
+
+			cell->val = val;
+			cell->seq.store(pos + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(T &val)
+		{
+			Cell *cell;
+			size_t pos = deq.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				cell = &cells[pos & mask];
+				const intptr_t diff = (intptr_t)cell->seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+				if (diff == 0)
+				{
+					if (deq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+				}
+				else if (diff < 0) return false;   // empty
+				else pos = deq.load(std::memory_order_relaxed);
+			}
+
+			val = cell->val;
+			cell->seq.store(pos + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		// approximate while producers or consumers are active
+		size_t size() const
+		{
+			const size_t e = enq.load(std::memory_order_acquire);
+			const size_t d = deq.load(std::memory_order_acquire);
+			return (e > d) ? e - d : 0;
+		}
+		size_t capacity() const { return mask + 1; }
+	};
+}
+
+#endif
@@ -0,0 +1,307 @@
+/*
+*  NUMA aware work-stealing thread pool
+*/
+
+#include "pool.h"
+
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace iy;
+
+static thread_local ThreadPool *tl_pool = NULL;
+static thread_local int tl_id = -1;
+
+std::vector<int> iy::parse_cpulist(const std::string &list)
+{
+	std::vector<int> cpus;
+	std::stringstream ss(list);
+	std::string range;
+
+	while (std::getline(ss, range, ','))
+	{
+		if (range.empty() || range == "\n") continue;
+
+		size_t dash = range.find('-');
+		int first = atoi(range.c_str());
+		int last = (dash == std::string::npos) ? first : atoi(range.c_str() + dash + 1);
+		for (int c = first; c <= last; c++) cpus.push_back(c);
+	}
+	return cpus;
+}
+
+NumaTopology iy::numa_topology()
+{
+	NumaTopology topo;
+
+#ifdef __linux__
+	std::vector<int> ids;
+	DIR *dir = opendir("/sys/devices/system/node");
+	if (dir)
+	{
+		struct dirent *ent;
+		while ((ent = readdir(dir)) != NULL)
+		{
+			if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9')
+				ids.push_back(atoi(ent->d_name + 4));
+		}
+		closedir(dir);
+	}
+	std::sort(ids.begin(), ids.end());
+
+	// memory-only nodes have no cpus to run on
+	for (size_t i = 0; i < ids.size(); i++)
+	{
+		std::ifstream f(("/sys/devices/system/node/node" + std::to_string(ids[i]) + "/cpulist").c_str());
+		std::string list;
+		if (!std::getline(f, list)) continue;
+
+		std::vector<int> cpus = parse_cpulist(list);
+		if (!cpus.empty()) topo.nodes.push_back(cpus);
+	}
+#endif
+
+	if (topo.nodes.empty())
+	{
+		std::vector<int> cpus;
+		const int n = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int c = 0; c < n; c++) cpus.push_back(c);
+		topo.nodes.push_back(cpus);
+	}
+
+	return topo;
+}
+
+bool iy::bind_thread(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+	if (cpus.empty()) return false;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus.size(); i++) CPU_SET(cpus[i], &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpus;
+	return false;
+#endif
+}
+
+ThreadPool::ThreadPool(PoolParams pams)
+{
+	topo = numa_topology();
+	if (pams.nNodes > 0 && pams.nNodes < (int)topo.nodes.size()) topo.nodes.resize(pams.nNodes);
+
+	int nWorkers = pams.nWorkers;
+	if (nWorkers <= 0)
+	{
+		nWorkers = 0;
+		for (size_t n = 0; n < topo.nodes.size(); n++) nWorkers += (int)topo.nodes[n].size();
+	}
+
+	// never more queues than workers, so every queue has a local worker
+	const int nNodes = std::min((int)topo.nodes.size(), nWorkers);
+	topo.nodes.resize(nNodes);
+
+	for (int n = 0; n < nNodes; n++)
+	{
+		queues.push_back(std::unique_ptr<NodeQueue>(new NodeQueue()));
+		queues.back()->nIdle = 0;
+	}
+
+	nQueued = 0;
+	nextNode = 0;
+	isStop = false;
+	stats.assign(nWorkers, PoolStats());
+
+	// contiguous blocks of workers per node, the k-th of a node on its k-th cpu
+	workerNode.resize(nWorkers);
+	std::vector<int> nOnNode(nNodes, 0);
+	for (int w = 0; w < nWorkers; w++)
+	{
+		const int node = (int)((int64_t)w * nNodes / nWorkers);
+		const std::vector<int> &cpus = topo.nodes[node];
+		const int cpu = cpus[nOnNode[node]++ % cpus.size()];
+
+		workerNode[w] = node;
+		stats[w].nTasks = stats[w].nStolen = 0;
+		workers.push_back(std::thread(&ThreadPool::worker, this, w, pams.affinity, cpu));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(wLock);
+		isStop = true;
+		for (size_t n = 0; n < queues.size(); n++) queues[n]->cond.notify_all();
+	}
+	for (size_t w = 0; w < workers.size(); w++) workers[w].join();
+}
+
+int ThreadPool::worker_id()
+{
+	return tl_id;
+}
+
+void ThreadPool::worker(int id, int affinity, int cpu)
+{
+	const int node = workerNode[id];
+	tl_pool = this;
+	tl_id = id;
+
+	bool isBound = true;
+	if (affinity == IY_AFFINITY_NODE) isBound = bind_thread(topo.nodes[node]);
+	else if (affinity == IY_AFFINITY_CPU) isBound = bind_thread(std::vector<int>(1, cpu));
+	if (!isBound) std::cerr << "warning! can not bind pool worker " << id << " to node " << node << std::endl;
+
+	for (;;)
+	{
+		std::function<void()> task;
+		bool isStolen;
+		if (take(node, task, isStolen))
+		{
+			try
+			{
+				task();
+			}
+			catch (std::exception &e)
+			{
+				std::cerr << "ThreadPool: task failed: " << e.what() << std::endl;
+			}
+
+			std::lock_guard<std::mutex> lock(sLock);
+			stats[id].nTasks++;
+			if (isStolen) stats[id].nStolen++;
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wLock);
+		if (nQueued.load() > 0) continue;   // submitted after take() looked
+		if (isStop) break;
+
+		queues[node]->nIdle++;
+		queues[node]->cond.wait(lock);
+		queues[node]->nIdle--;
+	}
+}
+
+// own node first, then the other nodes from the nearest index on
+bool ThreadPool::take(int node, std::function<void()> &task, bool &isStolen)
+{
+	const int nNodes = (int)queues.size();
+
+	for (int i = 0; i < nNodes; i++)
+	{
+		NodeQueue &q = *queues[(node + i) % nNodes];
+		std::lock_guard<std::mutex> lock(q.lock);
+		if (q.tasks.empty()) continue;
+
+		// the owner works from the front, thieves from the back
+		if (i == 0)
+		{
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+		else
+		{
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		nQueued--;
+		isStolen = (i != 0);
+		return true;
+	}
+	return false;
+}
+
+// an idle worker of the node, or one of another node that will steal the task
+void ThreadPool::wake(int node)
+{
+	const int nNodes = (int)queues.size();
+
+	for (int i = 0; i < nNodes; i++)
+	{
+		NodeQueue &q = *queues[(node + i) % nNodes];
+		if (q.nIdle == 0) continue;
+
+		q.cond.notify_one();
+		return;
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task, int node)
+{
+	const int nNodes = (int)queues.size();
+	if (node < 0 || node >= nNodes) node = (int)(nextNode++ % nNodes);
+
+	{
+		std::lock_guard<std::mutex> lock(queues[node]->lock);
+		queues[node]->tasks.push_back(std::move(task));
+	}
+
+	std::lock_guard<std::mutex> lock(wLock);
+	nQueued++;
+	wake(node);
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(int, size_t)> &fn, int nTasks)
+{
+	if (n == 0) return;
+
+	// a task of this pool waiting for its own workers could wait forever
+	if (tl_pool == this)
+	{
+		for (size_t i = 0; i < n; i++) fn(tl_id, i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::mutex dLock;
+	std::condition_variable dCond;
+	std::exception_ptr error;
+
+	if (nTasks <= 0 || nTasks > (int)workers.size()) nTasks = (int)workers.size();
+	nTasks = (int)std::min<size_t>(nTasks, n);
+	int nLeft = nTasks;
+
+	for (int t = 0; t < nTasks; t++)
+	{
+		submit([&]() {
+			try
+			{
+				for (size_t i = next++; i < n; i = next++) fn(tl_id, i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(dLock);
+				if (!error) error = std::current_exception();
+				next = n;
+			}
+
+			std::lock_guard<std::mutex> lock(dLock);
+			if (--nLeft == 0) dCond.notify_one();
+		}, workerNode[t * workers.size() / nTasks]);
+	}
+
+	std::unique_lock<std::mutex> lock(dLock);
+	dCond.wait(lock, [&]() { return nLeft == 0; });
+	if (error) std::rethrow_exception(error);
+}
+
+std::vector<PoolStats> ThreadPool::getStats()
+{
+	std::lock_guard<std::mutex> lock(sLock);
+	return stats;
+}
@@ -0,0 +1,115 @@
+/*
+*  NUMA aware work-stealing thread pool
+*
+*   Workers are spread evenly over the NUMA nodes (read from sysfs, a single
+*   node when the topology is unknown) and, unless affinity is off, bound to
+*   the cpus of their node or pinned to one cpu each. Every node has its own
+*   task queue: a worker runs the tasks of its node first and steals from the
+*   other nodes only when its own queue is empty. Memory a task allocates is
+*   first touched by the worker that runs it, so per-worker workspaces created
+*   inside a task (detectors and their maps) stay on the worker's node.
+*/
+
+#ifndef IY_POOL_H
+#define IY_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace iy{
+	enum
+	{
+		IY_AFFINITY_NONE = 0,    // workers float over all cpus
+		IY_AFFINITY_NODE,        // workers bound to the cpus of their node
+		IY_AFFINITY_CPU          // every worker pinned to one cpu of its node
+	};
+
+	typedef struct
+	{
+		std::vector<std::vector<int> > nodes;   // cpus of every node that has any
+	} NumaTopology;
+
+	// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+	std::vector<int> parse_cpulist(const std::string &list);
+
+	// nodes from /sys/devices/system/node, one node with all hardware threads otherwise
+	NumaTopology numa_topology();
+
+	// restricts the calling thread to cpus, false if the system refused
+	bool bind_thread(const std::vector<int> &cpus);
+
+	typedef struct
+	{
+		int nWorkers;            // 0: one per cpu of the nodes in use
+		int nNodes;              // nodes to spread the workers over (0: all)
+		int affinity;            // IY_AFFINITY_*
+	} PoolParams;
+
+	typedef struct
+	{
+		uint64_t nTasks;         // tasks run
+		uint64_t nStolen;        // of them taken from another node's queue
+	} PoolStats;
+
+	class ThreadPool{
+	private:
+		typedef struct
+		{
+			std::mutex lock;
+			std::deque<std::function<void()> > tasks;
+			std::condition_variable cond;   // idle workers of the node (wLock)
+			int nIdle;                      // (wLock)
+		} NodeQueue;
+
+		NumaTopology topo;
+		std::vector<std::unique_ptr<NodeQueue> > queues;
+		std::vector<int> workerNode;
+		std::vector<std::thread> workers;
+
+		std::mutex wLock;
+		std::atomic<int> nQueued;
+		std::atomic<unsigned> nextNode;
+		bool isStop;                        // (wLock)
+
+		std::mutex sLock;
+		std::vector<PoolStats> stats;
+
+		ThreadPool(const ThreadPool &);
+		ThreadPool &operator=(const ThreadPool &);
+
+		void worker(int id, int affinity, int cpu);
+		bool take(int node, std::function<void()> &task, bool &isStolen);
+		void wake(int node);
+
+	public:
+		explicit ThreadPool(PoolParams pams);
+		~ThreadPool();   // runs the queued tasks, then joins the workers
+
+		int size() const { return (int)workers.size(); }
+		int num_nodes() const { return (int)queues.size(); }
+		int node_of(int worker) const { return workerNode[worker]; }
+
+		// index of the calling worker of any pool, -1 outside a pool
+		static int worker_id();
+
+		// queued on node (-1: round robin over the nodes)
+		void submit(std::function<void()> task, int node = -1);
+
+		// fn(worker, i) for i in [0, n), blocks until all are done. Indices are taken
+		// dynamically by nTasks tasks spread over the nodes (0: one per worker);
+		// called from a worker of this pool it runs inline.
+		void parallel_for(size_t n, const std::function<void(int, size_t)> &fn, int nTasks = 0);
+
+		std::vector<PoolStats> getStats();
+	};
+}
+
+#endif
@@ -0,0 +1,210 @@
+/*
+*  Python bindings of the localization methods (pybind11)
+*
+*   Gray frames are passed as 2-D uint8 NumPy arrays and wrapped by a
+*   cv::Mat header without copying. The GIL is released while a detector
+*   runs, and the *_batch calls spread a list of frames over native threads.
+*   A detector keeps workspaces (Yun) and incremental state between calls,
+*   so an instance must not be used by two threads at once: create one per
+*   thread, or use process_batch, which copies the detector per thread.
+*
+*   etc: not include barcode recognition process.
+*        only localization method! *
+*/
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "gallo/gallo.h"
+#include "soros/soros.h"
+#include "yun/yun.h"
+
+namespace py = pybind11;
+
+typedef std::tuple<int, int, int, int> PyRect;
+
+static PyRect to_tuple(const cv::Rect &rt)
+{
+	return PyRect(rt.x, rt.y, rt.width, rt.height);
+}
+
+// wrap a 2-D uint8 array; rows may be strided, pixels must be packed
+static cv::Mat to_mat(py::array &arr)
+{
+	if (arr.ndim() != 2)
+		throw std::invalid_argument("expected a 2-D gray image");
+	if (!py::isinstance<py::array_t<uint8_t> >(arr) || arr.strides(1) != 1)
+		arr = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>::ensure(arr);
+	if (!arr)
+		throw std::invalid_argument("image is not convertible to uint8");
+
+	return cv::Mat((int)arr.shape(0), (int)arr.shape(1), CV_8UC1,
+		const_cast<void *>(arr.data()), (size_t)arr.strides(0));
+}
+
+static std::vector<cv::Mat> to_mats(std::vector<py::array> &arrs)
+{
+	std::vector<cv::Mat> mats;
+	mats.reserve(arrs.size());
+	for (size_t i = 0; i < arrs.size(); i++) mats.push_back(to_mat(arrs[i]));
+	return mats;
+}
+
+static int num_threads(int nThreads, size_t nFrames)
+{
+	if (nThreads <= 0) nThreads = (int)std::thread::hardware_concurrency();
+	return (int)std::max<size_t>(std::min<size_t>(std::max(nThreads, 1), nFrames), 1);
+}
+
+// run fn(thread_id, frame_id) for every frame on nThreads threads
+template<typename Fn>
+static void run_parallel(size_t nFrames, int nThreads, Fn fn)
+{
+	if (nThreads <= 1)
+	{
+		for (size_t i = 0; i < nFrames; i++) fn(0, i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+	for (int t = 0; t < nThreads; t++)
+	{
+		pool.push_back(std::thread([&, t]() {
+			for (size_t i = next++; i < nFrames; i = next++) fn(t, i);
+		}));
+	}
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+}
+
+static py::list to_list(const iy::YunResult &res)
+{
+	py::list out;
+	for (size_t i = 0; i < res.size(); i++)
+	{
+		py::dict d;
+		d["roi"] = to_tuple(res.roi[i]);
+		d["orientation"] = res.orientation[i];
+		d["score"] = res.score[i];
+		d["first_pt"] = py::make_tuple(res.first_pt[i].x, res.first_pt[i].y);
+		d["last_pt"] = py::make_tuple(res.last_pt[i].x, res.last_pt[i].y);
+		// ((cx, cy), (w, h), angle) as cv2.minAreaRect returns it
+		const cv::RotatedRect &b = res.box[i];
+		d["box"] = py::make_tuple(py::make_tuple(b.center.x, b.center.y), py::make_tuple(b.size.width, b.size.height), b.angle);
+		out.append(d);
+	}
+	return out;
+}
+
+PYBIND11_MODULE(iybarcode, m)
+{
+	m.doc() = "1D barcode localization (Gallo, Soros, Yun)\n\n"
+		"The GIL is released while a detector runs. A detector instance keeps state "
+		"between calls and must not be used by two threads at once: create one per "
+		"thread, or use process_batch, which copies it per thread.";
+
+	py::class_<iy::YunParams>(m, "YunParams")
+		.def(py::init([]() { return iy::Yun().getParams(); }))
+		.def_readwrite("magT", &iy::YunParams::magT)
+		.def_readwrite("winSz", &iy::YunParams::winSz)
+		.def_readwrite("minEdgeT", &iy::YunParams::minEdgeT)
+		.def_readwrite("localBlockSz", &iy::YunParams::localBlockSz)
+		.def_readwrite("minDensityEdgeT", &iy::YunParams::minDensityEdgeT)
+		.def_readwrite("minStrongRatio", &iy::YunParams::minStrongRatio)
+		.def_readwrite("maxCandidates", &iy::YunParams::maxCandidates)
+		.def_readwrite("useSpecialized", &iy::YunParams::useSpecialized)
+		.def_readwrite("blockGrid", &iy::YunParams::blockGrid)
+		.def_readwrite("lazyMagnitude", &iy::YunParams::lazyMagnitude)
+		.def_readwrite("useCascade", &iy::YunParams::useCascade)
+		.def_readwrite("maxAspect", &iy::YunParams::maxAspect)
+		.def_readwrite("minPurity", &iy::YunParams::minPurity)
+		.def_readwrite("minEdgeDensity", &iy::YunParams::minEdgeDensity)
+		.def_readwrite("incTile", &iy::YunParams::incTile)
+		.def_readwrite("incSadT", &iy::YunParams::incSadT);
+
+	py::class_<iy::Yun>(m, "Yun")
+		.def(py::init<>())
+		.def(py::init([](const iy::YunParams &pams) { iy::Yun y; y.setParams(pams); return y; }))
+		.def_property("params", &iy::Yun::getParams, &iy::Yun::setParams)
+		.def("process", [](iy::Yun &self, py::array img) {
+			cv::Mat gray = to_mat(img);
+			iy::YunResult res;
+			{
+				py::gil_scoped_release release;
+				self.process(gray, res);
+			}
+			return to_list(res);
+		}, py::arg("gray"))
+		.def("process_incremental", [](iy::Yun &self, py::array img) {
+			cv::Mat gray = to_mat(img);
+			iy::YunResult res;
+			{
+				py::gil_scoped_release release;
+				self.process_incremental(gray, res);
+			}
+			return to_list(res);
+		}, py::arg("gray"))
+		.def("reset_incremental", &iy::Yun::reset_incremental)
+		.def("process_batch", [](iy::Yun &self, std::vector<py::array> imgs, int threads) {
+			std::vector<cv::Mat> grays = to_mats(imgs);
+			std::vector<iy::YunResult> res(grays.size());
+			{
+				py::gil_scoped_release release;
+				const int nThreads = num_threads(threads, grays.size());
+				std::vector<iy::Yun> workers(nThreads, self);
+				run_parallel(grays.size(), nThreads, [&](int t, size_t i) {
+					workers[t].process(grays[i], res[i]);
+				});
+			}
+			py::list out;
+			for (size_t i = 0; i < res.size(); i++) out.append(to_list(res[i]));
+			return out;
+		}, py::arg("grays"), py::arg("threads") = 0);
+
+	py::class_<iy::Gallo>(m, "Gallo")
+		.def(py::init<>())
+		.def("process", [](iy::Gallo &self, py::array img, int win_sz, bool steerable) {
+			cv::Mat gray = to_mat(img);
+			py::gil_scoped_release release;
+			return to_tuple(self.process(gray, win_sz, steerable));
+		}, py::arg("gray"), py::arg("win_sz") = 20, py::arg("steerable") = false)
+		.def("process_batch", [](iy::Gallo &self, std::vector<py::array> imgs, int win_sz, int threads, bool steerable) {
+			std::vector<cv::Mat> grays = to_mats(imgs);
+			std::vector<PyRect> res(grays.size());
+			py::gil_scoped_release release;
+			run_parallel(grays.size(), num_threads(threads, grays.size()), [&](int, size_t i) {
+				iy::Gallo worker;
+				res[i] = to_tuple(worker.process(grays[i], win_sz, steerable));
+			});
+			return res;
+		}, py::arg("grays"), py::arg("win_sz") = 20, py::arg("threads") = 0, py::arg("steerable") = false);
+
+	py::class_<iy::Soros>(m, "Soros")
+		.def(py::init<>())
+		.def("process", [](iy::Soros &self, py::array img, bool is_1d, int win_sz) {
+			cv::Mat gray = to_mat(img);
+			py::gil_scoped_release release;
+			return to_tuple(self.process(gray, is_1d, win_sz));
+		}, py::arg("gray"), py::arg("is_1d") = true, py::arg("win_sz") = 20)
+		.def("process_joint", [](iy::Soros &self, py::array img, int win_sz) {
+			cv::Mat gray = to_mat(img);
+			py::gil_scoped_release release;
+			iy::SorosResult res = self.process_joint(gray, win_sz);
+			return std::make_pair(to_tuple(res.roi1D), to_tuple(res.roi2D));
+		}, py::arg("gray"), py::arg("win_sz") = 20)
+		.def("process_batch", [](iy::Soros &self, std::vector<py::array> imgs, bool is_1d, int win_sz, int threads) {
+			std::vector<cv::Mat> grays = to_mats(imgs);
+			std::vector<PyRect> res(grays.size());
+			py::gil_scoped_release release;
+			run_parallel(grays.size(), num_threads(threads, grays.size()), [&](int, size_t i) {
+				iy::Soros worker;
+				res[i] = to_tuple(worker.process(grays[i], is_1d, win_sz));
+			});
+			return res;
+		}, py::arg("grays"), py::arg("is_1d") = true, py::arg("win_sz") = 20, py::arg("threads") = 0);
+}
@@ -0,0 +1,133 @@
+/*
+*  Load generator for the iyBarcode detection daemon
+*
+*   Opens N client connections and sends the same gray frame as fast as the
+*   server answers, then prints throughput, latency percentiles and the
+*   number of rejected (busy) requests, followed by the server metrics.
+*/
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "protocol.h"
+
+const char* keys =
+    "{h        help |                      | print help message                            }"
+    "{socket        | /tmp/iybarcode.sock  | daemon socket path                            }"
+    "{file          | /file/dir/file_name  | test image file(.bmp .jpg .png)               }"
+    "{method        | 2                    | 0 gallo, 1 soros, 2 yun                       }"
+    "{clients       | 4                    | concurrent connections                        }"
+    "{requests      | 100                  | requests per connection                       }";
+
+static int connect_to(const std::string &path)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool request(int fd, const iy::IyRequestHeader &hdr, const cv::Mat &gray, std::string &reply)
+{
+	if (!iy::write_full(fd, &hdr, sizeof(hdr))) return false;
+	for (int h = 0; h < (int)hdr.height; h++)
+		if (!iy::write_full(fd, gray.ptr<uchar>(h), hdr.width)) return false;
+
+	uint32_t len = 0;
+	if (!iy::read_full(fd, &len, sizeof(len))) return false;
+	reply.resize(len);
+	return len == 0 || iy::read_full(fd, &reply[0], len);
+}
+
+int main(int argc, char* argv[])
+{
+	cv::CommandLineParser cmd(argc, argv, keys);
+	if (cmd.has("help") || !cmd.check())
+	{
+		cmd.printMessage();
+		cmd.printErrors();
+		return 0;
+	}
+
+	const std::string path = cmd.get<std::string>("socket");
+	const int method = cmd.get<int>("method");
+	const int nClients = std::max(1, cmd.get<int>("clients"));
+	const int nRequests = std::max(1, cmd.get<int>("requests"));
+
+	cv::Mat gray = cv::imread(cmd.get<std::string>("file"), cv::IMREAD_GRAYSCALE);
+	if (gray.empty())
+	{
+		std::cerr << "error! read image" << std::endl;
+		return -1;
+	}
+
+	std::vector<std::vector<double> > lat(nClients);
+	std::atomic<int> nBusy(0), nFail(0);
+
+	int64_t t0 = cv::getTickCount();
+
+	std::vector<std::thread> pool;
+	for (int c = 0; c < nClients; c++)
+	{
+		pool.push_back(std::thread([&, c]() {
+			int fd = connect_to(path);
+			if (fd < 0) { nFail += nRequests; return; }
+
+			iy::IyRequestHeader hdr = { IY_PROTO_MAGIC, (uint32_t)method, (uint32_t)gray.cols, (uint32_t)gray.rows, 0 };
+			std::string reply;
+			for (int i = 0; i < nRequests; i++)
+			{
+				hdr.seq = (uint32_t)i;
+				int64_t t = cv::getTickCount();
+				if (!request(fd, hdr, gray, reply)) { nFail++; break; }
+				double ms = (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+
+				if (reply.find("\"busy\"") != std::string::npos) nBusy++;
+				else lat[c].push_back(ms);
+			}
+			close(fd);
+		}));
+	}
+	for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+
+	double sec = (cv::getTickCount() - t0) / cv::getTickFrequency();
+
+	std::vector<double> all;
+	for (int c = 0; c < nClients; c++) all.insert(all.end(), lat[c].begin(), lat[c].end());
+	std::sort(all.begin(), all.end());
+
+	std::cout << "frames : " << all.size() << " ok, " << nBusy << " busy, " << nFail << " failed" << std::endl;
+	std::cout << "rate   : " << all.size() / sec << " frames/s" << std::endl;
+	if (!all.empty())
+	{
+		std::cout << "latency: p50 " << all[all.size() / 2] << " ms, p95 " << all[(size_t)(all.size() * 0.95)]
+			<< " ms, p99 " << all[(size_t)(all.size() * 0.99)] << " ms, max " << all.back() << " ms" << std::endl;
+	}
+
+	// server side metrics
+	int fd = connect_to(path);
+	if (fd >= 0)
+	{
+		iy::IyRequestHeader hdr = { IY_PROTO_MAGIC, iy::IY_REQ_STATS, 0, 0, 0 };
+		std::string reply;
+		if (request(fd, hdr, gray, reply)) std::cout << "server : " << reply << std::endl;
+		close(fd);
+	}
+
+	return 0;
+}
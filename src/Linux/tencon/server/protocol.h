@@ -0,0 +1,70 @@
+/*
+*  Wire protocol of the iyBarcode detection daemon
+*
+*   request : IyRequestHeader followed by width * height bytes of gray plane
+*   response: uint32 length followed by a JSON document of that length
+*
+*   All header fields are host byte order (the socket is local).
+*/
+
+#ifndef IY_SERVER_PROTOCOL_H
+#define IY_SERVER_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "common/method.h"
+
+#define IY_PROTO_MAGIC    0x31425949u   // "IYB1"
+#define IY_PROTO_MAX_SIZE (64 << 20)    // largest accepted plane in bytes
+
+namespace iy{
+	enum
+	{
+		IY_REQ_GALLO = IY_GALLO,
+		IY_REQ_SOROS = IY_SOROS,
+		IY_REQ_YUN = IY_YUN,
+		IY_REQ_STATS = IY_NUM_METHODS     // no plane, returns the server metrics
+	};
+
+	typedef struct
+	{
+		uint32_t magic;
+		uint32_t method;
+		uint32_t width;
+		uint32_t height;
+		uint32_t seq;        // echoed back in the response
+	} IyRequestHeader;
+
+	inline bool read_full(int fd, void *buf, size_t n)
+	{
+		char *p = (char *)buf;
+		while (n > 0)
+		{
+			ssize_t r = ::read(fd, p, n);
+			if (r < 0 && errno == EINTR) continue;
+			if (r <= 0) return false;
+			p += r;
+			n -= (size_t)r;
+		}
+		return true;
+	}
+
+	inline bool write_full(int fd, const void *buf, size_t n)
+	{
+		const char *p = (const char *)buf;
+		while (n > 0)
+		{
+			ssize_t r = ::write(fd, p, n);
+			if (r < 0 && errno == EINTR) continue;
+			if (r <= 0) return false;
+			p += r;
+			n -= (size_t)r;
+		}
+		return true;
+	}
+}
+
+#endif
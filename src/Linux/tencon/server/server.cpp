@@ -0,0 +1,374 @@
+/*
+*  Long-lived detection daemon over a Unix domain socket
+*/
+
+#include "server.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace iy;
+
+#define IY_LATENCY_RING 4096
+
+static int64_t now_us()
+{
+	return (int64_t)(cv::getTickCount() * 1e6 / cv::getTickFrequency());
+}
+
+// Yun barcodes add their oriented box
+static void json_rect(std::ostringstream &os, const cv::Rect &rt, int orientation, const cv::RotatedRect *box = NULL)
+{
+	os << "{\"x\":" << rt.x << ",\"y\":" << rt.y << ",\"w\":" << rt.width << ",\"h\":" << rt.height
+		<< ",\"orientation\":" << orientation;
+	if (box)
+	{
+		os << ",\"box\":{\"cx\":" << box->center.x << ",\"cy\":" << box->center.y
+			<< ",\"w\":" << box->size.width << ",\"h\":" << box->size.height << ",\"angle\":" << box->angle << "}";
+	}
+	os << "}";
+}
+
+bool Server::run(ServerParams pams)
+{
+	pam = pams;
+	if (pam.nWorkers <= 0) pam.nWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+	if (pam.maxQueue <= 0) pam.maxQueue = 1;
+
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (pam.path.size() >= sizeof(addr.sun_path))
+	{
+		std::cerr << "error! socket path too long" << std::endl;
+		return false;
+	}
+	strncpy(addr.sun_path, pam.path.c_str(), sizeof(addr.sun_path) - 1);
+
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0)
+	{
+		std::cerr << "error! socket" << std::endl;
+		return false;
+	}
+
+	unlink(pam.path.c_str());
+	if (bind(lfd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 64) < 0)
+	{
+		std::cerr << "error! bind " << pam.path << std::endl;
+		close(lfd);
+		return false;
+	}
+
+	latency_us.assign(IY_LATENCY_RING, -1);
+	isExit = false;
+
+	if (pam.cacheSize > 0) cache.reset(new ResultCache(pam.cacheSize, pam.cacheDistance));
+	else cache.reset();
+
+	if (!pam.trace.dir.empty()) tracer.reset(new TraceRecorder(pam.trace));
+	else tracer.reset();
+
+	// without affinity every thread shares a single queue
+	topo = numa_topology();
+	if (pam.affinity == IY_AFFINITY_NONE || (int)topo.nodes.size() > pam.nWorkers) topo.nodes.resize(1);
+	const int nNodes = (int)topo.nodes.size();
+
+	queues.assign(nNodes, std::deque<ServerJob *>());
+	qCond.reset(new std::condition_variable[nNodes]);
+	nIdle.assign(nNodes, 0);
+	nQueued = 0;
+	nConnections = 0;
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < pam.nWorkers; i++)
+		workers.push_back(std::thread(&Server::worker, this, (int)((int64_t)i * nNodes / pam.nWorkers)));
+
+	while (!isStop)
+	{
+		pollfd pfd = { lfd, POLLIN, 0 };
+		if (poll(&pfd, 1, 200) <= 0) continue;
+
+		int fd = accept(lfd, NULL, NULL);
+		if (fd < 0) continue;
+
+		std::lock_guard<std::mutex> lock(cLock);
+		clients.push_back(fd);
+		std::thread(&Server::connection, this, fd, (int)(nConnections++ % nNodes)).detach();
+	}
+
+	// shutdown: wake up readers and workers, wait for the connections to close
+	while (true)
+	{
+		{
+			std::lock_guard<std::mutex> lock(cLock);
+			if (clients.empty()) break;
+			for (size_t i = 0; i < clients.size(); i++) shutdown(clients[i], SHUT_RDWR);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(qLock);
+		isExit = true;
+	}
+	for (int n = 0; n < nNodes; n++) qCond[n].notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	close(lfd);
+	unlink(pam.path.c_str());
+
+	return true;
+}
+
+bool Server::submit(ServerJob *job, int node)
+{
+	std::lock_guard<std::mutex> lock(qLock);
+	if ((int)nQueued >= pam.maxQueue) return false;
+
+	job->tEnqueue = now_us();
+	queues[node].push_back(job);
+	nQueued++;
+	maxDepth = std::max(maxDepth, nQueued);
+
+	// a worker of the node, or an idle one elsewhere that steals the frame
+	const int nNodes = (int)queues.size();
+	for (int i = 0; i < nNodes; i++)
+	{
+		const int n = (node + i) % nNodes;
+		if (nIdle[n] == 0) continue;
+		qCond[n].notify_one();
+		break;
+	}
+	return true;
+}
+
+void Server::worker(int node)
+{
+	if (pam.affinity == IY_AFFINITY_NODE || pam.affinity == IY_AFFINITY_CPU)
+	{
+		if (!bind_thread(topo.nodes[node]))
+			std::cerr << "warning! can not bind worker to node " << node << std::endl;
+	}
+
+	// per-thread detector workspaces, first touched on the worker's node
+	iy::Gallo gallo;
+	iy::Soros soros;
+	iy::Yun yun;
+	YunResult yres(16);
+
+	while (true)
+	{
+		// one frame per wake-up: the frames of a worker share no work, and a frame
+		// held behind others of the same worker would wait while another is idle
+		ServerJob *job = NULL;
+		{
+			std::unique_lock<std::mutex> lock(qLock);
+			nIdle[node]++;
+			qCond[node].wait(lock, [this]() { return isExit || nQueued > 0; });
+			nIdle[node]--;
+			if (nQueued == 0) break;   // all connections closed and queue drained
+
+			// own node first; a frame stolen from another node is taken from its back
+			const int nNodes = (int)queues.size();
+			for (int i = 0; i < nNodes && job == NULL; i++)
+			{
+				std::deque<ServerJob *> &q = queues[(node + i) % nNodes];
+				if (q.empty()) continue;
+
+				if (i == 0) { job = q.front(); q.pop_front(); }
+				else { job = q.back(); q.pop_back(); nStolen++; }
+			}
+			nQueued--;
+		}
+
+		std::string reply = detect(*job, gallo, soros, yun, yres);
+		record(job->tEnqueue);
+		job->reply.set_value(reply);
+	}
+}
+
+void Server::connection(int fd, int node)
+{
+	// frames read here are first touched on the node that will process them
+	if (pam.affinity != IY_AFFINITY_NONE) bind_thread(topo.nodes[node]);
+
+	IyRequestHeader hdr;
+
+	while (!isStop && read_full(fd, &hdr, sizeof(hdr)))
+	{
+		std::string reply;
+
+		if (hdr.magic != IY_PROTO_MAGIC)
+			break;
+
+		if (hdr.method == IY_REQ_STATS)
+		{
+			reply = stats();
+		}
+		else if (hdr.method > IY_REQ_YUN || (uint64_t)hdr.width * hdr.height > IY_PROTO_MAX_SIZE)
+		{
+			break;
+		}
+		else
+		{
+			ServerJob job;
+			job.hdr = hdr;
+			job.plane.resize((size_t)hdr.width * hdr.height);
+			if (!read_full(fd, job.plane.data(), job.plane.size())) break;
+
+			std::future<std::string> done = job.reply.get_future();
+			if (submit(&job, node))
+			{
+				reply = done.get();
+			}
+			else
+			{
+				{
+					std::lock_guard<std::mutex> lock(mLock);
+					nRejected++;
+				}
+				std::ostringstream os;
+				os << "{\"seq\":" << hdr.seq << ",\"status\":\"busy\"}";
+				reply = os.str();
+			}
+		}
+
+		uint32_t len = (uint32_t)reply.size();
+		if (!write_full(fd, &len, sizeof(len)) || !write_full(fd, reply.data(), len)) break;
+	}
+
+	std::lock_guard<std::mutex> lock(cLock);
+	clients.erase(std::remove(clients.begin(), clients.end(), fd), clients.end());
+	close(fd);
+}
+
+std::string Server::detect(ServerJob &job, iy::Gallo &gallo, iy::Soros &soros, iy::Yun &yun, YunResult &yres)
+{
+	static const char *names[] = { "gallo", "soros", "yun" };
+
+	cv::Mat gray((int)job.hdr.height, (int)job.hdr.width, CV_8UC1, job.plane.data());
+
+	std::ostringstream os;
+	os << "{\"seq\":" << job.hdr.seq << ",\"status\":\"ok\",\"method\":\"" << names[job.hdr.method] << "\",\"regions\":[";
+
+	// IY_CACHE_* follow the order of IY_REQ_*
+	static_assert(IY_CACHE_GALLO == 1 << IY_REQ_GALLO && IY_CACHE_SOROS == 1 << IY_REQ_SOROS &&
+		IY_CACHE_YUN == 1 << IY_REQ_YUN, "a cache bit per request method");
+	const int need = 1 << job.hdr.method;
+	CacheKey key;
+	CacheResult res;
+	res.valid = 0;
+	bool isCached = false;
+	if (cache && !gray.empty())
+	{
+		key = ResultCache::fingerprint(gray);
+		isCached = cache->find(key, need, res);
+	}
+
+	const bool isTraced = tracer && !isCached && !gray.empty();
+	const int64_t t0 = isTraced ? tracer->begin() : 0;
+
+	if (gray.empty())
+	{
+		// nothing to detect
+	}
+	else if (job.hdr.method == IY_REQ_GALLO)
+	{
+		if (!isCached) res.gallo = gallo.process(gray, 20);
+		json_rect(os, res.gallo, -1);
+	}
+	else if (job.hdr.method == IY_REQ_SOROS)
+	{
+		if (!isCached) res.soros = soros.process(gray, true, 20);
+		json_rect(os, res.soros, -1);
+	}
+	else
+	{
+		// the worker's result arrays, copied only to and from the cache
+		if (isCached) yres = res.yun;
+		else yun.process(gray, yres);
+
+		for (size_t i = 0; i < yres.size(); i++)
+		{
+			if (i > 0) os << ",";
+			json_rect(os, yres.roi[i], yres.orientation[i], &yres.box[i]);
+		}
+	}
+
+	// IY_REQ_* are the method ids the tracer takes
+	if (isTraced) tracer->end(t0, job.hdr.method, gray, yun.getParams(), 20, false);
+
+	if (cache && !gray.empty() && !isCached)
+	{
+		res.valid = need;
+		if (job.hdr.method == IY_REQ_YUN) res.yun = yres;
+		cache->insert(key, res);
+	}
+
+	os << "]";
+	if (cache) os << ",\"cached\":" << (isCached ? "true" : "false");
+	os << ",\"latency_us\":" << (now_us() - job.tEnqueue) << "}";
+	return os.str();
+}
+
+void Server::record(int64_t tEnqueue)
+{
+	int lat = (int)(now_us() - tEnqueue);
+
+	std::lock_guard<std::mutex> lock(mLock);
+	latency_us[latency_pos] = lat;
+	latency_pos = (latency_pos + 1) % latency_us.size();
+	nDone++;
+}
+
+std::string Server::stats()
+{
+	size_t depth, depthMax;
+	uint64_t stolen;
+	{
+		std::lock_guard<std::mutex> lock(qLock);
+		depth = nQueued;
+		depthMax = maxDepth;
+		stolen = nStolen;
+	}
+
+	std::vector<int> lat;
+	std::ostringstream os;
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for (size_t i = 0; i < latency_us.size(); i++)
+			if (latency_us[i] >= 0) lat.push_back(latency_us[i]);
+
+		os << "{\"status\":\"ok\",\"workers\":" << pam.nWorkers << ",\"queue_depth\":" << depth
+			<< ",\"queue_max_depth\":" << depthMax << ",\"queue_capacity\":" << pam.maxQueue
+			<< ",\"done\":" << nDone << ",\"rejected\":" << nRejected
+			<< ",\"nodes\":" << queues.size() << ",\"stolen\":" << stolen;
+	}
+
+	// latency percentiles over the last IY_LATENCY_RING frames
+	std::sort(lat.begin(), lat.end());
+	const double pct[] = { 0.5, 0.95, 0.99 };
+	const char *names[] = { "p50_us", "p95_us", "p99_us" };
+	for (int i = 0; i < 3; i++)
+	{
+		int v = lat.empty() ? 0 : lat[std::min(lat.size() - 1, (size_t)(pct[i] * lat.size()))];
+		os << ",\"" << names[i] << "\":" << v;
+	}
+
+	if (cache)
+	{
+		CacheStats cs = cache->getStats();
+		os << ",\"cache_hits\":" << cs.nHits << ",\"cache_near_hits\":" << cs.nNearHits
+			<< ",\"cache_misses\":" << cs.nMisses << ",\"cache_entries\":" << cs.nEntries;
+	}
+	if (tracer) os << ",\"traces\":" << tracer->count();
+	os << "}";
+
+	return os.str();
+}
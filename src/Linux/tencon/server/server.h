@@ -0,0 +1,125 @@
+/*
+*  Long-lived detection daemon over a Unix domain socket
+*
+*   Frames arrive as raw gray planes (see protocol.h) and are queued for a
+*   pool of workers. Every worker owns its own Gallo/Soros/Yun instances, so
+*   the per-frame maps are never shared between threads. A worker takes one
+*   queued frame at a time, so no frame waits behind another while a worker
+*   is idle; when the queue is full new frames are answered with "busy"
+*   instead of waiting (back-pressure to the client).
+*   With a result cache, repeated frames are answered from it. With an
+*   affinity the workers and the connections are bound to NUMA nodes: a
+*   frame is read and queued on the node of its connection and taken by a
+*   worker of that node, idle workers steal from the other nodes. With a
+*   trace directory, detections slower than the threshold are written to it
+*   as frame traces.
+*/
+
+#ifndef IY_SERVER_H
+#define IY_SERVER_H
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "protocol.h"
+#include "cache/cache.h"
+#include "trace/trace.h"
+#include "pool/pool.h"
+#include "gallo/gallo.h"
+#include "soros/soros.h"
+#include "yun/yun.h"
+
+namespace iy{
+	typedef struct
+	{
+		std::string path;    // socket path
+		int nWorkers;        // detection threads (0: hardware threads)
+		int maxQueue;        // queued frames before requests are rejected
+		size_t cacheSize;    // frames whose results are cached (0: no cache)
+		int cacheDistance;   // difference hash bits a near duplicate may differ in (0: exact only)
+		int affinity;        // IY_AFFINITY_* of workers and connections (NONE: one queue, not bound)
+		TraceParams trace;   // detections slower than trace.thresholdMs are written to trace.dir (empty: off)
+	} ServerParams;
+
+	class Server{
+	private:
+		typedef struct
+		{
+			IyRequestHeader hdr;
+			std::vector<uchar> plane;
+			int64_t tEnqueue;
+			std::promise<std::string> reply;
+		} ServerJob;
+
+		ServerParams pam;
+
+		// one queue per node, all under qLock
+		NumaTopology topo;
+		std::vector<std::deque<ServerJob *> > queues;
+		std::unique_ptr<std::condition_variable[]> qCond;
+		std::vector<int> nIdle;
+		size_t nQueued;
+		size_t maxDepth;               // largest nQueued seen
+		uint64_t nStolen;              // frames taken from another node's queue
+		std::atomic<unsigned> nConnections;
+
+		std::mutex qLock;
+		std::atomic<bool> isStop;
+		bool isExit;                   // workers leave once the queue is drained (qLock)
+
+		// metrics
+		std::mutex mLock;
+		std::vector<int> latency_us;   // ring of the last frames (queue + detection)
+		size_t latency_pos;
+		uint64_t nDone, nRejected;
+
+		std::mutex cLock;
+		std::vector<int> clients;
+
+		std::unique_ptr<ResultCache> cache;   // shared by the workers, NULL: off
+		std::unique_ptr<TraceRecorder> tracer;
+
+		void worker(int node);
+		void connection(int fd, int node);
+		bool submit(ServerJob *job, int node);
+		std::string detect(ServerJob &job, iy::Gallo &gallo, iy::Soros &soros, iy::Yun &yun, YunResult &yres);
+		std::string stats();
+		void record(int64_t tEnqueue);
+
+	public:
+		Server() {
+			pam.path = "/tmp/iybarcode.sock";
+			pam.nWorkers = 0;
+			pam.maxQueue = 64;
+			pam.cacheSize = 0;
+			pam.cacheDistance = 0;
+			pam.affinity = IY_AFFINITY_NONE;
+			pam.trace.thresholdMs = 100;
+			pam.trace.maxTraces = 100;
+			nQueued = 0;
+			nConnections = 0;
+			isStop = false;
+			isExit = false;
+			latency_pos = 0;
+			nDone = nRejected = 0;
+			nStolen = 0;
+			maxDepth = 0;
+		}
+		~Server() {}
+
+		// blocks until stop() is called, returns false if the socket cannot be served
+		bool run(ServerParams pams);
+		void stop() { isStop = true; }  // async-signal-safe
+	};
+}
+
+#endif
@@ -25,19 +25,126 @@ cv::Rect Soros::process(cv::Mat &gray_src, bool is1D /*= true*/, int WinSz /*= 2
        // saliency map
        cv::Mat saliency = SaliencyMapbyAndoMatrix(gray_src, is1D);
        
-       // integral map
-       cv::Mat iMap = calc_integral_image(saliency);
+       result = find_region(saliency, WinSz);
+    }
+    catch(cv::Exception &e)
+    {
+        std::cerr << "cv::Exception: " << std::endl;
+        std::cerr << e.what() << std::endl;
+    }
+    
+    // return result
+    return result;
+}
+
+cv::Rect Soros::process_tiled(cv::Mat &gray_src, size_t maxBytes, bool is1D /*= true*/, int WinSz /*= 20*/)
+{
+    cv::Rect result(0,0,0,0);
+    
+    // the region is found on the whole frame, so the saliency, integral and
+    // smoothed maps stay full size; the tensor takes 24 bytes per pixel of a band
+    const cv::Size imSz = gray_src.size();
+    const double mapBytes = (2.0 + sizeof(float)) * imSz.width * imSz.height;
+    const double rowBytes = 3.0 * sizeof(double) * imSz.width;
+    const double nRows = (maxBytes - mapBytes) / rowBytes - 6;
+    if(mapBytes >= maxBytes || nRows < 1)
+    {
+        std::cerr << "Soros::process_tiled: " << maxBytes << " bytes can not hold the maps of a "
+                  << imSz.width << "x" << imSz.height << " frame" << std::endl;
+        return result;
+    }
+    const int bandRows = (int)std::min<double>(nRows, imSz.height);
+    
+    try{
+       // the row variant band by band, same map as process()
+       KernelTick t0 = KernelRegistry::get().tick();
+       
+       cv::Mat saliency(imSz, CV_8UC1, cv::Scalar(0));
+       std::vector<double> I;
+       for(int h = 0; h < imSz.height; h += bandRows)
+       {
+           const int h1 = std::min(imSz.height, h + bandRows);
+           if(is1D) calc_ando_band(gray_src, h, h1, I, &saliency, NULL);
+           else     calc_ando_band(gray_src, h, h1, I, NULL, &saliency);
+       }
+       std::vector<double>().swap(I);
        
-       // find max point with box filter
-       cv::Mat sMap(saliency.size(), CV_8UC1); 
-       cv::Point cp = find_max_point_with_smooth(iMap, sMap, WinSz);
+       KernelRegistry::get().record(IY_KERNEL_ANDO, IY_VARIANT_OPTIMIZED, t0, gray_src.total());
+       
+       result = find_region(saliency, WinSz);
+    }
+    catch(cv::Exception &e)
+    {
+        std::cerr << "cv::Exception: " << std::endl;
+        std::cerr << e.what() << std::endl;
+    }
     
-       // global binzrization
-       cv::Mat bMap(saliency.size(), CV_8UC1);
-       cv::threshold(sMap, bMap, 50, 255, cv::THRESH_OTSU);
+    return result;
+}
+
+bool Soros::preview(cv::Mat &gray_src, cv::Rect &roi, int stride /*= 4*/, bool is1D /*= true*/, int WinSz /*= 20*/)
+{
+    roi = cv::Rect(0,0,0,0);
+    if(stride < 1) stride = 1;
+    
+    try{
+       // tensor on the coarse grid, window in grid cells
+       cv::Mat saliency;
+       if(is1D) calc_ando_stride(gray_src, stride, &saliency, NULL);
+       else     calc_ando_stride(gray_src, stride, NULL, &saliency);
        
-       // box detection       
-       result = box_detection(bMap, cp);
+       cv::Rect rt = find_region(saliency, std::max(3, WinSz / stride));
+       roi = cv::Rect(rt.x * stride, rt.y * stride, rt.width * stride, rt.height * stride) & cv::Rect(0, 0, gray_src.cols, gray_src.rows);
+    }
+    catch(cv::Exception &e)
+    {
+        std::cerr << "cv::Exception: " << std::endl;
+        std::cerr << e.what() << std::endl;
+    }
+    
+    return roi.area() > 0;
+}
+
+cv::Rect Soros::find_region(cv::Mat &saliency, int WinSz)
+{
+    // integral map
+    cv::Mat iMap = calc_integral_image(saliency);
+    
+    // find max point with box filter, histogram of the smoothed map on the way
+    cv::Mat sMap(saliency.size(), CV_8UC1); 
+    int hist[256] = { 0 };
+    cv::Point cp = find_max_point_with_smooth(iMap, sMap, WinSz, hist);
+    
+    // global binzrization, applied on the fly by box_detection
+    int thr = calc_otsu(hist, sMap.rows * sMap.cols);
+    
+    // box detection       
+    return box_detection(sMap, cp, thr);
+}
+
+SorosResult Soros::process_joint(cv::Mat &gray_src, int WinSz /*= 20*/)
+{
+    SorosResult result;
+    result.roi1D = cv::Rect(0,0,0,0);
+    result.roi2D = cv::Rect(0,0,0,0);
+    
+    try{
+       // edge and corner maps from one structure tensor
+       cv::Mat saliency[2];
+       SaliencyMapsbyAndoMatrix(gray_src, &saliency[0], &saliency[1]);
+       
+       // integral maps
+       cv::Mat iMap[2] = { calc_integral_image(saliency[0]), calc_integral_image(saliency[1]) };
+       
+       // both box filters and maxima in one pass
+       cv::Mat sMap[2] = { cv::Mat(gray_src.size(), CV_8UC1), cv::Mat(gray_src.size(), CV_8UC1) };
+       int hist[2 * 256] = { 0 };
+       cv::Point cp[2];
+       find_max_points_with_smooth(iMap, sMap, 2, WinSz, hist, cp);
+       
+       // binarization and box detection per map
+       result.roi1D = box_detection(sMap[0], cp[0], calc_otsu(hist, sMap[0].rows * sMap[0].cols));
+       result.roi2D = box_detection(sMap[1], cp[1], calc_otsu(hist + 256, sMap[1].rows * sMap[1].cols));
     }
     catch(cv::Exception &e)
     {
@@ -45,7 +152,6 @@ cv::Rect Soros::process(cv::Mat &gray_src, bool is1D /*= true*/, int WinSz /*= 2
         std::cerr << e.what() << std::endl;
     }
     
-    // return result
     return result;
 }
 
@@ -58,17 +164,53 @@ double gmask[7][7] = {{0.0071, 0.0071, 0.0143, 0.0143, 0.0143, 0.0071, 0.0071},
                       {0.0071, 0.0071, 0.0143, 0.0143, 0.0143, 0.0071, 0.0071} };
 
 cv::Mat Soros::SaliencyMapbyAndoMatrix(cv::Mat &src, bool is1D)
+{
+    cv::Mat result;
+    if(is1D) SaliencyMapsbyAndoMatrix(src, &result, NULL);
+    else     SaliencyMapsbyAndoMatrix(src, NULL, &result);
+    
+    return result;
+}
+
+void Soros::SaliencyMapsbyAndoMatrix(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D)
+{
+    KernelRegistry &reg = KernelRegistry::get();
+    const int v = reg.selected(IY_KERNEL_ANDO);
+    run_ando(v, src, map1D, map2D);
+    
+    if(!reg.verify()) return;
+    
+    // the other variant on maps of its own
+    cv::Mat other1D, other2D;
+    run_ando(KernelRegistry::other(v), src, map1D ? &other1D : NULL, map2D ? &other2D : NULL);
+    
+    std::string where;
+    if(map1D) where = diff_maps(*map1D, other1D, "ando 1D");
+    if(where.empty() && map2D) where = diff_maps(*map2D, other2D, "ando 2D");
+    reg.verified(IY_KERNEL_ANDO, where);
+}
+
+void Soros::run_ando(int v, cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D)
+{
+    KernelTick t0 = KernelRegistry::get().tick();
+    
+    if(v == IY_VARIANT_REFERENCE) calc_ando_reference(src, map1D, map2D);
+    else                          calc_ando_rows(src, map1D, map2D);
+    
+    KernelRegistry::get().record(IY_KERNEL_ANDO, v, t0, src.total());
+}
+
+void Soros::calc_ando_reference(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D)
 {
     const cv::Size imSz = src.size();
     
-    cv::Mat result(imSz, CV_8UC1);
+    if(map1D) *map1D = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+    if(map2D) *map2D = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
     
-    double *Ixx = new double[sizeof(double) * imSz.width * imSz.height];
-    double *Ixy = new double[sizeof(double) * imSz.width * imSz.height];
-    double *Iyy = new double[sizeof(double) * imSz.width * imSz.height];
-    double *Cxx = new double[sizeof(double) * imSz.width * imSz.height];
-    double *Cxy = new double[sizeof(double) * imSz.width * imSz.height];
-    double *Cyy = new double[sizeof(double) * imSz.width * imSz.height];
+    // gradient products, zero on the image border
+    double *Ixx = new double[(size_t)imSz.width * imSz.height]();
+    double *Ixy = new double[(size_t)imSz.width * imSz.height]();
+    double *Iyy = new double[(size_t)imSz.width * imSz.height]();
     
     // edge by sobel
     for(int h = 1; h < imSz.height - 1; h++)
@@ -87,7 +229,7 @@ cv::Mat Soros::SaliencyMapbyAndoMatrix(cv::Mat &src, bool is1D)
         }
     } 
     
-    // apply gaussian window function
+    // apply gaussian window function, edge or corner map
     for(int h = 1; h < imSz.height - 1; h++)
     {
         for(int w = 1; w < imSz.width - 1; w++)
@@ -99,56 +241,201 @@ cv::Mat Soros::SaliencyMapbyAndoMatrix(cv::Mat &src, bool is1D)
             for(int m = 0; m < 7; m++)
             {
                 int s = h + m - 4;
-                if(s < 0) continue;
+                if(s < 0 || s >= imSz.height) continue;
                 for(int n = 0; n < 7; n++)
                 {
                     int k = w + n - 4;
-                    if(k < 0) continue;
+                    if(k < 0 || k >= imSz.width) continue;
                     C1 += Ixx[s*imSz.width + k] * gmask[m][n];
                     C2 += Ixy[s*imSz.width + k] * gmask[m][n];
                     C3 += Iyy[s*imSz.width + k] * gmask[m][n];
                 }
             }
             
-            Cxx[h*imSz.width + w] = C1;
-            Cxy[h*imSz.width + w] = C2;
-            Cyy[h*imSz.width + w] = C3;
+            double Txx = C1;
+            double Txy = C2;
+            double Tyy = C3;
+            
+            // edge map
+            if(map1D)
+            {
+                double m = ((Txx - Tyy)*(Txx - Tyy) + 4 * (Txy * Txy)) / ((Txx + Tyy) * (Txx + Tyy) + 10000); 
+                m *= 255.0;
+                map1D->at<uchar>(h,w) = (m > 255) ? 255 : m; 
+            }
+            
+            // corner map
+            if(map2D)
+            {
+                double m = (4 * (Txx*Tyy - (Txy*Txy))) / ((Txx + Tyy)*(Txx + Tyy) + 10000);
+                m *= 255.0;
+                map2D->at<uchar>(h,w) = (m > 255) ? 255 : m; 
+            }
         }
     }
     
-    // edge or corner map 
-    for(int h = 1; h < imSz.height - 1; h++)
+    delete[]Ixx;
+    delete[]Ixy;
+    delete[]Iyy;
+}
+
+// gaussian window over the interleaved gradient products I of an imSz grid, rows
+// h0 .. h1 - 1 of the edge and corner maps; I holds the grid from row iy0 on
+static void ando_window(const std::vector<double> &I, int iy0, cv::Size imSz, int h0, int h1, cv::Mat *map1D, cv::Mat *map2D)
+{
+    const int W = imSz.width;
+    
+    for(int h = std::max(1, h0); h < std::min(imSz.height - 1, h1); h++)
     {
-        for(int w = 1; w < imSz.width - 1; w++)
+        // window rows h - 4 .. h + 2 and columns w - 4 .. w + 2
+        const bool isRowInside = (h >= 4 && h + 2 < imSz.height);
+        uchar *row1D = map1D ? map1D->ptr<uchar>(h) : NULL;
+        uchar *row2D = map2D ? map2D->ptr<uchar>(h) : NULL;
+        
+        for(int w = 1; w < W - 1; w++)
         {
-            double Txx = Cxx[h*imSz.width + w];
-            double Txy = Cxy[h*imSz.width + w];
-            double Tyy = Cyy[h*imSz.width + w];
+            double C1 = 0;
+            double C2 = 0;
+            double C3 = 0;
             
-            double m = 0;
-            if(is1D)
+            if(isRowInside && w >= 4 && w + 2 < W)
             {
-                m = ((Txx - Tyy)*(Txx - Tyy) + 4 * (Txy * Txy)) / ((Txx + Tyy) * (Txx + Tyy) + 10000); 
+                for(int m = 0; m < 7; m++)
+                {
+                    const double *t = &I[(size_t)3 * ((h + m - 4 - iy0) * W + w - 4)];
+                    for(int n = 0; n < 7; n++)
+                    {
+                        C1 += t[3*n]     * gmask[m][n];
+                        C2 += t[3*n + 1] * gmask[m][n];
+                        C3 += t[3*n + 2] * gmask[m][n];
+                    }
+                }
             }
             else
             {
-                m = (4 * (Txx*Tyy - (Txy*Txy))) / ((Txx + Tyy)*(Txx + Tyy) + 10000);
-            }            
+                for(int m = 0; m < 7; m++)
+                {
+                    int s = h + m - 4;
+                    if(s < 0 || s >= imSz.height) continue;
+                    for(int n = 0; n < 7; n++)
+                    {
+                        int k = w + n - 4;
+                        if(k < 0 || k >= W) continue;
+                        const double *t = &I[(size_t)3 * ((s - iy0) * W + k)];
+                        C1 += t[0] * gmask[m][n];
+                        C2 += t[1] * gmask[m][n];
+                        C3 += t[2] * gmask[m][n];
+                    }
+                }
+            }
+            
+            double Txx = C1;
+            double Txy = C2;
+            double Tyy = C3;
             
-            m *= 255.0;
+            // edge map
+            if(row1D)
+            {
+                double m = ((Txx - Tyy)*(Txx - Tyy) + 4 * (Txy * Txy)) / ((Txx + Tyy) * (Txx + Tyy) + 10000); 
+                m *= 255.0;
+                row1D[w] = (m > 255) ? 255 : m; 
+            }
             
-            result.at<uchar>(h,w) = (m > 255) ? 255 : m; 
+            // corner map
+            if(row2D)
+            {
+                double m = (4 * (Txx*Tyy - (Txy*Txy))) / ((Txx + Tyy)*(Txx + Tyy) + 10000);
+                m *= 255.0;
+                row2D[w] = (m > 255) ? 255 : m; 
+            }
         }
     }
+}
+
+// calc_ando_reference on row pointers: integer sobel (the float products of the
+// reference are exact integers too), the three products interleaved, and no
+// border tests where the window lies inside the image; same sums in the same order
+void Soros::calc_ando_rows(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D)
+{
+    if(map1D) *map1D = cv::Mat(src.size(), CV_8UC1, cv::Scalar(0));
+    if(map2D) *map2D = cv::Mat(src.size(), CV_8UC1, cv::Scalar(0));
     
-    delete[]Ixx;
-    delete[]Ixy;
-    delete[]Iyy;
-    delete[]Cxx;
-    delete[]Cxy;
-    delete[]Cyy;
+    std::vector<double> I;
+    calc_ando_band(src, 0, src.rows, I, map1D, map2D);
+}
 
-    return result;
+// rows h0 .. h1 - 1 of the maps: the window reaches 4 rows up and 2 down, so
+// I holds the products of rows h0 - 4 .. h1 + 1 only
+void Soros::calc_ando_band(cv::Mat &src, int h0, int h1, std::vector<double> &I, cv::Mat *map1D, cv::Mat *map2D)
+{
+    const cv::Size imSz = src.size();
+    const int W = imSz.width;
+    const int iy0 = std::max(0, h0 - 4);
+    const int iy1 = std::min(imSz.height, h1 + 2);
+    
+    // Ixx, Ixy, Iyy per pixel, zero on the image border
+    I.assign((size_t)3 * W * (iy1 - iy0), 0.0);
+    
+    for(int h = std::max(1, iy0); h < std::min(imSz.height - 1, iy1); h++)
+    {
+        const uchar *p0 = src.ptr<uchar>(h - 1);
+        const uchar *p1 = src.ptr<uchar>(h);
+        const uchar *p2 = src.ptr<uchar>(h + 1);
+        double *dst = &I[(size_t)3 * (h - iy0) * W];
+        
+        for(int w = 1; w < W - 1; w++)
+        {
+            int dx = p0[w-1] + 2*p1[w-1] + p2[w-1] - p0[w+1] - 2*p1[w+1] - p2[w+1];
+            int dy = p0[w-1] + 2*p0[w] + p0[w+1] - p2[w-1] - 2*p2[w] - p2[w+1];
+            
+            dst[3*w]     = (double)(dx*dx);
+            dst[3*w + 1] = (double)(dx*dy);
+            dst[3*w + 2] = (double)(dy*dy);
+        }
+    }
+    
+    ando_window(I, iy0, imSz, h0, h1, map1D, map2D);
+}
+
+// calc_ando_rows on every stride-th pixel of src, no resized copy: the sobel of
+// cell (h, w) is centred on (w * stride + stride / 2, h * stride + stride / 2)
+// with taps stride / 2 apart, the window then spans 7 cells
+void Soros::calc_ando_stride(cv::Mat &src, int stride, cv::Mat *map1D, cv::Mat *map2D)
+{
+    const cv::Size imSz(src.cols / stride, src.rows / stride);
+    const int W = imSz.width;
+    const int off = stride / 2;
+    const int r = std::max(1, stride / 2);
+    
+    std::vector<double> I((size_t)3 * W * imSz.height, 0.0);
+    
+    for(int h = 0; h < imSz.height; h++)
+    {
+        const int y = h * stride + off;
+        if(y - r < 0 || y + r >= src.rows) continue;
+        
+        const uchar *p0 = src.ptr<uchar>(y - r);
+        const uchar *p1 = src.ptr<uchar>(y);
+        const uchar *p2 = src.ptr<uchar>(y + r);
+        double *dst = &I[(size_t)3 * h * W];
+        
+        for(int w = 0; w < W; w++)
+        {
+            const int x = w * stride + off;
+            if(x - r < 0 || x + r >= src.cols) continue;
+            
+            int dx = p0[x-r] + 2*p1[x-r] + p2[x-r] - p0[x+r] - 2*p1[x+r] - p2[x+r];
+            int dy = p0[x-r] + 2*p0[x] + p0[x+r] - p2[x-r] - 2*p2[x] - p2[x+r];
+            
+            dst[3*w]     = (double)(dx*dx);
+            dst[3*w + 1] = (double)(dx*dy);
+            dst[3*w + 2] = (double)(dy*dy);
+        }
+    }
+    
+    if(map1D) *map1D = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+    if(map2D) *map2D = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+    ando_window(I, 0, imSz, 0, imSz.height, map1D, map2D);
 }
 
 cv::Mat Soros::calc_integral_image(cv::Mat &src)
@@ -177,53 +464,7 @@ cv::Mat Soros::calc_integral_image(cv::Mat &src)
     return result;      
 }
        
-cv::Point Soros::find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz)
-{
-    const cv::Size imSz = src.size(); 
-    cv::Point max_pt(0, 0);
-    
-    const int nSize = WinSz * WinSz;
-    const int cSize = (WinSz / 2) + 1;
-    const int max_height =  imSz.height - cSize;
-    const int max_width = imSz.width - cSize;
-    float mean_max = 0.0f;
-    
-    for(int h = 0; h < imSz.height; h++)
-    {
-        int temp_top = h - cSize;
-        int ntop = (temp_top > max_height) ? max_height : temp_top;
-        int temp_bottom = h + cSize;
-        int nbottom = (temp_bottom >= imSz.height-1) ? imSz.height-1 : temp_bottom; 
-        
-        for(int w = 0; w < imSz.width; w++)
-        {
-            int temp_left = w - cSize;
-            int nleft = (temp_left > max_width) ? max_width : temp_left;
-            int temp_right = w + cSize;
-            int nright = (temp_right >= imSz.width-1) ? imSz.width-1 : temp_right; 
-            
-            // local mean
-            float n1 = (nleft > 0 && ntop > 0) ? src.at<float>(ntop, nleft-1): 0;
-            float n2 = (nleft > 0) ? src.at<float>(nbottom, nleft-1): 0;
-            float n3 = (ntop > 0) ? src.at<float>(ntop, nright): 0;
-            
-            float sum = src.at<float>(nbottom, nright) - n3 - n2 + n1;
-            float mean = sum / nSize;
-            
-            if(mean > mean_max){
-                mean_max = mean;
-                max_pt.x = w;
-                max_pt.y = h;
-            }
-            
-            smooth_map.at<uchar>(h,w) = (mean > 255) ? 255 : mean;
-        }
-    }
-    
-    return max_pt;
-}
-        
-cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp)
+cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp, int thr)
 {
    cv::Rect result(0,0,0,0);
     
@@ -232,7 +473,7 @@ cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp)
     // lfet
     for(int w = cp.x; w >= 0; w--)
     {
-        if(src.at<uchar>(cp.y, w) < 128)
+        if(src.at<uchar>(cp.y, w) <= thr)
         {
             result.x = w;
             break;
@@ -242,7 +483,7 @@ cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp)
     // right
     for(int w = cp.x; w < imSz.width; w++)
     {
-        if(src.at<uchar>(cp.y, w) < 128)
+        if(src.at<uchar>(cp.y, w) <= thr)
         {
             result.width = w - result.x;
             break;
@@ -252,7 +493,7 @@ cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp)
     // up
     for(int h = cp.y; h >= 0; h--)
     {
-        if(src.at<uchar>(h, cp.x) < 128)
+        if(src.at<uchar>(h, cp.x) <= thr)
         {
             result.y = h;
             break;
@@ -262,7 +503,7 @@ cv::Rect Soros::box_detection(cv::Mat &src, cv::Point cp)
     //down
     for(int h = cp.y; h < imSz.height; h++)
     {
-        if(src.at<uchar>(h, cp.x) < 128)
+        if(src.at<uchar>(h, cp.x) <= thr)
         {
             result.height = h - result.y;
             break;
@@ -13,19 +13,56 @@
  *        only localization method! *    
  */
 
+#ifndef IY_SOROS_H
+#define IY_SOROS_H
+
 #include <opencv2/opencv.hpp>
+#include <cfloat>
+
+#include "common/imgproc.h"
+#include "kernel/registry.h"
 
 namespace iy{
+    typedef struct
+    {
+        cv::Rect roi1D;   // edge coherence (1D codes)
+        cv::Rect roi2D;   // corner measure (QR, DataMatrix)
+    } SorosResult;
+    
     class Soros {
     private:        
         cv::Mat SaliencyMapbyAndoMatrix(cv::Mat &src, bool is1D = true);        
+        void SaliencyMapsbyAndoMatrix(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D);
+        
+        // variants of the kernel registry
+        void run_ando(int v, cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D);
+        void calc_ando_reference(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D);
+        void calc_ando_rows(cv::Mat &src, cv::Mat *map1D, cv::Mat *map2D);
+        void calc_ando_band(cv::Mat &src, int h0, int h1, std::vector<double> &I, cv::Mat *map1D, cv::Mat *map2D);
+        
+        // preview: tensor on every stride-th pixel, read straight from the source
+        void calc_ando_stride(cv::Mat &src, int stride, cv::Mat *map1D, cv::Mat *map2D);
         cv::Mat calc_integral_image(cv::Mat &src);
-        cv::Point find_max_point_with_smooth(cv::Mat &src, cv::Mat &smooth_map, int WinSz = 20);
-        cv::Rect box_detection(cv::Mat &src, cv::Point cp);
+        cv::Rect box_detection(cv::Mat &src, cv::Point cp, int thr);
+        cv::Rect find_region(cv::Mat &saliency, int WinSz);
     public:
         Soros() {}  
         ~Soros() {} 
         
         cv::Rect process(cv::Mat &gray_src, bool is1D = true, int WinSz = 20);
+        
+        // process() on large images: the tensor is computed in bands of rows sized
+        // to maxBytes, the full size maps (6 bytes per pixel) are not split because
+        // the region is searched over the whole frame; same result as process()
+        cv::Rect process_tiled(cv::Mat &gray_src, size_t maxBytes, bool is1D = true, int WinSz = 20);
+        
+        // presence check on a stride 2 or 4 grid, all stages at the reduced size;
+        // roi is coarse (grid cells in source pixels), true if a region was found
+        bool preview(cv::Mat &gray_src, cv::Rect &roi, int stride = 4, bool is1D = true, int WinSz = 20);
+        
+        // 1D and 2D regions from one tensor and one smoothing pass
+        SorosResult process_joint(cv::Mat &gray_src, int WinSz = 20);
     };
-}
\ No newline at end of file
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+*  Checks of the tests: a failed check is printed and counted, main returns
+*  the count so ctest sees any failure
+*/
+
+#ifndef IY_TEST_CHECK_H
+#define IY_TEST_CHECK_H
+
+#include <iostream>
+
+static int g_failures = 0;
+
+#define IY_CHECK(cond) \
+	do { \
+		if (!(cond)) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+			g_failures++; \
+		} \
+	} while (0)
+
+#define IY_CHECK_EQ(a, b) \
+	do { \
+		if (!((a) == (b))) \
+		{ \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #a " == " #b \
+				<< " (" << (a) << " vs " << (b) << ")" << std::endl; \
+			g_failures++; \
+		} \
+	} while (0)
+
+static inline int test_result(const char *name)
+{
+	std::cout << name << ": " << (g_failures == 0 ? "passed" : "FAILED") << std::endl;
+	return g_failures;
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*
+*  Frames of the tests: the images of Test_images, read as gray, and the
+*  comparison of two detector results
+*/
+
+#ifndef IY_TEST_FRAMES_H
+#define IY_TEST_FRAMES_H
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "yun/yun.h"
+
+#ifndef IY_TEST_IMAGES
+#define IY_TEST_IMAGES "Test_images"
+#endif
+
+#define IY_NUM_TEST_IMAGES 6
+
+// Test_images/t<n>.jpg as gray, empty if it can not be read
+static inline cv::Mat test_image(int n)
+{
+	const std::string path = std::string(IY_TEST_IMAGES) + "/t" + std::to_string(n) + ".jpg";
+	cv::Mat gray = cv::imread(path, cv::IMREAD_GRAYSCALE);
+	if (gray.empty()) std::cerr << "error! can not read " << path << std::endl;
+	return gray;
+}
+
+static inline bool same_pixels(const cv::Mat &a, const cv::Mat &b)
+{
+	if (a.size() != b.size() || a.type() != b.type()) return false;
+	for (int y = 0; y < a.rows; y++)
+		if (memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize()) != 0) return false;
+	return true;
+}
+
+static inline bool same_rect(const cv::Rect &a, const cv::Rect &b)
+{
+	return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+}
+
+static inline bool same_box(const cv::RotatedRect &a, const cv::RotatedRect &b)
+{
+	return a.center.x == b.center.x && a.center.y == b.center.y
+		&& a.size.width == b.size.width && a.size.height == b.size.height && a.angle == b.angle;
+}
+
+// every field that a caller sees, in the same order
+static inline bool same_candidates(const std::vector<iy::YunCandidate> &a, const std::vector<iy::YunCandidate> &b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++)
+	{
+		if (!same_rect(a[i].roi, b[i].roi) || !same_box(a[i].box, b[i].box)) return false;
+		if (a[i].orientation != b[i].orientation || a[i].isBarcode != b[i].isBarcode || a[i].score != b[i].score) return false;
+	}
+	return true;
+}
+
+static inline int count_barcodes(const std::vector<iy::YunCandidate> &c)
+{
+	int n = 0;
+	for (size_t i = 0; i < c.size(); i++)
+		if (c[i].isBarcode) n++;
+	return n;
+}
+
+#endif
@@ -0,0 +1,134 @@
+/*
+*  ResultCache: exact and near hits, ROI views, results of one frame joined, LRU eviction
+*/
+
+#include "cache/cache.h"
+#include "frames.h"
+#include "check.h"
+
+using namespace iy;
+
+static CacheResult make_result(int valid, int x)
+{
+	CacheResult res;
+	res.valid = valid;
+	res.gallo = cv::Rect(x, 0, 10, 10);
+	res.soros = cv::Rect(0, x, 10, 10);
+	return res;
+}
+
+static void test_hits(cv::Mat &gray)
+{
+	ResultCache cache(2, 0);
+	const CacheKey key = ResultCache::fingerprint(gray);
+	CacheResult res;
+
+	// same pixels, same key; one pixel changed, another key
+	cv::Mat copy = gray.clone();
+	IY_CHECK_EQ(ResultCache::fingerprint(copy).exact, key.exact);
+	copy.at<uchar>(gray.rows / 2, gray.cols / 2) ^= 1;
+	IY_CHECK(ResultCache::fingerprint(copy).exact != key.exact);
+
+	IY_CHECK(!cache.find(key, IY_CACHE_GALLO, res));
+	cache.insert(key, make_result(IY_CACHE_GALLO, 1));
+	IY_CHECK(cache.find(key, IY_CACHE_GALLO, res));
+	IY_CHECK(same_rect(res.gallo, cv::Rect(1, 0, 10, 10)));
+
+	// Soros is not stored yet, then joins the Gallo result of the frame
+	IY_CHECK(!cache.find(key, IY_CACHE_GALLO | IY_CACHE_SOROS, res));
+	cache.insert(key, make_result(IY_CACHE_SOROS, 2));
+	IY_CHECK(cache.find(key, IY_CACHE_GALLO | IY_CACHE_SOROS, res));
+	IY_CHECK(same_rect(res.gallo, cv::Rect(1, 0, 10, 10)));
+	IY_CHECK(same_rect(res.soros, cv::Rect(0, 2, 10, 10)));
+
+	// exact only: the changed frame misses
+	IY_CHECK(!cache.find(ResultCache::fingerprint(copy), IY_CACHE_GALLO, res));
+
+	CacheStats st = cache.getStats();
+	IY_CHECK_EQ(st.nHits, (uint64_t)2);
+	IY_CHECK_EQ(st.nMisses, (uint64_t)3);
+	IY_CHECK_EQ(st.nEntries, (size_t)1);
+}
+
+// a view into a larger frame and its continuous copy are the same frame
+static void test_roi(cv::Mat &gray)
+{
+	const cv::Rect area(gray.cols / 4 + 3, gray.rows / 4 + 1, gray.cols / 2 + 5, gray.rows / 2);
+	cv::Mat view = gray(area);
+	cv::Mat copy = view.clone();
+	IY_CHECK(!view.isContinuous());
+	IY_CHECK(copy.isContinuous());
+
+	const CacheKey kView = ResultCache::fingerprint(view), kCopy = ResultCache::fingerprint(copy);
+	IY_CHECK_EQ(kView.exact, kCopy.exact);
+	IY_CHECK_EQ(kView.dhash, kCopy.dhash);
+
+	ResultCache cache(4, 0);
+	CacheResult res;
+	cache.insert(kView, make_result(IY_CACHE_GALLO, 4));
+	IY_CHECK(cache.find(kCopy, IY_CACHE_GALLO, res));
+	IY_CHECK(same_rect(res.gallo, cv::Rect(4, 0, 10, 10)));
+	IY_CHECK_EQ(cache.getStats().nHits, (uint64_t)1);
+}
+
+static void test_near(cv::Mat &gray)
+{
+	ResultCache cache(4, 4);
+	cache.insert(ResultCache::fingerprint(gray), make_result(IY_CACHE_GALLO, 3));
+
+	// a little noise keeps the difference hash
+	cv::Mat noisy = gray.clone();
+	for (int y = 0; y < noisy.rows; y += 7)
+		for (int x = y % 5; x < noisy.cols; x += 5) noisy.at<uchar>(y, x) = (uchar)std::min(255, noisy.at<uchar>(y, x) + 1);
+
+	CacheResult res;
+	IY_CHECK(cache.find(ResultCache::fingerprint(noisy), IY_CACHE_GALLO, res));
+	IY_CHECK(same_rect(res.gallo, cv::Rect(3, 0, 10, 10)));
+	IY_CHECK_EQ(cache.getStats().nNearHits, (uint64_t)1);
+
+	// another size never matches
+	cv::Mat part = gray(cv::Rect(0, 0, gray.cols / 2, gray.rows / 2)).clone();
+	IY_CHECK(!cache.find(ResultCache::fingerprint(part), IY_CACHE_GALLO, res));
+}
+
+static void test_eviction(cv::Mat &gray)
+{
+	ResultCache cache(2, 0);
+	cv::Mat frames[3];
+	CacheKey keys[3];
+	for (int i = 0; i < 3; i++)
+	{
+		frames[i] = gray.clone();
+		frames[i].at<uchar>(0, 0) = (uchar)i;
+		keys[i] = ResultCache::fingerprint(frames[i]);
+	}
+
+	CacheResult res;
+	cache.insert(keys[0], make_result(IY_CACHE_GALLO, 0));
+	cache.insert(keys[1], make_result(IY_CACHE_GALLO, 1));
+	IY_CHECK(cache.find(keys[0], IY_CACHE_GALLO, res));   // 1 is now the least recently used
+	cache.insert(keys[2], make_result(IY_CACHE_GALLO, 2));
+
+	IY_CHECK(cache.find(keys[0], IY_CACHE_GALLO, res));
+	IY_CHECK(!cache.find(keys[1], IY_CACHE_GALLO, res));
+	IY_CHECK(cache.find(keys[2], IY_CACHE_GALLO, res));
+	IY_CHECK(same_rect(res.gallo, cv::Rect(2, 0, 10, 10)));
+	IY_CHECK_EQ(cache.getStats().nEvictions, (uint64_t)1);
+
+	cache.clear();
+	IY_CHECK(!cache.find(keys[0], IY_CACHE_GALLO, res));
+}
+
+int main()
+{
+	cv::Mat gray = test_image(2);
+	IY_CHECK(!gray.empty());
+	if (gray.empty()) return test_result("cache");
+
+	test_hits(gray);
+	test_roi(gray);
+	test_near(gray);
+	test_eviction(gray);
+
+	return test_result("cache");
+}
@@ -0,0 +1,56 @@
+/*
+*  ccl and ccl_packed: same blobs in the same order on every test image
+*/
+
+#include "yun/yun.h"
+#include "frames.h"
+#include "check.h"
+
+using namespace iy;
+
+// Yun with the labelling fixed to one variant, the other stages optimized
+static std::vector<YunCandidate> run_yun(cv::Mat &gray, int ccl, bool isCascade)
+{
+	KernelRegistry &kernels = KernelRegistry::get();
+	kernels.set_variant(IY_KERNEL_CCL, ccl);
+
+	Yun yun;
+	YunParams pam = yun.getParams();
+	pam.useCascade = isCascade;
+	yun.setParams(pam);
+	return yun.process(gray);
+}
+
+int main()
+{
+	KernelRegistry &kernels = KernelRegistry::get();
+	for (int k = 0; k < IY_NUM_KERNELS; k++) kernels.set_variant(k, IY_VARIANT_OPTIMIZED);
+
+	for (int n = 1; n <= IY_NUM_TEST_IMAGES; n++)
+	{
+		cv::Mat gray = test_image(n);
+		IY_CHECK(!gray.empty());
+		if (gray.empty()) continue;
+
+		for (int c = 0; c < 2; c++)
+		{
+			std::vector<YunCandidate> ref = run_yun(gray, IY_VARIANT_REFERENCE, c != 0);
+			std::vector<YunCandidate> opt = run_yun(gray, IY_VARIANT_OPTIMIZED, c != 0);
+			IY_CHECK(same_candidates(ref, opt));
+		}
+		IY_CHECK(count_barcodes(run_yun(gray, IY_VARIANT_OPTIMIZED, false)) > 0);
+
+		// both variants on every call, the blobs compared inside the registry
+		kernels.resetStats();
+		kernels.set_verify(true);
+		run_yun(gray, IY_VARIANT_OPTIMIZED, false);
+		kernels.set_verify(false);
+
+		KernelStats st = kernels.getStats(IY_KERNEL_CCL);
+		IY_CHECK(st.nChecks > 0);
+		IY_CHECK_EQ(st.nMismatches, (uint64_t)0);
+		if (st.nMismatches > 0) std::cerr << "t" << n << ": " << st.first << std::endl;
+	}
+
+	return test_result("ccl");
+}
@@ -0,0 +1,114 @@
+/*
+*  Ensemble: every detector completes, votes agree with the detectors run
+*  alone, early return leaves the next frame intact
+*/
+
+#include "ensemble/ensemble.h"
+#include "frames.h"
+#include "check.h"
+
+using namespace iy;
+
+static EnsembleParams make_params(int methods, int minVotes, bool isEarly)
+{
+	EnsembleParams pam;
+	pam.methods = methods;
+	pam.minVotes = minVotes;
+	pam.iouT = 0.3;
+	pam.isEarly = isEarly;
+	pam.WinSz = 20;
+	pam.isSteerable = false;
+	pam.pool = NULL;
+	return pam;
+}
+
+static void test_votes(cv::Mat &gray)
+{
+	const int all = (1 << IY_ENSEMBLE_GALLO) | (1 << IY_ENSEMBLE_SOROS) | (1 << IY_ENSEMBLE_YUN);
+	Ensemble ensemble(make_params(all, 1, false));
+
+	EnsembleResult res;
+	ensemble.process(gray, res);
+	IY_CHECK_EQ(res.finished, all);
+	IY_CHECK(!res.isEarly);
+	IY_CHECK(!res.regions.empty());
+	for (int m = 0; m < IY_NUM_METHODS; m++) IY_CHECK(res.ms[m] >= 0);
+
+	// a region holds one vote per detector that found it, most votes first
+	for (size_t i = 0; i < res.regions.size(); i++)
+	{
+		const EnsembleRegion &r = res.regions[i];
+		IY_CHECK_EQ(r.votes, __builtin_popcount(r.methods));
+		IY_CHECK(r.roi.area() > 0);
+		if (i > 0) IY_CHECK(res.regions[i - 1].votes >= r.votes);
+	}
+
+	// two votes: a subset of the single vote regions
+	ensemble.setParams(make_params(all, 2, false));
+	EnsembleResult res2;
+	ensemble.process(gray, res2);
+	size_t nTwo = 0;
+	for (size_t i = 0; i < res.regions.size(); i++)
+		if (res.regions[i].votes >= 2) nTwo++;
+	IY_CHECK_EQ(res2.regions.size(), nTwo);
+	for (size_t i = 0; i < res2.regions.size(); i++) IY_CHECK(res2.regions[i].votes >= 2);
+}
+
+// Yun alone in the ensemble finds the barcodes of Yun run on its own
+static void test_yun_only(cv::Mat &gray)
+{
+	Ensemble ensemble(make_params(1 << IY_ENSEMBLE_YUN, 1, false));
+	EnsembleResult res;
+	ensemble.process(gray, res);
+	IY_CHECK_EQ(res.finished, 1 << IY_ENSEMBLE_YUN);
+	IY_CHECK(res.ms[IY_ENSEMBLE_GALLO] < 0 && res.ms[IY_ENSEMBLE_SOROS] < 0);
+
+	Yun yun;
+	std::vector<YunCandidate> alone = yun.process(gray);
+	IY_CHECK_EQ((int)res.regions.size(), count_barcodes(alone));
+
+	size_t n = 0;
+	for (size_t i = 0; i < alone.size(); i++)
+	{
+		if (!alone[i].isBarcode) continue;
+
+		// sorted by score; every region of Yun is one of its barcodes
+		bool isFound = false;
+		for (size_t j = 0; j < res.regions.size(); j++)
+			if (same_rect(res.regions[j].roi, alone[i].roi)) isFound = true;
+		IY_CHECK(isFound);
+		n++;
+	}
+	IY_CHECK_EQ(n, res.regions.size());
+}
+
+static void test_early(cv::Mat &gray, cv::Mat &next)
+{
+	const int all = (1 << IY_ENSEMBLE_GALLO) | (1 << IY_ENSEMBLE_SOROS) | (1 << IY_ENSEMBLE_YUN);
+	Ensemble ensemble(make_params(all, 1, true));
+
+	EnsembleResult res;
+	ensemble.process(gray, res);
+	IY_CHECK(!res.regions.empty());
+	IY_CHECK(res.finished != 0);
+
+	// the next frame waits for the detectors left over from the first
+	ensemble.setParams(make_params(all, 1, false));
+	EnsembleResult res2;
+	ensemble.process(next, res2);
+	IY_CHECK_EQ(res2.finished, all);
+	IY_CHECK(!res2.isEarly);
+}
+
+int main()
+{
+	cv::Mat gray = test_image(1), next = test_image(2);
+	IY_CHECK(!gray.empty() && !next.empty());
+	if (gray.empty() || next.empty()) return test_result("ensemble");
+
+	test_votes(gray);
+	test_yun_only(gray);
+	test_early(gray, next);
+
+	return test_result("ensemble");
+}
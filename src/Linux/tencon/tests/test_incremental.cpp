@@ -0,0 +1,113 @@
+/*
+*  Yun incremental mode: a frame sequence with static and moving regions gives
+*  exactly the candidates of process() on every frame
+*/
+
+#include "yun/yun.h"
+#include "frames.h"
+#include "check.h"
+
+using namespace iy;
+
+static bool same_points(const std::vector<YunCandidate> &a, const std::vector<YunCandidate> &b)
+{
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); i++)
+		if (!(a[i].first_pt == b[i].first_pt) || !(a[i].last_pt == b[i].last_pt)) return false;
+	return true;
+}
+
+// frame t of the sequence: a barcode of t2 slides over t1, the rest stays put
+// except for single pixels on block borders, at the reach of the smoothing
+// window around a barcode of t1 and on the frame border
+static void make_frame(const cv::Mat &bg, const cv::Mat &fg, const YunParams &pam, int t, cv::Mat &frame)
+{
+	bg.copyTo(frame);
+
+	const cv::Rect patch(250, 194, 181, 92);
+	const int x = 10 + 7 * t, y = 20 + 3 * t;
+	const cv::Rect dst = cv::Rect(x, y, patch.width, patch.height) & cv::Rect(0, 0, frame.cols, frame.rows);
+	cv::Mat part = frame(dst);
+	fg(cv::Rect(patch.x, patch.y, dst.width, dst.height)).copyTo(part);
+
+	const int lbSz = pam.localBlockSz, halo = pam.winSz / 2;
+	const int k = 5 + t % 4;
+	const uchar val = (uchar)(t * 37);
+
+	// last column of block k - 1 and first of block k, then the same in y
+	frame.at<uchar>(300, lbSz * k) = val;
+	frame.at<uchar>(300, lbSz * k + 1) = (uchar)(255 - val);
+	frame.at<uchar>(lbSz * k, 500) = val;
+	frame.at<uchar>(lbSz * k + 1, 500) = (uchar)(255 - val);
+
+	// left of the barcode at (207, 119) of t1: inside, on and just past the
+	// smoothing window plus a block
+	const int dx = halo + lbSz - 2 + t % 5;
+	frame.at<uchar>(180, 207 - dx) = val;
+
+	// tile corners and the outermost row and column
+	frame.at<uchar>(pam.incTile * 3 - 1, pam.incTile * 4 - 1) = val;
+	frame.at<uchar>(pam.incTile * 3, pam.incTile * 4) = (uchar)(255 - val);
+	frame.at<uchar>(0, (t * 29) % frame.cols) = val;
+	frame.at<uchar>(frame.rows - 1 - t % 3, frame.cols - 1) = val;
+}
+
+static void run_sequence(const cv::Mat &bg, const cv::Mat &fg, YunParams pam, int nFrames)
+{
+	Yun inc, full;
+	inc.setParams(pam);
+	full.setParams(pam);
+
+	cv::Mat frame;
+	int nDiffer = 0;
+	for (int t = 0; t < nFrames; t++)
+	{
+		// two frames in a row unchanged, then a jump back
+		make_frame(bg, fg, pam, (t == 7) ? 6 : (t == 12) ? 2 : t, frame);
+
+		std::vector<YunCandidate> a = inc.process_incremental(frame);
+		std::vector<YunCandidate> b = full.process(frame);
+		if (!same_candidates(a, b) || !same_points(a, b))
+		{
+			std::cerr << "frame " << t << ": " << a.size() << " vs " << b.size() << " candidates" << std::endl;
+			nDiffer++;
+		}
+	}
+	IY_CHECK_EQ(nDiffer, 0);
+
+	// the frames after the first were patched, not recomputed
+	YunIncStats st = inc.getIncStats();
+	IY_CHECK_EQ(st.nFrames, (uint64_t)nFrames);
+	IY_CHECK_EQ(st.nFull, (uint64_t)1);
+	IY_CHECK(st.nDirty < st.nTiles);
+}
+
+int main()
+{
+	cv::Mat bg = test_image(1), fg = test_image(2);
+	IY_CHECK(!bg.empty() && !fg.empty());
+	if (bg.empty() || fg.empty()) return test_result("incremental");
+
+	Yun yun;
+	YunParams pam = yun.getParams();
+	run_sequence(bg, fg, pam, 16);
+
+	YunParams lazy = pam;
+	lazy.lazyMagnitude = true;
+	lazy.useCascade = true;
+	run_sequence(bg, fg, lazy, 16);
+
+	YunParams wide = pam;
+	wide.localBlockSz = 21;
+	wide.winSz = 35;
+	wide.incTile = 16;
+	run_sequence(bg, fg, wide, 16);
+
+	YunParams narrow = pam;
+	narrow.localBlockSz = 11;
+	narrow.winSz = 15;
+	narrow.incTile = 7;
+	run_sequence(bg, fg, narrow, 16);
+
+	return test_result("incremental");
+}
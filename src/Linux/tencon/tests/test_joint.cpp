@@ -0,0 +1,32 @@
+/*
+*  Soros process_joint: the regions of process() for 1D and 2D codes on every
+*  test image
+*/
+
+#include "soros/soros.h"
+#include "frames.h"
+#include "check.h"
+
+using namespace iy;
+
+int main()
+{
+	for (int n = 1; n <= IY_NUM_TEST_IMAGES; n++)
+	{
+		cv::Mat gray = test_image(n);
+		IY_CHECK(!gray.empty());
+		if (gray.empty()) continue;
+
+		Soros soros;
+		const SorosResult joint = soros.process_joint(gray);
+		IY_CHECK(same_rect(joint.roi1D, soros.process(gray, true)));
+		IY_CHECK(same_rect(joint.roi2D, soros.process(gray, false)));
+
+		// another window changes both regions the same way
+		const SorosResult wide = soros.process_joint(gray, 30);
+		IY_CHECK(same_rect(wide.roi1D, soros.process(gray, true, 30)));
+		IY_CHECK(same_rect(wide.roi2D, soros.process(gray, false, 30)));
+	}
+
+	return test_result("joint");
+}
@@ -0,0 +1,133 @@
+/*
+*  SpscQueue and MpmcQueue: bounds, order and no loss or duplicate under contention
+*/
+
+#include "pipeline/queue.h"
+#include "check.h"
+
+#include <thread>
+#include <vector>
+
+using namespace iy;
+
+static void test_bounds()
+{
+	SpscQueue<int> s(5);
+	IY_CHECK_EQ(s.capacity(), (size_t)8);
+
+	int v;
+	IY_CHECK(!s.pop(v));
+	for (int i = 0; i < 8; i++) IY_CHECK(s.push(i));
+	IY_CHECK(!s.push(8));
+	IY_CHECK_EQ(s.size(), (size_t)8);
+	for (int i = 0; i < 8; i++)
+	{
+		IY_CHECK(s.pop(v));
+		IY_CHECK_EQ(v, i);
+	}
+	IY_CHECK(!s.pop(v));
+
+	MpmcQueue<int> m(3);
+	IY_CHECK_EQ(m.capacity(), (size_t)4);
+	IY_CHECK(!m.pop(v));
+	for (int i = 0; i < 4; i++) IY_CHECK(m.push(i));
+	IY_CHECK(!m.push(4));
+	for (int i = 0; i < 4; i++)
+	{
+		IY_CHECK(m.pop(v));
+		IY_CHECK_EQ(v, i);
+	}
+	IY_CHECK(!m.pop(v));
+}
+
+// one producer and one consumer on a small ring, so both sides wrap and wait often
+static void test_spsc(int n)
+{
+	SpscQueue<int> q(4);
+	std::vector<int> got;
+	got.reserve(n);
+
+	std::thread consumer([&]() {
+		int v;
+		while ((int)got.size() < n)
+			if (q.pop(v)) got.push_back(v);
+			else std::this_thread::yield();
+	});
+	for (int i = 0; i < n; i++)
+		while (!q.push(i)) std::this_thread::yield();
+	consumer.join();
+
+	int nOutOfOrder = 0;
+	for (int i = 0; i < n; i++)
+		if (got[i] != i) nOutOfOrder++;
+	IY_CHECK_EQ(nOutOfOrder, 0);
+}
+
+// values are producer * n + i; every value arrives exactly once, and a consumer
+// sees the values of one producer in the order they were pushed
+static void test_mpmc(int nProducers, int nConsumers, int n)
+{
+	MpmcQueue<int> q(8);
+	std::atomic<int> nLeft(nProducers * n);
+	std::vector<std::vector<int> > got(nConsumers);
+
+	std::vector<std::thread> threads;
+	for (int c = 0; c < nConsumers; c++)
+	{
+		threads.push_back(std::thread([&, c]() {
+			int v;
+			while (nLeft.load() > 0)
+			{
+				if (!q.pop(v))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				got[c].push_back(v);
+				nLeft--;
+			}
+		}));
+	}
+	for (int p = 0; p < nProducers; p++)
+	{
+		threads.push_back(std::thread([&, p]() {
+			for (int i = 0; i < n; i++)
+				while (!q.push(p * n + i)) std::this_thread::yield();
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+
+	std::vector<int> seen(nProducers * n, 0);
+	int nOutOfOrder = 0;
+	for (int c = 0; c < nConsumers; c++)
+	{
+		std::vector<int> last(nProducers, -1);
+		for (size_t i = 0; i < got[c].size(); i++)
+		{
+			const int v = got[c][i];
+			seen[v]++;
+			if (v % n <= last[v / n]) nOutOfOrder++;
+			last[v / n] = v % n;
+		}
+	}
+
+	int nWrong = 0;
+	for (size_t i = 0; i < seen.size(); i++)
+		if (seen[i] != 1) nWrong++;
+	IY_CHECK_EQ(nWrong, 0);
+	IY_CHECK_EQ(nOutOfOrder, 0);
+
+	int v;
+	IY_CHECK(!q.pop(v));
+}
+
+int main()
+{
+	test_bounds();
+	test_spsc(200000);
+	test_mpmc(1, 4, 50000);
+	test_mpmc(4, 1, 50000);
+	test_mpmc(4, 4, 50000);
+
+	return test_result("queue");
+}
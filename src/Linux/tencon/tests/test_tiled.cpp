@@ -0,0 +1,96 @@
+/*
+*  Large images: Soros in bands gives the region of process(), Yun joins a
+*  barcode cut by tile seams into one candidate with its oriented box
+*/
+
+#include "soros/soros.h"
+#include "yun/yun.h"
+#include "frames.h"
+#include "check.h"
+
+#include <cmath>
+
+using namespace iy;
+
+// the full size maps plus a band of nRows rows of the tensor
+static size_t soros_budget(const cv::Mat &gray, int nRows)
+{
+	return (size_t)6 * gray.cols * gray.rows + (size_t)24 * gray.cols * (nRows + 6);
+}
+
+static void test_soros(int n)
+{
+	cv::Mat gray = test_image(n);
+	IY_CHECK(!gray.empty());
+	if (gray.empty()) return;
+
+	Soros soros;
+	for (int is1D = 0; is1D < 2; is1D++)
+	{
+		const cv::Rect full = soros.process(gray, is1D != 0);
+
+		// one row, a band that ends inside the window of the next, about a third of the frame
+		const int rows[3] = { 1, 7, gray.rows / 3 };
+		for (int k = 0; k < 3; k++)
+			IY_CHECK(same_rect(soros.process_tiled(gray, soros_budget(gray, rows[k]), is1D != 0), full));
+	}
+
+	// not even the full size maps fit
+	IY_CHECK_EQ(soros.process_tiled(gray, (size_t)gray.cols * gray.rows).area(), 0);
+}
+
+static const YunCandidate &first_barcode(const std::vector<YunCandidate> &c)
+{
+	size_t i = 0;
+	while (!c[i].isBarcode) i++;
+	return c[i];
+}
+
+// the code of t6 is 311 px tall and about 87 degrees off upright, the tiles
+// are some 150 px on a side
+static void test_yun_seam()
+{
+	cv::Mat gray = test_image(6);
+	IY_CHECK(!gray.empty());
+	if (gray.empty()) return;
+
+	Yun yun;
+	YunParams pam = yun.getParams();
+	pam.orientedBox = true;
+	yun.setParams(pam);
+
+	std::vector<YunCandidate> full = yun.process(gray);
+	IY_CHECK_EQ(count_barcodes(full), 1);
+
+	YunTileParams tpam;
+	tpam.maxBytes = 224 << 10;
+	tpam.overlap = 40;
+	tpam.nThreads = 1;
+	tpam.pool = NULL;
+	std::vector<YunCandidate> tiled = yun.process_tiled(gray, tpam);
+	IY_CHECK_EQ(count_barcodes(tiled), 1);
+	if (count_barcodes(full) != 1 || count_barcodes(tiled) != 1) return;
+
+	const YunCandidate &a = first_barcode(full);
+	const YunCandidate &b = first_barcode(tiled);
+
+	// joined from several tiles, not just the part of one
+	const double side = std::sqrt(tpam.maxBytes / yun.bytes_per_pixel());
+	IY_CHECK(b.roi.height > side);
+
+	IY_CHECK(std::fabs(b.box.angle - a.box.angle) < 1);
+	IY_CHECK(std::fabs(b.box.size.width - a.box.size.width) < 0.05 * a.box.size.width);
+	IY_CHECK(std::fabs(b.box.size.height - a.box.size.height) < 0.05 * a.box.size.height);
+
+	// the maps of a single tile do not fit: an error, not a larger tile
+	tpam.maxBytes = 64 << 10;
+	IY_CHECK(yun.process_tiled(gray, tpam).empty());
+}
+
+int main()
+{
+	for (int n = 1; n <= IY_NUM_TEST_IMAGES; n++) test_soros(n);
+	test_yun_seam();
+
+	return test_result("tiled");
+}
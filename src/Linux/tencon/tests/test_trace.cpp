@@ -0,0 +1,112 @@
+/*
+*  Frame traces: written and read back field by field, the replay of a Yun
+*  trace finds what the recorded run found
+*/
+
+#include "trace/trace.h"
+#include "frames.h"
+#include "check.h"
+
+#include <cstdio>
+
+using namespace iy;
+
+static void test_round_trip(cv::Mat &gray)
+{
+	Yun yun;
+	YunParams pam = yun.getParams();
+	pam.useCascade = true;
+	pam.winSz = 21;
+	pam.minPurity = 0.45;
+	pam.incSadT = 1.5;
+
+	FrameTrace in = make_trace(IY_YUN, gray, pam, 24, true);
+	in.ms = 123.5;
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		in.variant[k] = (k & 1) ? IY_VARIANT_REFERENCE : IY_VARIANT_OPTIMIZED;
+		in.kernel_ms[k] = 1.25 * k;
+	}
+
+	const std::string path = "test_trace.iytrace";
+	IY_CHECK(write_trace(path, in));
+
+	FrameTrace out;
+	IY_CHECK(read_trace(path, out));
+	std::remove(path.c_str());
+
+	IY_CHECK_EQ(out.time, in.time);
+	IY_CHECK_EQ(out.method, in.method);
+	IY_CHECK_EQ(out.WinSz, in.WinSz);
+	IY_CHECK_EQ(out.isSteerable, in.isSteerable);
+	IY_CHECK_EQ(out.ms, in.ms);
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		IY_CHECK_EQ(out.variant[k], in.variant[k]);
+		IY_CHECK_EQ(out.kernel_ms[k], in.kernel_ms[k]);
+	}
+
+	IY_CHECK_EQ(out.yun.magT, in.yun.magT);
+	IY_CHECK_EQ(out.yun.winSz, in.yun.winSz);
+	IY_CHECK_EQ(out.yun.useCascade, in.yun.useCascade);
+	IY_CHECK_EQ(out.yun.minPurity, in.yun.minPurity);
+	IY_CHECK_EQ(out.yun.orientedBox, in.yun.orientedBox);
+	IY_CHECK_EQ(out.yun.incSadT, in.yun.incSadT);
+
+	IY_CHECK(same_pixels(out.gray, gray));
+
+	// a file that is not a trace
+	FILE *f = std::fopen(path.c_str(), "wb");
+	if (f)
+	{
+		std::fputs("not a trace", f);
+		std::fclose(f);
+	}
+	IY_CHECK(!read_trace(path, out));
+	std::remove(path.c_str());
+}
+
+// recorder with a threshold of 0 keeps every run, the replay of the file it
+// wrote gives the candidates of the run
+static void test_replay(cv::Mat &gray)
+{
+	TraceParams tpam;
+	tpam.dir = ".";
+	tpam.thresholdMs = 0;
+	tpam.maxTraces = 1;
+	TraceRecorder recorder(tpam);
+
+	Yun yun;
+	const int64_t t0 = recorder.begin();
+	std::vector<YunCandidate> recorded = yun.process(gray);
+	const std::string path = recorder.end(t0, IY_YUN, gray, yun.getParams());
+	IY_CHECK(!path.empty());
+	IY_CHECK_EQ(recorder.count(), 1);
+
+	// the limit holds
+	IY_CHECK(recorder.end(recorder.begin(), IY_YUN, gray, yun.getParams()).empty());
+
+	FrameTrace trace;
+	IY_CHECK(read_trace(path, trace));
+	std::remove(path.c_str());
+	IY_CHECK(trace.ms >= 0);
+
+	KernelRegistry &kernels = KernelRegistry::get();
+	for (int k = 0; k < IY_NUM_KERNELS; k++) kernels.set_variant(k, trace.variant[k]);
+
+	Yun replay;
+	replay.setParams(trace.yun);
+	IY_CHECK(same_candidates(replay.process(trace.gray), recorded));
+}
+
+int main()
+{
+	cv::Mat gray = test_image(1);
+	IY_CHECK(!gray.empty());
+	if (gray.empty()) return test_result("trace");
+
+	test_round_trip(gray);
+	test_replay(gray);
+
+	return test_result("trace");
+}
@@ -0,0 +1,231 @@
+/*
+*  Frame traces of slow detections, for replay under a profiler
+*/
+
+#include "trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string.h>
+
+using namespace iy;
+
+// "IYTR", then fields in host byte order
+static const char trace_magic[4] = { 'I', 'Y', 'T', 'R' };
+static const int32_t trace_version = 1;
+
+static const char *method_names[IY_NUM_METHODS] = { "gallo", "soros", "yun" };
+
+template<typename T>
+static void put(std::ostream &os, T val)
+{
+	os.write((const char *)&val, sizeof(T));
+}
+
+template<typename T>
+static bool get(std::istream &is, T &val)
+{
+	return (bool)is.read((char *)&val, sizeof(T));
+}
+
+// fixed width fields, so the file does not depend on the struct layout
+static void put_params(std::ostream &os, const YunParams &p)
+{
+	put<int32_t>(os, p.magT);
+	put<int32_t>(os, p.winSz);
+	put<int32_t>(os, p.minEdgeT);
+	put<int32_t>(os, p.localBlockSz);
+	put<double>(os, p.minDensityEdgeT);
+	put<double>(os, p.minStrongRatio);
+	put<int32_t>(os, p.maxCandidates);
+	put<int32_t>(os, p.useSpecialized);
+	put<int32_t>(os, p.blockGrid);
+	put<int32_t>(os, p.lazyMagnitude);
+	put<int32_t>(os, p.useCascade);
+	put<double>(os, p.maxAspect);
+	put<double>(os, p.minPurity);
+	put<double>(os, p.minEdgeDensity);
+	put<int32_t>(os, p.orientedBox);
+	put<int32_t>(os, p.incTile);
+	put<double>(os, p.incSadT);
+}
+
+static bool get_params(std::istream &is, YunParams &p)
+{
+	int32_t v[8];
+	bool isOk = get(is, v[0]) && get(is, v[1]) && get(is, v[2]) && get(is, v[3])
+		&& get(is, p.minDensityEdgeT) && get(is, p.minStrongRatio)
+		&& get(is, v[4]) && get(is, v[5]) && get(is, v[6]) && get(is, v[7]);
+	if (!isOk) return false;
+
+	p.magT = v[0];
+	p.winSz = v[1];
+	p.minEdgeT = v[2];
+	p.localBlockSz = v[3];
+	p.maxCandidates = v[4];
+	p.useSpecialized = v[5] != 0;
+	p.blockGrid = v[6] != 0;
+	p.lazyMagnitude = v[7] != 0;
+
+	int32_t isCascade, isBox, tile;
+	isOk = get(is, isCascade) && get(is, p.maxAspect) && get(is, p.minPurity) && get(is, p.minEdgeDensity)
+		&& get(is, isBox) && get(is, tile) && get(is, p.incSadT);
+	if (!isOk) return false;
+
+	p.useCascade = isCascade != 0;
+	p.orientedBox = isBox != 0;
+	p.incTile = tile;
+	return true;
+}
+
+FrameTrace iy::make_trace(int method, const cv::Mat &gray, const YunParams &yun, int WinSz, bool isSteerable)
+{
+	FrameTrace trace;
+	trace.time = (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	trace.method = method;
+	trace.WinSz = WinSz;
+	trace.isSteerable = isSteerable;
+	trace.yun = yun;
+	trace.ms = 0;
+
+	KernelRegistry &kernels = KernelRegistry::get();
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		trace.variant[k] = kernels.selected(k);
+		trace.kernel_ms[k] = 0;
+	}
+
+	trace.gray = gray;
+	return trace;
+}
+
+bool iy::write_trace(const std::string &path, const FrameTrace &trace)
+{
+	std::vector<uchar> png;
+	try
+	{
+		if (trace.gray.empty() || !cv::imencode(".png", trace.gray, png)) return false;
+	}
+	catch (cv::Exception &e)
+	{
+		std::cerr << "warning! trace frame: " << e.what() << std::endl;
+		return false;
+	}
+
+	std::ofstream os(path.c_str(), std::ios::binary);
+	if (!os) return false;
+
+	os.write(trace_magic, sizeof(trace_magic));
+	put<int32_t>(os, trace_version);
+	put<int64_t>(os, trace.time);
+	put<int32_t>(os, trace.method);
+	put<int32_t>(os, trace.WinSz);
+	put<int32_t>(os, trace.isSteerable);
+	put_params(os, trace.yun);
+
+	put<int32_t>(os, IY_NUM_KERNELS);
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		put<int32_t>(os, trace.variant[k]);
+		put<double>(os, trace.kernel_ms[k]);
+	}
+	put<double>(os, trace.ms);
+
+	put<uint32_t>(os, (uint32_t)png.size());
+	os.write((const char *)png.data(), png.size());
+
+	return (bool)os;
+}
+
+bool iy::read_trace(const std::string &path, FrameTrace &trace)
+{
+	std::ifstream is(path.c_str(), std::ios::binary);
+	if (!is) return false;
+
+	char magic[4];
+	int32_t version, method, isSteer, nKernels;
+	if (!is.read(magic, sizeof(magic)) || memcmp(magic, trace_magic, sizeof(magic)) != 0) return false;
+	if (!get(is, version) || version != trace_version) return false;
+
+	bool isOk = get(is, trace.time) && get(is, method) && get(is, trace.WinSz) && get(is, isSteer)
+		&& get_params(is, trace.yun) && get(is, nKernels);
+	if (!isOk || method < 0 || method >= IY_NUM_METHODS || nKernels < 0) return false;
+	trace.method = method;
+	trace.isSteerable = isSteer != 0;
+
+	// kernels added since the trace was written keep their current variant
+	KernelRegistry &kernels = KernelRegistry::get();
+	for (int k = 0; k < IY_NUM_KERNELS; k++)
+	{
+		trace.variant[k] = kernels.selected(k);
+		trace.kernel_ms[k] = 0;
+	}
+	for (int k = 0; k < nKernels; k++)
+	{
+		int32_t v;
+		double ms;
+		if (!get(is, v) || !get(is, ms)) return false;
+		if (k >= IY_NUM_KERNELS) continue;
+
+		trace.variant[k] = (v == IY_VARIANT_REFERENCE) ? IY_VARIANT_REFERENCE : IY_VARIANT_OPTIMIZED;
+		trace.kernel_ms[k] = ms;
+	}
+
+	uint32_t nBytes;
+	if (!get(is, trace.ms) || !get(is, nBytes)) return false;
+
+	std::vector<uchar> png(nBytes);
+	if (!is.read((char *)png.data(), nBytes)) return false;
+
+	try
+	{
+		trace.gray = cv::imdecode(png, cv::IMREAD_GRAYSCALE);
+	}
+	catch (cv::Exception &e)
+	{
+		std::cerr << "warning! trace frame: " << e.what() << std::endl;
+		return false;
+	}
+	return !trace.gray.empty();
+}
+
+std::string TraceRecorder::record(const FrameTrace &trace)
+{
+	if (!is_slow(trace.ms)) return std::string();
+	if (pam.maxTraces > 0 && nTraces.load() >= pam.maxTraces) return std::string();
+
+	// the slot is taken before writing, so concurrent runs never exceed the limit
+	const int n = nTraces++;
+	if (pam.maxTraces > 0 && n >= pam.maxTraces) return std::string();
+
+	std::ostringstream path;
+	path << pam.dir << "/" << trace.time << "_" << method_names[trace.method] << "_" << n << ".iytrace";
+	if (!write_trace(path.str(), trace))
+	{
+		std::cerr << "warning! can not write trace " << path.str() << std::endl;
+		return std::string();
+	}
+	return path.str();
+}
+
+int64_t TraceRecorder::begin() const
+{
+	double ms[IY_NUM_KERNELS];
+	KernelRegistry::take_thread_ms(ms);
+	return cv::getTickCount();
+}
+
+std::string TraceRecorder::end(int64_t t0, int method, const cv::Mat &gray, const YunParams &yun, int WinSz, bool isSteerable)
+{
+	const double ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+	if (!is_slow(ms)) return std::string();
+
+	FrameTrace trace = make_trace(method, gray, yun, WinSz, isSteerable);
+	trace.ms = ms;
+	KernelRegistry::take_thread_ms(trace.kernel_ms);
+	return record(trace);
+}
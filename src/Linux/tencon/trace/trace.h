@@ -0,0 +1,81 @@
+/*
+*  Frame traces of slow detections, for replay under a profiler
+*
+*   A trace holds one detector run: the gray frame (PNG, lossless), the
+*   detector params, the kernel variants that were selected and the time of
+*   the run and of every registered kernel in it. TraceRecorder writes a
+*   trace for every run slower than thresholdMs into a directory, at most
+*   maxTraces of them, so a latency spike seen in production can be run again
+*   with the same input and settings (iyBarcode --replay). Kernel times are
+*   those of the calling thread, see KernelRegistry::take_thread_ms(). The
+*   recorder is thread safe.
+*/
+
+#ifndef IY_TRACE_H
+#define IY_TRACE_H
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <stdint.h>
+
+#include "common/method.h"
+#include "kernel/registry.h"
+#include "yun/yun.h"
+
+namespace iy{
+	typedef struct
+	{
+		int64_t time;                     // unix time of the run, ms
+		int method;                       // IY_GALLO, IY_SOROS or IY_YUN
+		int WinSz;                        // Gallo and Soros window
+		bool isSteerable;                 // Gallo
+		YunParams yun;
+		int variant[IY_NUM_KERNELS];      // IY_VARIANT_* selected at the time
+		double ms;                        // the whole run
+		double kernel_ms[IY_NUM_KERNELS]; // of it in the registered kernels
+		cv::Mat gray;
+	} FrameTrace;
+
+	typedef struct
+	{
+		std::string dir;        // existing directory the traces are written to
+		double thresholdMs;     // runs slower than this are recorded
+		int maxTraces;          // traces written at most (0: no limit)
+	} TraceParams;
+
+	// method, params and variants filled in, the rest cleared
+	FrameTrace make_trace(int method, const cv::Mat &gray, const YunParams &yun, int WinSz = 20, bool isSteerable = false);
+
+	bool write_trace(const std::string &path, const FrameTrace &trace);
+	bool read_trace(const std::string &path, FrameTrace &trace);
+
+	class TraceRecorder{
+	private:
+		TraceParams pam;
+		std::atomic<int> nTraces;
+
+		TraceRecorder(const TraceRecorder &);
+		TraceRecorder &operator=(const TraceRecorder &);
+
+	public:
+		explicit TraceRecorder(TraceParams pams) : pam(pams), nTraces(0) {}
+		~TraceRecorder() {}
+
+		bool is_slow(double ms) const { return ms >= pam.thresholdMs; }
+		int count() const { return (pam.maxTraces > 0) ? std::min(nTraces.load(), pam.maxTraces) : nTraces.load(); }
+
+		// writes dir/<time>_<method>_<n>.iytrace if the run was slow and the
+		// limit is not reached, returns the path (empty: nothing written)
+		std::string record(const FrameTrace &trace);
+
+		// bracket one run on the calling thread: begin() restarts its kernel
+		// sums and returns the tick count, end() records the run if it was slow
+		int64_t begin() const;
+		std::string end(int64_t t0, int method, const cv::Mat &gray, const YunParams &yun, int WinSz = 20, bool isSteerable = false);
+	};
+}
+
+#endif
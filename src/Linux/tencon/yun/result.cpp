@@ -0,0 +1,140 @@
+/*
+*  Blobs and barcodes of Yun, one array per field
+*/
+
+#include "result.h"
+
+using namespace iy;
+
+void YunBlobs::clear()
+{
+	roi.clear();
+	max_orientation.clear();
+	cnt.clear();
+	nEdge.clear();
+	nNear.clear();
+	score.clear();
+}
+
+void YunBlobs::reserve(size_t n)
+{
+	roi.reserve(n);
+	max_orientation.reserve(n);
+	cnt.reserve(n);
+	nEdge.reserve(n);
+	nNear.reserve(n);
+	score.reserve(n);
+}
+
+size_t YunBlobs::bytes() const
+{
+	return (roi.capacity() + tRoi.capacity()) * sizeof(cv::Rect) +
+		(max_orientation.capacity() + cnt.capacity() + nEdge.capacity() + nNear.capacity() + tInt.capacity()) * sizeof(int) +
+		(score.capacity() + tScore.capacity()) * sizeof(double);
+}
+
+void YunBlobs::push_back(const YunLabel &val)
+{
+	roi.push_back(val.roi);
+	max_orientation.push_back(val.max_orientation);
+	cnt.push_back(val.cnt);
+	nEdge.push_back(val.nEdge);
+	nNear.push_back(val.nNear);
+	score.push_back(val.score);
+}
+
+YunLabel YunBlobs::at(size_t i) const
+{
+	YunLabel val;
+	val.roi = roi[i];
+	val.max_orientation = max_orientation[i];
+	val.cnt = cnt[i];
+	val.nEdge = nEdge[i];
+	val.nNear = nNear[i];
+	val.score = score[i];
+	return val;
+}
+
+template<typename T>
+static void gather(std::vector<T> &v, const std::vector<int> &idx, std::vector<T> &tmp)
+{
+	tmp.resize(idx.size());
+	for (size_t i = 0; i < idx.size(); i++) tmp[i] = v[idx[i]];
+	v.swap(tmp);
+}
+
+void YunBlobs::select(const std::vector<int> &idx)
+{
+	gather(roi, idx, tRoi);
+	gather(max_orientation, idx, tInt);
+	gather(cnt, idx, tInt);
+	gather(nEdge, idx, tInt);
+	gather(nNear, idx, tInt);
+	gather(score, idx, tScore);
+}
+
+std::vector<YunLabel> YunBlobs::to_vector() const
+{
+	std::vector<YunLabel> list(size());
+	for (size_t i = 0; i < list.size(); i++) list[i] = at(i);
+	return list;
+}
+
+void YunResult::clear()
+{
+	roi.clear();
+	box.clear();
+	orientation.clear();
+	first_pt.clear();
+	last_pt.clear();
+	score.clear();
+}
+
+void YunResult::reserve(size_t n)
+{
+	roi.reserve(n);
+	box.reserve(n);
+	orientation.reserve(n);
+	first_pt.reserve(n);
+	last_pt.reserve(n);
+	score.reserve(n);
+}
+
+void YunResult::push_back(const YunCandidate &val)
+{
+	if (!val.isBarcode) return;
+	if (roi.size() == roi.capacity()) nGrow++;
+
+	roi.push_back(val.roi);
+	box.push_back(val.box);
+	orientation.push_back(val.orientation);
+	first_pt.push_back(val.first_pt);
+	last_pt.push_back(val.last_pt);
+	score.push_back(val.score);
+}
+
+YunCandidate YunResult::at(size_t i) const
+{
+	YunCandidate val;
+	val.roi = roi[i];
+	val.box = box[i];
+	val.orientation = orientation[i];
+	val.first_pt = first_pt[i];
+	val.last_pt = last_pt[i];
+	val.score = score[i];
+	val.isBarcode = true;
+	return val;
+}
+
+void YunResult::assign(const std::vector<YunCandidate> &list)
+{
+	clear();
+	for (size_t i = 0; i < list.size(); i++) push_back(list[i]);
+}
+
+std::vector<YunCandidate> YunResult::to_vector() const
+{
+	std::vector<YunCandidate> list(size());
+	for (size_t i = 0; i < list.size(); i++) list[i] = at(i);
+	return list;
+}
@@ -0,0 +1,105 @@
+/*
+*  Blobs and barcodes of Yun, one array per field
+*
+*   YunBlobs holds what the labelling found, YunResult the verified barcodes
+*   of a frame. Both keep their arrays between frames: clear() leaves the
+*   capacity, so a detector or a caller that reuses one object stops
+*   allocating once it has seen its largest frame (or after reserve()).
+*   YunLabel and YunCandidate stay as the record of a single entry.
+*
+*   box is the oriented extent of a barcode (YunParams::orientedBox): width
+*   across the bars, height along them, angle of the bar normal in degrees.
+*   A 45 degree code fills about half of its roi, the box only the code.
+*/
+
+#ifndef IY_YUN_RESULT_H
+#define IY_YUN_RESULT_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <stdint.h>
+
+namespace iy{
+	typedef struct
+	{
+		cv::Rect roi;
+		int max_orientation;
+		int cnt;      // edge pixels voting for max_orientation
+		int nEdge;    // all oriented pixels of the blob
+		int nNear;    // pixels within NEAR_ANG folded orientations of max_orientation
+		double score; // cascade confidence
+	} YunLabel;
+
+	typedef struct
+	{
+		cv::Point last_pt, first_pt;
+		cv::Rect roi;
+		cv::RotatedRect box;   // oriented extent, roi as an upright box when not computed
+		int orientation;
+		bool isBarcode;
+		double score;  // confidence in [0, 1] when the cascade runs, 0 otherwise
+	} YunCandidate;
+
+	class YunBlobs{
+	private:
+		// gather buffers of select()
+		std::vector<cv::Rect> tRoi;
+		std::vector<int> tInt;
+		std::vector<double> tScore;
+
+	public:
+		std::vector<cv::Rect> roi;
+		std::vector<int> max_orientation;
+		std::vector<int> cnt, nEdge, nNear;
+		std::vector<double> score;
+
+		size_t size() const { return roi.size(); }
+		bool empty() const { return roi.empty(); }
+		void clear();
+		void reserve(size_t n);
+
+		// heap held by the arrays and the gather buffers
+		size_t bytes() const;
+
+		void push_back(const YunLabel &val);
+		YunLabel at(size_t i) const;
+
+		// keeps the blobs idx[0], idx[1], .. in that order
+		void select(const std::vector<int> &idx);
+
+		std::vector<YunLabel> to_vector() const;
+	};
+
+	class YunResult{
+	private:
+		uint64_t nGrow;
+
+	public:
+		std::vector<cv::Rect> roi;
+		std::vector<cv::RotatedRect> box;
+		std::vector<int> orientation;
+		std::vector<cv::Point> first_pt, last_pt;
+		std::vector<double> score;
+
+		YunResult() : nGrow(0) {}
+		explicit YunResult(size_t n) : nGrow(0) { reserve(n); }
+
+		size_t size() const { return roi.size(); }
+		bool empty() const { return roi.empty(); }
+		size_t capacity() const { return roi.capacity(); }
+		void clear();
+		void reserve(size_t n);
+
+		// only barcodes are stored, at() returns them with isBarcode set
+		void push_back(const YunCandidate &val);
+		YunCandidate at(size_t i) const;
+
+		void assign(const std::vector<YunCandidate> &list);
+		std::vector<YunCandidate> to_vector() const;
+
+		// push_back() calls that had to grow the arrays
+		uint64_t growths() const { return nGrow; }
+	};
+}
+
+#endif
@@ -15,41 +15,414 @@
 
 #include "yun.h"
 
+#include <sstream>
+
 using namespace iy;
 
 std::vector<YunCandidate> Yun::process(cv::Mat &gray_src)
 {
-	std::vector<YunCandidate> result;
+	YunResult result;
+	process(gray_src, result);
+	return result.to_vector();
+}
+
+void Yun::process(cv::Mat &gray_src, YunResult &result)
+{
+	result.clear();
+	isCut = false;
 
 	try{
 		std::vector<YunOrientation> Vmap;
-		cv::Mat mMap(gray_src.size(), CV_8UC1);
-		cv::Mat oMap = calc_orientation(gray_src, mMap, Vmap);
+		// empty in lazy mode: magnitude is computed where it is needed
+		cv::Mat mMap;
+		if (!pam.lazyMagnitude) mMap = cv::Mat(gray_src.size(), CV_8UC1, cv::Scalar(0));
+		cv::Mat oMap = dispatch_orientation(gray_src, mMap, Vmap);
+
+		detect(gray_src, mMap, oMap, Vmap, result);
+	}
+	catch (cv::Exception &e)
+	{
+		std::cerr << "cv::Exception: " << std::endl;
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+void Yun::detect(cv::Mat &gray_src, cv::Mat &mMap, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunResult &result)
+{
+	YunBlobs &blob = wsBlob;
+	blob.clear();
 
+	if (is_expired())
+	{
+		// out of time before any region was searched
+	}
+	else if (pam.blockGrid)
+	{
+		// saliency map, one cell per block
+		cv::Mat hMap;
+		cv::Mat gMap = calc_saliency_grid(oMap, pam.localBlockSz, hMap);
+		int hist[256] = { 0 };
+		cv::Mat sMap = calc_smooth_grid(gMap, pam.winSz, pam.localBlockSz, hist);
+		int thr = calc_otsu(hist, sMap.rows * sMap.cols);
+
+		// search region, blobs mapped back to pixel rectangles
+		if (!is_expired()) ccl_grid(sMap, thr, hMap, Vmap, pam.localBlockSz, oMap.size(), blob);
+	}
+	else
+	{
 		// saliency map
-		cv::Mat eMap = calc_saliency(oMap, Vmap, pam.localBlockSz);
+		cv::Mat eMap = dispatch_saliency(oMap, Vmap, pam.localBlockSz);
 
-		cv::Mat iMap = calc_integral_image(eMap);
-		cv::Mat sMap = calc_smooth(iMap, pam.winSz);
+		// smoothing also builds the histogram for Otsu
+		int hist[256] = { 0 };
+		cv::Mat iMap = dispatch_integral(eMap);
+		cv::Mat sMap = dispatch_smooth(iMap, pam.winSz, hist);
 
-		cv::Mat bMap; // (sMap.size(), CV_8UC1);
-		cv::threshold(sMap, bMap, 50, 255, cv::THRESH_OTSU);
+		// global binarization, applied on the fly by ccl
+		int thr = calc_otsu(hist, sMap.rows * sMap.cols);
 
 		// search region
-		std::vector<YunLabel> blob = ccl(bMap, oMap, Vmap);
+		if (!is_expired()) dispatch_ccl(sMap, thr, oMap, Vmap, blob);
+	}
+
+	// blobs of a cut labelling are incomplete, nothing to verify
+	if (!isCut)
+	{
+		limit_candidates(blob, token != NULL);
+		cstats.nBlobs += blob.size();
+
+		// cheap rejects before the ray walk
+		if (pam.useCascade) calc_cascade(blob, oMap);
 
 		// candidate
-		result = calc_candidate(blob, mMap, oMap);
+		calc_candidate(blob, gray_src, mMap, oMap, result);
+	}
+
+	//clear
+	Vmap.clear();
+	blob.clear();
+}
+
+bool Yun::preview(cv::Mat &gray_src, int stride, YunResult &result)
+{
+	result.clear();
+	isCut = false;
+	if (stride < 1) stride = 1;
+
+	// windows and edge counts shrink with the grid (odd sizes: the specialized
+	// kernels of the default params at stride 2 and 4); the magnitude map is
+	// kept and no box computed, so the stages never read the full size source
+	struct Restore { YunParams &dst; YunParams val; ~Restore() { dst = val; } } restore = { pam, pam };
+	pam.localBlockSz = std::max(3, (pam.localBlockSz / stride) | 1);
+	pam.winSz = std::max(3, (pam.winSz / stride) | 1);
+	pam.minEdgeT = std::max(4, pam.minEdgeT / stride);
+	pam.lazyMagnitude = false;
+	pam.orientedBox = false;
+
+	try{
+		std::vector<YunOrientation> Vmap;
+		cv::Mat mMap;
+		cv::Mat oMap = calc_orientation_stride(gray_src, stride, mMap, Vmap);
 
-		//clear
-		Vmap.clear();
-		blob.clear();
+		detect(gray_src, mMap, oMap, Vmap, result);
 	}
 	catch (cv::Exception &e)
 	{
 		std::cerr << "cv::Exception: " << std::endl;
 		std::cerr << e.what() << std::endl;
 	}
+
+	// grid cells back to source pixels
+	const cv::Rect imgRect(0, 0, gray_src.cols, gray_src.rows);
+	const cv::Point off(stride / 2, stride / 2);
+	for (size_t i = 0; i < result.size(); i++)
+	{
+		cv::Rect &roi = result.roi[i];
+		roi = cv::Rect(roi.x * stride, roi.y * stride, roi.width * stride, roi.height * stride) & imgRect;
+		result.first_pt[i] = result.first_pt[i] * stride + off;
+		result.last_pt[i] = result.last_pt[i] * stride + off;
+		result.box[i] = cv::RotatedRect(cv::Point2f(roi.x + roi.width * 0.5f, roi.y + roi.height * 0.5f),
+			cv::Size2f((float)roi.width, (float)roi.height), 0);
+	}
+
+	return !result.empty();
+}
+
+std::vector<YunCandidate> Yun::process(cv::Mat &gray_src, const YunToken &tok, bool &isPartial)
+{
+	// the token is cleared on every way out, a throwing stage included
+	struct TokenScope
+	{
+		const YunToken *&ref;
+		TokenScope(const YunToken *&r, const YunToken *t) : ref(r) { ref = t; }
+		~TokenScope() { ref = NULL; }
+	} scope(token, &tok);
+
+	std::vector<YunCandidate> result = process(gray_src);
+
+	isPartial = isCut;
+	return result;
+}
+
+bool Yun::is_expired()
+{
+	if (token != NULL && !isCut && token->expired()) isCut = true;
+	return isCut;
+}
+
+// per tile, on top of its maps: cv::Mat headers, histograms, the detector and
+// its results, and room for the runs and blob records of usual content
+static const size_t TILE_SLACK = 8 << 10;
+static const double TILE_CONTENT_BPP = 2.0;
+
+// blob record with its share of the gather buffers of select() and of wsOrder
+static const size_t BLOB_BYTES = 2 * (sizeof(cv::Rect) + 4 * sizeof(int) + sizeof(double)) + sizeof(int);
+
+size_t Yun::ws_held() const
+{
+	return wsBlob.bytes() + wsOrder.capacity() * sizeof(int) + (wsHist[0].capacity() + wsHist[1].capacity()) * sizeof(int);
+}
+
+bool Yun::ws_fits(size_t n)
+{
+	if (wsCap == 0 || ws_held() + wsUsed + n <= wsCap) return true;
+
+	isOverCap = true;
+	isCut = true;
+	return false;
+}
+
+void Yun::push_blob(YunBlobs &blob, const YunLabel &val)
+{
+	// the arrays double, old and new are both alive while they move
+	const size_t cap = blob.roi.capacity();
+	if (blob.size() == cap)
+	{
+		const size_t n = std::max((size_t)16, 2 * cap);
+		if (!ws_fits(n * BLOB_BYTES)) return;
+		blob.reserve(n);
+	}
+	blob.push_back(val);
+}
+
+double Yun::bytes_per_pixel() const
+{
+	// orientation map, plus magnitude unless it is computed on demand
+	const double maps = pam.lazyMagnitude ? 1.0 : 2.0;
+
+	// the maps of the labelling are released before the cascade builds its
+	// edge integral, one row and column larger (tiles are at least 64 px a side)
+	const double cascade = pam.useCascade ? sizeof(int) * (1.0 + 2.0 / 64) : 0.0;
+	double labelling;
+
+	if (pam.blockGrid)
+	{
+		// per block: orientation histogram, saliency and smoothed cell, mask,
+		// dominant bin and flood fill stack of ccl_grid
+		labelling = (NUM_ANG * sizeof(int) + 4.0 + 2 * sizeof(cv::Point)) / ((double)pam.localBlockSz * pam.localBlockSz);
+	}
+	else
+	{
+		// saliency, integral and smoothed maps
+		labelling = 1.0 + sizeof(int) + 1.0;
+
+		// packed foreground (its runs are counted as they are found), or mask
+		// and flood fill stacks
+		if (pam.useSpecialized) labelling += 1.0 / 8;
+		else labelling += 1.0 + 2 * sizeof(int);
+	}
+
+	return maps + std::max(labelling, cascade);
+}
+
+// the fallback of calc_box, the roi as it is
+static bool is_upright(const cv::RotatedRect &box, const cv::Rect &roi)
+{
+	return box.angle == 0 && box.size.width == (float)roi.width && box.size.height == (float)roi.height;
+}
+
+// smallest box at the angle of a that holds a and b
+static cv::RotatedRect join_boxes(const cv::RotatedRect &a, const cv::RotatedRect &b)
+{
+	const double theta = a.angle * CV_PI / 180.0;
+	const double cu = std::cos(theta), su = std::sin(theta);
+
+	cv::Point2f pts[8];
+	a.points(pts);
+	b.points(pts + 4);
+
+	double lo[2] = { DBL_MAX, DBL_MAX }, hi[2] = { -DBL_MAX, -DBL_MAX };
+	for (int k = 0; k < 8; k++)
+	{
+		const double u = pts[k].x * cu + pts[k].y * su;
+		const double v = -pts[k].x * su + pts[k].y * cu;
+		lo[0] = std::min(lo[0], u); hi[0] = std::max(hi[0], u);
+		lo[1] = std::min(lo[1], v); hi[1] = std::max(hi[1], v);
+	}
+
+	const double mu = 0.5 * (lo[0] + hi[0]), mv = 0.5 * (lo[1] + hi[1]);
+	return cv::RotatedRect(cv::Point2f((float)(mu * cu - mv * su), (float)(mu * su + mv * cu)),
+		cv::Size2f((float)(hi[0] - lo[0]), (float)(hi[1] - lo[1])), a.angle);
+}
+
+// tile origins along one axis, the last tile flush with the image border
+static std::vector<int> tile_starts(int len, int tile, int overlap)
+{
+	std::vector<int> starts(1, 0);
+	while (starts.back() + tile < len)
+		starts.push_back(std::min(starts.back() + tile - overlap, len - tile));
+	return starts;
+}
+
+std::vector<YunCandidate> Yun::process_tiled(cv::Mat &gray_src, YunTileParams tpam)
+{
+	std::vector<YunCandidate> result;
+
+	const cv::Size imSz = gray_src.size();
+	const double bpp = bytes_per_pixel();
+
+	// a tile has to hold a barcode next to the overlap shared with each neighbour
+	const int minSide = 2 * tpam.overlap + 64;
+
+	// fewer tiles in flight until each one gets a usable share of the budget:
+	// its maps, the detector and its small buffers, and room for content
+	int nConc = tpam.nThreads;
+	if (nConc <= 0) nConc = tpam.pool ? tpam.pool->size() : std::max(1, (int)std::thread::hardware_concurrency());
+	double area = 0;
+	for (; nConc > 0; nConc--)
+	{
+		const double share = (double)tpam.maxBytes / nConc - TILE_SLACK;
+		area = share / (bpp + TILE_CONTENT_BPP);
+		if (area >= (double)minSide * minSide) break;
+	}
+
+	if (nConc == 0)
+	{
+		std::cerr << "Yun::process_tiled: " << tpam.maxBytes << " bytes can not hold a "
+			<< minSide << "x" << minSide << " tile" << std::endl;
+		return result;
+	}
+
+	// as wide as the image allows, then as tall as the area allows
+	const int tw = std::min(imSz.width, (int)std::sqrt(area));
+	const int th = std::min(imSz.height, (int)(area / tw));
+	const size_t fixed = (size_t)(bpp * tw * th) + TILE_SLACK;
+
+	std::vector<cv::Rect> tiles;
+	std::vector<int> xs = tile_starts(imSz.width, tw, tpam.overlap);
+	std::vector<int> ys = tile_starts(imSz.height, th, tpam.overlap);
+	for (size_t y = 0; y < ys.size(); y++)
+		for (size_t x = 0; x < xs.size(); x++)
+			tiles.push_back(cv::Rect(xs[x], ys[y], tw, th));
+
+	nConc = std::min(nConc, (int)tiles.size());
+
+	// tiles are views into the source, every thread keeps its own detector,
+	// capped at what its share leaves next to the maps
+	std::vector<std::vector<YunCandidate> > found(tiles.size());
+	std::vector<char> isOver(tiles.size(), 0);
+
+	auto run_tile = [&](Yun &yun, int i)
+	{
+		cv::Mat tile = gray_src(tiles[i]);
+		yun.isOverCap = false;
+		found[i] = yun.process(tile);
+		isOver[i] = yun.isOverCap;
+
+		const cv::Point tl = tiles[i].tl();
+		for (std::vector<YunCandidate>::iterator it = found[i].begin(); it < found[i].end(); it++)
+		{
+			it->roi.x += tl.x;
+			it->roi.y += tl.y;
+			it->first_pt += tl;
+			it->last_pt += tl;
+			it->box.center += cv::Point2f((float)tl.x, (float)tl.y);
+		}
+	};
+
+	if (tpam.pool)
+	{
+		// detectors made by the worker that uses them, so their maps live on its node
+		std::vector<std::unique_ptr<Yun> > yuns(tpam.pool->size());
+		tpam.pool->parallel_for(tiles.size(), [&](int w, size_t i) {
+			if (!yuns[w])
+			{
+				yuns[w].reset(new Yun(*this));
+				yuns[w]->wsCap = tpam.maxBytes / nConc - fixed;
+			}
+			run_tile(*yuns[w], (int)i);
+		}, nConc);
+	}
+	else
+	{
+		std::atomic<int> next(0);
+		auto worker = [&]()
+		{
+			Yun yun = *this;
+			yun.wsCap = tpam.maxBytes / nConc - fixed;
+			for (int i = next++; i < (int)tiles.size(); i = next++) run_tile(yun, i);
+		};
+
+		std::vector<std::thread> pool;
+		for (int t = 1; t < nConc; t++) pool.push_back(std::thread(worker));
+		worker();
+		for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+	}
+
+	// a busy tile that outgrew its share runs again alone, with the budget
+	// of all tiles; one that does not fit that either ends the call
+	for (size_t i = 0; i < tiles.size(); i++)
+	{
+		if (!isOver[i]) continue;
+
+		if (nConc > 1)
+		{
+			Yun yun = *this;
+			yun.wsCap = tpam.maxBytes - fixed;
+			run_tile(yun, (int)i);
+		}
+		if (isOver[i])
+		{
+			std::cerr << "Yun::process_tiled: " << tpam.maxBytes << " bytes can not hold the labelling of tile "
+				<< tiles[i].x << "," << tiles[i].y << " " << tw << "x" << th << std::endl;
+			return result;
+		}
+	}
+
+	// a barcode on a seam is found by both neighbours; join overlapping boxes until none are left
+	for (size_t i = 0; i < found.size(); i++)
+		result.insert(result.end(), found[i].begin(), found[i].end());
+
+	// boxes of joined candidates under the same cap, with the source only
+	struct Restore { size_t &dst; size_t val; ~Restore() { dst = val; } } restore = { wsCap, wsCap };
+	wsCap = ws_held() + tpam.maxBytes - TILE_SLACK;
+
+	bool isMerged = true;
+	while (isMerged)
+	{
+		isMerged = false;
+		for (size_t i = 0; i < result.size() && !isMerged; i++)
+		{
+			for (size_t j = i + 1; j < result.size(); j++)
+			{
+				if ((result[i].roi & result[j].roi).area() == 0) continue;
+
+				// too few edges at the orientation for a box of the union: the box
+				// of the larger part stretched over the other keeps its angle
+				const bool isFirst = result[i].box.size.area() >= result[j].box.size.area();
+				const cv::RotatedRect parts[2] = { isFirst ? result[i].box : result[j].box, isFirst ? result[j].box : result[i].box };
+
+				result[i].roi |= result[j].roi;
+				result[i].score = std::max(result[i].score, result[j].score);
+				result[i].box = calc_box(gray_src, result[i].roi, result[i].orientation);
+				if (pam.orientedBox && is_upright(result[i].box, result[i].roi)) result[i].box = join_boxes(parts[0], parts[1]);
+				result.erase(result.begin() + j);
+				isMerged = true;
+				break;
+			}
+		}
+	}
+
 	return result;
 }
 
@@ -57,12 +430,15 @@ cv::Mat Yun::calc_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrient
 {
 	const cv::Size imSz = src.size();
 	const int ExtAng = 2 * NUM_ANG;
+	const bool isStoreMag = !mMap.empty();
 
-	cv::Mat oMap(imSz, CV_8UC1);
+	cv::Mat oMap(imSz, CV_8UC1, cv::Scalar(255));
 
 	Vmap.resize(NUM_ANG);
 	for (int i = 0; i < NUM_ANG; i++) Vmap[i].cnt = 0;
 
+	int nEdge = 0;
+
 	for (int h = 1; h < imSz.height - 1; h++)
 	{
 		for (int w = 1; w < imSz.width - 1; w++)
@@ -74,7 +450,7 @@ cv::Mat Yun::calc_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrient
 				(double)src.at<uchar>(h + 1, w - 1) - 2.0 * (double)src.at<uchar>(h + 1, w) - (double)src.at<uchar>(h + 1, w + 1);
 
 			int intensity = std::sqrt(dx*dx + dy*dy);
-			mMap.at<uchar>(h, w) = intensity > 255 ? 255 : intensity;
+			if (isStoreMag) mMap.at<uchar>(h, w) = intensity > 255 ? 255 : intensity;
 
 			if (intensity > pam.magT)
 			{
@@ -96,301 +472,1824 @@ cv::Mat Yun::calc_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrient
 				else if (bin < 14)       bin = 12;
 				else                     bin = 15;
 
-				// save
-				oMap.at<uchar>(h, w) = bin;
-				Vmap[bin].cnt++;
-			}
-			else
-			{
-				oMap.at<uchar>(h, w) = 255;
-			}
+				// save
+				oMap.at<uchar>(h, w) = bin;
+				Vmap[bin].cnt++;
+				nEdge++;
+			}
+			else
+			{
+				oMap.at<uchar>(h, w) = 255;
+			}
+		}
+	}
+
+	// check orientation
+	calc_strong(Vmap, nEdge);
+
+	return oMap;
+}
+
+// calc_orientation on every stride-th pixel of src, no resized copy: cell (i, j)
+// is the sobel response at (j * stride + stride / 2, i * stride + stride / 2)
+// with taps stride / 2 apart, so every edge falls into the span of one cell.
+// The magnitude map only tells edges (255) from the rest (0), all that the
+// ray walk of sub_candidate reads.
+cv::Mat Yun::calc_orientation_stride(cv::Mat &src, int stride, cv::Mat &mMap, std::vector<YunOrientation> &Vmap)
+{
+	const cv::Size imSz(src.cols / stride, src.rows / stride);
+	const int off = stride / 2;
+	const int r = std::max(1, stride / 2);
+	const int magT2 = (pam.magT + 1) * (pam.magT + 1);
+
+	cv::Mat oMap(imSz, CV_8UC1, cv::Scalar(255));
+	mMap = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+
+	// the folded bins of calc_orientation cover [30k - 10, 30k + 20) degree
+	// (mod 180), found by the side of the gradient to each bin border
+	// instead of atan2
+	float bx[6], by[6];
+	for (int k = 0; k < 6; k++)
+	{
+		const double beta = (20.0 + 30.0 * k) * CV_PI / 180.0;
+		bx[k] = (float)std::cos(beta);
+		by[k] = (float)std::sin(beta);
+	}
+
+	int cnt[NUM_ANG] = { 0 };
+	for (int h = 0; h < imSz.height; h++)
+	{
+		const int y = h * stride + off;
+		if (y - r < 0 || y + r >= src.rows) continue;
+
+		const uchar *p0 = src.ptr<uchar>(y - r);
+		const uchar *p1 = src.ptr<uchar>(y);
+		const uchar *p2 = src.ptr<uchar>(y + r);
+		uchar *mRow = mMap.ptr<uchar>(h);
+		uchar *oRow = oMap.ptr<uchar>(h);
+
+		for (int w = 0; w < imSz.width; w++)
+		{
+			const int x = w * stride + off;
+			if (x - r < 0 || x + r >= src.cols) continue;
+
+			int dx = p0[x - r] + 2 * p1[x - r] + p2[x - r] - p0[x + r] - 2 * p1[x + r] - p2[x + r];
+			int dy = p0[x - r] + 2 * p0[x] + p0[x + r] - p2[x - r] - 2 * p2[x] - p2[x + r];
+			if (dx * dx + dy * dy < magT2) continue;
+
+			// gradient in [0, 180) degree
+			if (dy < 0 || (dy == 0 && dx < 0)) { dx = -dx; dy = -dy; }
+
+			int k = 0;
+			for (int b = 0; b < 6; b++) k += (bx[b] * dy - by[b] * dx >= 0);
+
+			const int bin = (k % 6) * 3;
+			mRow[w] = 255;
+			oRow[w] = bin;
+			cnt[bin]++;
+		}
+	}
+
+	int nEdge = 0;
+	Vmap.resize(NUM_ANG);
+	for (int i = 0; i < NUM_ANG; i++)
+	{
+		Vmap[i].cnt = cnt[i];
+		nEdge += cnt[i];
+	}
+
+	calc_strong(Vmap, nEdge);
+
+	return oMap;
+}
+
+void Yun::calc_strong(std::vector<YunOrientation> &Vmap, int nEdge)
+{
+	// share of the edge pixels instead of an absolute count, so the
+	// test behaves the same on VGA and on multi-megapixel frames
+	const double strongT = pam.minStrongRatio * nEdge;
+	for (size_t i = 0; i < Vmap.size(); i++)
+	{
+		if (Vmap[i].cnt > 0 && Vmap[i].cnt >= strongT)
+		{
+			Vmap[i].isStrong = true;
+		}
+		else Vmap[i].isStrong = false;
+	}
+}
+
+cv::Mat Yun::calc_saliency(cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz)
+{
+	const cv::Size imSz = src.size();
+
+	cv::Mat sMap(imSz, CV_8UC1); sMap.setTo(0);
+	const int nMax = lbSz * lbSz * NUM_ANG;
+	const int cBlock = (lbSz / 2) + 1;
+
+	for (int h = cBlock; h < imSz.height - cBlock; h += lbSz)
+	{
+		for (int w = cBlock; w < imSz.width - cBlock; w += lbSz)
+		{
+			// step 1 local block histogram (orientation)
+			int LocalHisto[NUM_ANG] = { 0 };
+			for (int y = h - cBlock; y <= h + cBlock; y++)
+			{
+				if (y < 0 || y >= imSz.height) continue;
+				for (int x = w - cBlock; x <= w + cBlock; x++)
+				{
+					if (x < 0 || x >= imSz.width) continue;
+
+					uchar bin = src.at<uchar>(y, x);
+					if (bin >= NUM_ANG) continue;
+
+					LocalHisto[bin]++;
+				}
+			}
+
+			// step 2 find max values
+			int max_val = 0;
+			for (int i = 0; i < NUM_ANG; i++)
+			{
+				if (LocalHisto[i] > max_val)
+					max_val = LocalHisto[i];
+			}
+
+			// step 3 entropy
+			double pim = 0;
+			for (int i = 0; i < NUM_ANG; i++)
+			{
+				pim += std::abs(LocalHisto[i] - max_val);
+			}
+
+			// step 4 check max value
+			if (max_val == 0) continue;
+
+			// step 5 normalization
+			double npim = pim / nMax;
+			uchar ramp_npim = (npim * 255) > 255 ? 255 : (npim * 255);
+
+			if (npim < 0.6) ramp_npim = 0;
+
+			// step 6 set block
+			for (int y = h - cBlock; y <= h + cBlock; y++)
+			{
+				if (y < 0 || y >= imSz.height) continue;
+				for (int x = w - cBlock; x <= w + cBlock; x++)
+				{
+					if (x < 0 || x >= imSz.width) continue;
+					sMap.at<uchar>(y, x) = ramp_npim;
+				}
+			}
+		}
+	}
+
+	return sMap;
+}
+
+cv::Mat Yun::calc_integral_image(cv::Mat &src)
+{
+	//assert(src.channels() == 1);
+
+	// 32 bit sums that may wrap around: a box sum taken from them is exact
+	// (it is far below 2^32), float sums were not once they passed 2^24
+	const cv::Size imSz = src.size();
+	cv::Mat result(imSz, CV_32SC1);
+
+	// -1st cols
+	uint32_t sum = 0;
+	for (int w = 0; w < imSz.width; w++)
+	{
+		sum += src.at<uchar>(0, w);
+		result.at<int>(0, w) = (int)sum;
+	}
+
+	// -other cols
+	for (int h = 1; h < imSz.height; h++)
+	{
+		sum = 0;
+		for (int w = 0; w < imSz.width; w++)
+		{
+			sum += src.at<uchar>(h, w);
+			result.at<int>(h, w) = (int)((uint32_t)result.at<int>(h - 1, w) + sum);
+		}
+	}
+
+	return result;
+}
+
+// calc_integral_image on row pointers
+cv::Mat Yun::calc_integral_rows(cv::Mat &src)
+{
+	const cv::Size imSz = src.size();
+	cv::Mat result(imSz, CV_32SC1);
+
+	for (int h = 0; h < imSz.height; h++)
+	{
+		const uchar *sRow = src.ptr<uchar>(h);
+		const uint32_t *prev = (h > 0) ? (const uint32_t *)result.ptr<int>(h - 1) : NULL;
+		uint32_t *row = (uint32_t *)result.ptr<int>(h);
+
+		uint32_t sum = 0;
+		for (int w = 0; w < imSz.width; w++)
+		{
+			sum += sRow[w];
+			row[w] = (prev ? prev[w] : 0) + sum;
+		}
+	}
+
+	return result;
+}
+
+cv::Mat Yun::calc_smooth(cv::Mat &src, int WinSz, int *hist)
+{
+	const cv::Size imSz = src.size();
+
+	const int nSize = WinSz * WinSz;
+	const int cSize = (WinSz / 2) + 1;
+	const int max_height = imSz.height - cSize;
+	const int max_width = imSz.width - cSize;
+
+	cv::Mat smooth_map(imSz, CV_8UC1);
+
+	for (int h = 0; h < imSz.height; h++)
+	{
+		int temp_top = h - cSize;
+		int ntop = (temp_top > max_height) ? max_height : temp_top;
+		int temp_bottom = h + cSize;
+		int nbottom = (temp_bottom >= imSz.height - 1) ? imSz.height - 1 : temp_bottom;
+
+		for (int w = 0; w < imSz.width; w++)
+		{
+			int temp_left = w - cSize;
+			int nleft = (temp_left > max_width) ? max_width : temp_left;
+			int temp_right = w + cSize;
+			int nright = (temp_right >= imSz.width - 1) ? imSz.width - 1 : temp_right;
+
+			// local mean
+			uint32_t n1 = (nleft > 0 && ntop > 0) ? src.at<int>(ntop, nleft - 1) : 0;
+			uint32_t n2 = (nleft > 0) ? src.at<int>(nbottom, nleft - 1) : 0;
+			uint32_t n3 = (ntop > 0) ? src.at<int>(ntop, nright) : 0;
+
+			uint32_t sum = (uint32_t)src.at<int>(nbottom, nright) - n3 - n2 + n1;
+			float mean = (float)sum / nSize;
+
+			uchar val = (mean > 255) ? 255 : mean;
+			smooth_map.at<uchar>(h, w) = val;
+			hist[val]++;
+		}
+	}
+
+	return smooth_map;
+}
+
+template<int NBins, bool StoreMag>
+cv::Mat Yun::calc_orientation_t(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap)
+{
+	const cv::Size imSz = src.size();
+
+	cv::Mat oMap(imSz, CV_8UC1, cv::Scalar(255));
+
+	int cnt[NBins] = { 0 };
+	if (imSz.width > 2 && imSz.height > 2)
+		calc_orientation_area_t<NBins, StoreMag>(src, mMap, oMap, cv::Rect(1, 1, imSz.width - 2, imSz.height - 2), cnt);
+
+	int nEdge = 0;
+	Vmap.resize(NBins);
+	for (int i = 0; i < NBins; i++)
+	{
+		Vmap[i].cnt = cnt[i];
+		nEdge += cnt[i];
+	}
+
+	calc_strong(Vmap, nEdge);
+
+	return oMap;
+}
+
+// orientation of the pixels in area (inside the 1 pixel border), edge pixels added to cnt;
+// non-edge pixels of oMap are left as they are
+template<int NBins, bool StoreMag>
+void Yun::calc_orientation_area_t(cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap, cv::Rect area, int *cnt)
+{
+	static_assert(NBins % 3 == 0, "bins are folded in groups of three");
+
+	const int ExtAng = 2 * NBins;
+
+	// intensity > magT  <=>  dx*dx + dy*dy >= (magT + 1)^2 for integer gradients
+	const int magT2 = (pam.magT + 1) * (pam.magT + 1);
+
+	// bin folding of calc_orientation as a table: 360 -> 180 degree, then
+	// every bin joins the nearest multiple of three (0, 3, 6, ...)
+	int fold[ExtAng];
+	for (int i = 0; i < ExtAng; i++)
+	{
+		int bin = (i >= NBins) ? i - NBins : i;
+		fold[i] = ((bin + 1) / 3 * 3) % NBins;
+	}
+
+	for (int h = area.y; h < area.y + area.height; h++)
+	{
+		const uchar *p0 = src.ptr<uchar>(h - 1);
+		const uchar *p1 = src.ptr<uchar>(h);
+		const uchar *p2 = src.ptr<uchar>(h + 1);
+		uchar *mRow = StoreMag ? mMap.ptr<uchar>(h) : NULL;
+		uchar *oRow = oMap.ptr<uchar>(h);
+
+		for (int w = area.x; w < area.x + area.width; w++)
+		{
+			int dx = p0[w - 1] + 2 * p1[w - 1] + p2[w - 1] - p0[w + 1] - 2 * p1[w + 1] - p2[w + 1];
+			int dy = p0[w - 1] + 2 * p0[w] + p0[w + 1] - p2[w - 1] - 2 * p2[w] - p2[w + 1];
+			int mag2 = dx * dx + dy * dy;
+
+			if (StoreMag)
+			{
+				int intensity = std::sqrt((double)mag2);
+				mRow[w] = intensity > 255 ? 255 : intensity;
+			}
+
+			if (mag2 >= magT2)
+			{
+				double degree = (double)(std::atan2((double)dy, (double)dx) + CV_PI) * 180.0 / CV_PI; // 0~360;
+
+				int bin = ExtAng * (degree / 360.0);
+				if (bin < 0) bin = 0;
+				else if (bin >= ExtAng) bin = ExtAng - 1;
+
+				bin = fold[bin];
+				oRow[w] = bin;
+				cnt[bin]++;
+			}
+		}
+	}
+}
+
+// saliency of the block centred on (h, w), -1 if it holds no oriented pixel
+template<int NBins, int LbSz>
+static inline int saliency_block(cv::Mat &src, int h, int w)
+{
+	const int nMax = LbSz * LbSz * NBins;
+	const int cBlock = (LbSz / 2) + 1;
+	const int span = 2 * cBlock + 1;
+
+	// step 1 local block histogram (orientation)
+	int LocalHisto[NBins] = { 0 };
+	for (int y = 0; y < span; y++)
+	{
+		const uchar *row = src.ptr<uchar>(h - cBlock + y) + (w - cBlock);
+		for (int x = 0; x < span; x++)
+		{
+			uchar bin = row[x];
+			if (bin < NBins) LocalHisto[bin]++;
+		}
+	}
+
+	// step 2 find max values
+	int max_val = 0;
+	for (int i = 0; i < NBins; i++)
+		max_val = LocalHisto[i] > max_val ? LocalHisto[i] : max_val;
+
+	// step 4 check max value
+	if (max_val == 0) return -1;
+
+	// step 3 entropy
+	int pim = 0;
+	for (int i = 0; i < NBins; i++)
+		pim += max_val - LocalHisto[i];
+
+	// step 5 normalization
+	double npim = (double)pim / nMax;
+	uchar ramp_npim = (npim * 255) > 255 ? 255 : (npim * 255);
+
+	if (npim < 0.6) ramp_npim = 0;
+
+	return ramp_npim;
+}
+
+template<int NBins, int LbSz>
+cv::Mat Yun::calc_saliency_t(cv::Mat &src)
+{
+	const cv::Size imSz = src.size();
+
+	cv::Mat sMap(imSz, CV_8UC1); sMap.setTo(0);
+	const int cBlock = (LbSz / 2) + 1;
+	const int span = 2 * cBlock + 1;
+
+	// the block loop keeps [h - cBlock, h + cBlock] inside the image,
+	// so the border checks of calc_saliency are dropped here
+	for (int h = cBlock; h < imSz.height - cBlock; h += LbSz)
+	{
+		for (int w = cBlock; w < imSz.width - cBlock; w += LbSz)
+		{
+			int val = saliency_block<NBins, LbSz>(src, h, w);
+			if (val < 0) continue;
+
+			// step 6 set block
+			for (int y = 0; y < span; y++)
+				memset(sMap.ptr<uchar>(h - cBlock + y) + (w - cBlock), val, span);
+		}
+	}
+
+	return sMap;
+}
+
+template<int WinSz>
+cv::Mat Yun::calc_smooth_t(cv::Mat &src, int *hist)
+{
+	const cv::Size imSz = src.size();
+
+	const int nSize = WinSz * WinSz;
+	const int cSize = (WinSz / 2) + 1;
+
+	// columns whose window is not clamped by the image border
+	const int wBegin = std::min(cSize + 1, imSz.width);
+	const int wEnd = std::max(wBegin, imSz.width - cSize);
+
+	cv::Mat smooth_map(imSz, CV_8UC1);
+
+	// row stripes in parallel, one histogram per stripe merged at the end
+	const int nStripes = std::max(1, std::min(cv::getNumThreads(), imSz.height));
+	std::vector<int> stripe_hist(nStripes * 256, 0);
+
+	cv::parallel_for_(cv::Range(0, nStripes), [&](const cv::Range &range)
+	{
+		for (int s = range.start; s < range.end; s++)
+		{
+			int *sHist = &stripe_hist[s * 256];
+
+			for (int h = imSz.height * s / nStripes; h < imSz.height * (s + 1) / nStripes; h++)
+			{
+				int ntop = h - cSize;
+				int temp_bottom = h + cSize;
+				int nbottom = (temp_bottom >= imSz.height - 1) ? imSz.height - 1 : temp_bottom;
+
+				const uint32_t *rB = (const uint32_t *)src.ptr<int>(nbottom);
+				const uint32_t *rT = (ntop > 0) ? (const uint32_t *)src.ptr<int>(ntop) : NULL;
+				uchar *dst = smooth_map.ptr<uchar>(h);
+
+				// border columns, same clamping as calc_smooth
+				for (int w = 0; w < imSz.width; w = (w + 1 == wBegin) ? wEnd : w + 1)
+				{
+					int nleft = w - cSize;
+					int temp_right = w + cSize;
+					int nright = (temp_right >= imSz.width - 1) ? imSz.width - 1 : temp_right;
+
+					uint32_t n1 = (nleft > 0 && rT) ? rT[nleft - 1] : 0;
+					uint32_t n2 = (nleft > 0) ? rB[nleft - 1] : 0;
+					uint32_t n3 = rT ? rT[nright] : 0;
+
+					float mean = (float)(rB[nright] - n3 - n2 + n1) / nSize;
+					dst[w] = (mean > 255) ? 255 : mean;
+				}
+
+				// inner columns
+				if (rT)
+				{
+					for (int w = wBegin; w < wEnd; w++)
+					{
+						float mean = (float)(rB[w + cSize] - rT[w + cSize] - rB[w - cSize - 1] + rT[w - cSize - 1]) / nSize;
+						dst[w] = (mean > 255) ? 255 : mean;
+					}
+				}
+				else
+				{
+					for (int w = wBegin; w < wEnd; w++)
+					{
+						float mean = (float)(rB[w + cSize] - rB[w - cSize - 1]) / nSize;
+						dst[w] = (mean > 255) ? 255 : mean;
+					}
+				}
+
+				for (int w = 0; w < imSz.width; w++) sHist[dst[w]]++;
+			}
+		}
+	});
+
+	for (int s = 0; s < nStripes; s++)
+	{
+		for (int i = 0; i < 256; i++) hist[i] += stripe_hist[s * 256 + i];
+	}
+
+	return smooth_map;
+}
+
+int Yun::select_variant(int k) const
+{
+	return pam.useSpecialized ? KernelRegistry::get().selected(k) : IY_VARIANT_REFERENCE;
+}
+
+cv::Mat Yun::run_orientation(int v, cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap)
+{
+	KernelTick t0 = KernelRegistry::get().tick();
+
+	cv::Mat oMap;
+	if (v == IY_VARIANT_REFERENCE) oMap = calc_orientation(src, mMap, Vmap);
+	else if (mMap.empty()) oMap = calc_orientation_t<NUM_ANG, false>(src, mMap, Vmap);
+	else oMap = calc_orientation_t<NUM_ANG, true>(src, mMap, Vmap);
+
+	KernelRegistry::get().record(IY_KERNEL_ORIENTATION, v, t0, src.total());
+	return oMap;
+}
+
+cv::Mat Yun::dispatch_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap)
+{
+	const int v = select_variant(IY_KERNEL_ORIENTATION);
+	cv::Mat oMap = run_orientation(v, src, mMap, Vmap);
+
+	KernelRegistry &reg = KernelRegistry::get();
+	if (!reg.verify()) return oMap;
+
+	// the other variant on maps of its own
+	cv::Mat mOther = mMap.empty() ? cv::Mat() : cv::Mat(mMap.size(), CV_8UC1, cv::Scalar(0));
+	std::vector<YunOrientation> vOther;
+	cv::Mat oOther = run_orientation(KernelRegistry::other(v), src, mOther, vOther);
+
+	std::string where = diff_maps(oMap, oOther, "orientation");
+	if (where.empty()) where = diff_maps(mMap, mOther, "magnitude");
+	for (int i = 0; where.empty() && i < NUM_ANG; i++)
+	{
+		if (Vmap[i].cnt != vOther[i].cnt || Vmap[i].isStrong != vOther[i].isStrong)
+			where = "votes of bin " + std::to_string(i) + ": " + std::to_string(Vmap[i].cnt) + " vs " + std::to_string(vOther[i].cnt);
+	}
+	reg.verified(IY_KERNEL_ORIENTATION, where);
+
+	return oMap;
+}
+
+cv::Mat Yun::run_saliency(int v, cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz)
+{
+	KernelTick t0 = KernelRegistry::get().tick();
+
+	cv::Mat eMap;
+	if (v == IY_VARIANT_OPTIMIZED && lbSz == 3) eMap = calc_saliency_t<NUM_ANG, 3>(src);
+	else if (v == IY_VARIANT_OPTIMIZED && lbSz == 7) eMap = calc_saliency_t<NUM_ANG, 7>(src);
+	else if (v == IY_VARIANT_OPTIMIZED && lbSz == 11) eMap = calc_saliency_t<NUM_ANG, 11>(src);
+	else if (v == IY_VARIANT_OPTIMIZED && lbSz == 15) eMap = calc_saliency_t<NUM_ANG, 15>(src);
+	else if (v == IY_VARIANT_OPTIMIZED && lbSz == 21) eMap = calc_saliency_t<NUM_ANG, 21>(src);
+	else
+	{
+		v = IY_VARIANT_REFERENCE;
+		eMap = calc_saliency(src, Vmap, lbSz);
+	}
+
+	KernelRegistry::get().record(IY_KERNEL_SALIENCY, v, t0, src.total());
+	return eMap;
+}
+
+cv::Mat Yun::dispatch_saliency(cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz)
+{
+	const int v = select_variant(IY_KERNEL_SALIENCY);
+	cv::Mat eMap = run_saliency(v, src, Vmap, lbSz);
+
+	// nothing to compare with if no specialized kernel is instantiated for lbSz
+	KernelRegistry &reg = KernelRegistry::get();
+	if (!reg.verify() || (lbSz != 3 && lbSz != 7 && lbSz != 11 && lbSz != 15 && lbSz != 21)) return eMap;
+
+	cv::Mat eOther = run_saliency(KernelRegistry::other(v), src, Vmap, lbSz);
+	reg.verified(IY_KERNEL_SALIENCY, diff_maps(eMap, eOther, "saliency"));
+
+	return eMap;
+}
+
+cv::Mat Yun::run_integral(int v, cv::Mat &src)
+{
+	KernelTick t0 = KernelRegistry::get().tick();
+
+	cv::Mat iMap = (v == IY_VARIANT_REFERENCE) ? calc_integral_image(src) : calc_integral_rows(src);
+
+	KernelRegistry::get().record(IY_KERNEL_INTEGRAL, v, t0, src.total());
+	return iMap;
+}
+
+cv::Mat Yun::dispatch_integral(cv::Mat &src)
+{
+	const int v = select_variant(IY_KERNEL_INTEGRAL);
+	cv::Mat iMap = run_integral(v, src);
+
+	KernelRegistry &reg = KernelRegistry::get();
+	if (!reg.verify()) return iMap;
+
+	cv::Mat iOther = run_integral(KernelRegistry::other(v), src);
+	reg.verified(IY_KERNEL_INTEGRAL, diff_maps(iMap, iOther, "integral"));
+
+	return iMap;
+}
+
+cv::Mat Yun::run_smooth(int v, cv::Mat &src, int WinSz, int *hist)
+{
+	KernelTick t0 = KernelRegistry::get().tick();
+
+	cv::Mat sMap;
+	if (v == IY_VARIANT_OPTIMIZED && WinSz == 7) sMap = calc_smooth_t<7>(src, hist);
+	else if (v == IY_VARIANT_OPTIMIZED && WinSz == 13) sMap = calc_smooth_t<13>(src, hist);
+	else if (v == IY_VARIANT_OPTIMIZED && WinSz == 15) sMap = calc_smooth_t<15>(src, hist);
+	else if (v == IY_VARIANT_OPTIMIZED && WinSz == 25) sMap = calc_smooth_t<25>(src, hist);
+	else if (v == IY_VARIANT_OPTIMIZED && WinSz == 35) sMap = calc_smooth_t<35>(src, hist);
+	else
+	{
+		v = IY_VARIANT_REFERENCE;
+		sMap = calc_smooth(src, WinSz, hist);
+	}
+
+	KernelRegistry::get().record(IY_KERNEL_SMOOTH, v, t0, src.total());
+	return sMap;
+}
+
+cv::Mat Yun::dispatch_smooth(cv::Mat &src, int WinSz, int *hist)
+{
+	const int v = select_variant(IY_KERNEL_SMOOTH);
+
+	KernelRegistry &reg = KernelRegistry::get();
+	if (!reg.verify() || (WinSz != 7 && WinSz != 13 && WinSz != 15 && WinSz != 25 && WinSz != 35)) return run_smooth(v, src, WinSz, hist);
+
+	// histograms of their own, the selected one is added to hist
+	int hSel[256] = { 0 }, hOther[256] = { 0 };
+	cv::Mat sMap = run_smooth(v, src, WinSz, hSel);
+	cv::Mat sOther = run_smooth(KernelRegistry::other(v), src, WinSz, hOther);
+
+	std::string where = diff_maps(sMap, sOther, "smooth");
+	for (int i = 0; where.empty() && i < 256; i++)
+	{
+		if (hSel[i] != hOther[i])
+			where = "histogram bin " + std::to_string(i) + ": " + std::to_string(hSel[i]) + " vs " + std::to_string(hOther[i]);
+	}
+	reg.verified(IY_KERNEL_SMOOTH, where);
+
+	for (int i = 0; i < 256; i++) hist[i] += hSel[i];
+	return sMap;
+}
+
+void Yun::run_ccl(int v, cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &blob)
+{
+	KernelTick t0 = KernelRegistry::get().tick();
+
+	if (v == IY_VARIANT_REFERENCE) ccl(src, thr, oMap, Vmap, blob);
+	else
+	{
+		YunBitmap bMap;
+		calc_binary_packed(src, thr, oMap, bMap);
+		ccl_packed(src, thr, bMap, oMap, Vmap, blob);
+	}
+
+	KernelRegistry::get().record(IY_KERNEL_CCL, v, t0, src.total());
+}
+
+static bool blob_less(const YunLabel &a, const YunLabel &b)
+{
+	if (a.roi.y != b.roi.y) return a.roi.y < b.roi.y;
+	if (a.roi.x != b.roi.x) return a.roi.x < b.roi.x;
+	if (a.roi.width != b.roi.width) return a.roi.width < b.roi.width;
+	return a.roi.height < b.roi.height;
+}
+
+static void put_blob(std::ostringstream &os, const std::vector<YunLabel> &list, size_t i)
+{
+	if (i >= list.size())
+	{
+		os << "none";
+		return;
+	}
+
+	const YunLabel &val = list[i];
+	os << val.roi.width << "x" << val.roi.height << " at (" << val.roi.x << ", " << val.roi.y << ") bin "
+		<< val.max_orientation << " votes " << val.cnt;
+}
+
+// first blob that is not in both lists (the labellers find them in different orders)
+static std::string diff_blobs(std::vector<YunLabel> a, std::vector<YunLabel> b)
+{
+	std::sort(a.begin(), a.end(), blob_less);
+	std::sort(b.begin(), b.end(), blob_less);
+
+	for (size_t i = 0; i < std::max(a.size(), b.size()); i++)
+	{
+		const bool isSame = i < a.size() && i < b.size() && a[i].roi == b[i].roi && a[i].max_orientation == b[i].max_orientation
+			&& a[i].cnt == b[i].cnt && a[i].nEdge == b[i].nEdge && a[i].nNear == b[i].nNear;
+		if (isSame) continue;
+
+		std::ostringstream os;
+		os << "blob " << i << " of " << a.size() << " vs " << b.size() << ": ";
+		put_blob(os, a, i);
+		os << " vs ";
+		put_blob(os, b, i);
+		return os.str();
+	}
+
+	return std::string();
+}
+
+void Yun::dispatch_ccl(cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &blob)
+{
+	const int v = select_variant(IY_KERNEL_CCL);
+	run_ccl(v, src, thr, oMap, Vmap, blob);
+
+	// a labelling cut by the deadline is not comparable
+	KernelRegistry &reg = KernelRegistry::get();
+	if (!reg.verify() || isCut) return;
+
+	YunBlobs bOther;
+	run_ccl(KernelRegistry::other(v), src, thr, oMap, Vmap, bOther);
+	if (!isCut) reg.verified(IY_KERNEL_CCL, diff_blobs(blob.to_vector(), bOther.to_vector()));
+}
+
+int Yun::dispatch_saliency_block(cv::Mat &src, int h, int w)
+{
+	switch (pam.localBlockSz)
+	{
+	case 11: return saliency_block<NUM_ANG, 11>(src, h, w);
+	case 15: return saliency_block<NUM_ANG, 15>(src, h, w);
+	default: return saliency_block<NUM_ANG, 21>(src, h, w);
+	}
+}
+
+static cv::Rect grow_rect(cv::Rect rt, int n)
+{
+	return cv::Rect(rt.x - n, rt.y - n, rt.width + 2 * n, rt.height + 2 * n);
+}
+
+// blocks [b0, b1] (of n) whose window [b * lbSz, b * lbSz + 2 * cBlock] meets [lo, lo + len)
+static bool block_range(int lo, int len, int lbSz, int cBlock, int n, int &b0, int &b1)
+{
+	b0 = std::max(0, (lo - 2 * cBlock + lbSz - 1) / lbSz);
+	b1 = std::min(n - 1, (lo + len - 1) / lbSz);
+	return b0 <= b1;
+}
+
+// smoothed value of every pixel of area, with the window clamping of calc_smooth_t
+// and from an integral of only the pixels the windows reach; the sums are exact
+// integers, so the values equal the ones taken from the integral of the frame.
+// hist follows the pixels that are overwritten
+static void smooth_area(cv::Mat &src, int WinSz, cv::Rect area, cv::Mat &dst, int *hist)
+{
+	const cv::Size imSz = src.size();
+
+	const int nSize = WinSz * WinSz;
+	const int cSize = (WinSz / 2) + 1;
+
+	const int y0 = std::max(0, area.y - cSize);
+	const int y1 = std::min(imSz.height - 1, area.y + area.height - 1 + cSize);
+	const int x0 = std::max(0, area.x - cSize);
+	const int x1 = std::min(imSz.width - 1, area.x + area.width - 1 + cSize);
+	const int iw = x1 - x0 + 2;
+
+	// one zero row and column in front
+	std::vector<uint32_t> integral((size_t)(y1 - y0 + 2) * iw, 0);
+	for (int h = y0; h <= y1; h++)
+	{
+		const uchar *sRow = src.ptr<uchar>(h);
+		const uint32_t *prev = &integral[(size_t)(h - y0) * iw];
+		uint32_t *row = &integral[(size_t)(h - y0 + 1) * iw];
+
+		uint32_t sum = 0;
+		for (int w = x0; w <= x1; w++)
+		{
+			sum += sRow[w];
+			row[w - x0 + 1] = prev[w - x0 + 1] + sum;
+		}
+	}
+
+	for (int h = area.y; h < area.y + area.height; h++)
+	{
+		// rows (h - cSize, h + cSize], from row 0 as long as h - cSize <= 0
+		const int top = (h - cSize > 0) ? h - cSize + 1 : 0;
+		const int bottom = std::min(h + cSize, imSz.height - 1);
+		const uint32_t *rT = &integral[(size_t)(top - y0) * iw];
+		const uint32_t *rB = &integral[(size_t)(bottom - y0 + 1) * iw];
+		uchar *dst_row = dst.ptr<uchar>(h);
+
+		for (int w = area.x; w < area.x + area.width; w++)
+		{
+			// columns [w - cSize, w + cSize]
+			const int left = std::max(w - cSize, 0) - x0;
+			const int right = std::min(w + cSize, imSz.width - 1) - x0 + 1;
+
+			float mean = (float)(rB[right] - rT[right] - rB[left] + rT[left]) / nSize;
+			uchar val = (mean > 255) ? 255 : mean;
+
+			hist[dst_row[w]]--;
+			hist[val]++;
+			dst_row[w] = val;
+		}
+	}
+}
+
+bool Yun::can_increment(cv::Size imSz) const
+{
+	// the patches reproduce the specialized kernels
+	const int lbSz = pam.localBlockSz;
+	if (!pam.useSpecialized || pam.blockGrid || pam.incTile <= 0) return false;
+	if (lbSz != 11 && lbSz != 15 && lbSz != 21) return false;
+	if (pam.winSz != 15 && pam.winSz != 25 && pam.winSz != 35) return false;
+
+	// room for a block and a smoothing window
+	const int minSide = std::max(lbSz, pam.winSz) + 3;
+	return imSz.width >= minSide && imSz.height >= minSide;
+}
+
+void Yun::init_incremental(cv::Mat &gray_src)
+{
+	const cv::Size imSz = gray_src.size();
+	const cv::Rect frame(cv::Point(0, 0), imSz);
+	const int lbSz = pam.localBlockSz;
+	const int cBlock = (lbSz / 2) + 1;
+
+	gray_src.copyTo(incPrev);
+
+	// orientation and magnitude
+	incO = cv::Mat(imSz, CV_8UC1, cv::Scalar(255));
+	if (pam.lazyMagnitude) incM.release();
+	else incM = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+	memset(incCnt, 0, sizeof(incCnt));
+	update_orientation(gray_src, cv::Rect(1, 1, imSz.width - 2, imSz.height - 2));
+
+	// saliency, block centres at cBlock + i * lbSz as in calc_saliency_t
+	incBlockW = (imSz.width - 2 * cBlock + lbSz - 1) / lbSz;
+	const int nBlockH = (imSz.height - 2 * cBlock + lbSz - 1) / lbSz;
+	incBlock.assign((size_t)incBlockW * nBlockH, -1);
+	incE = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+	render_saliency(update_saliency(frame));
+
+	// smoothing, the histogram starts with every pixel at 0
+	incS = cv::Mat(imSz, CV_8UC1, cv::Scalar(0));
+	memset(incHist, 0, sizeof(incHist));
+	incHist[0] = imSz.area();
+	smooth_area(incE, pam.winSz, frame, incS, incHist);
+}
+
+std::vector<cv::Rect> Yun::find_changed(cv::Mat &gray_src)
+{
+	const cv::Size imSz = gray_src.size();
+	const int tile = pam.incTile;
+
+	std::vector<cv::Rect> runs;
+	for (int ty = 0; ty < imSz.height; ty += tile)
+	{
+		const int th = std::min(tile, imSz.height - ty);
+
+		std::vector<cv::Rect> row;
+		for (int tx = 0; tx < imSz.width; tx += tile)
+		{
+			const int tw = std::min(tile, imSz.width - tx);
+			istats.nTiles++;
+
+			bool isChanged = false;
+			if (pam.incSadT <= 0)
+			{
+				// exact: any byte that differs
+				for (int y = ty; y < ty + th && !isChanged; y++)
+					isChanged = memcmp(gray_src.ptr<uchar>(y) + tx, incPrev.ptr<uchar>(y) + tx, tw) != 0;
+			}
+			else
+			{
+				// sum of absolute differences, a loop the compiler turns into SAD instructions
+				uint64_t sad = 0;
+				for (int y = ty; y < ty + th; y++)
+				{
+					const uchar *a = gray_src.ptr<uchar>(y) + tx;
+					const uchar *b = incPrev.ptr<uchar>(y) + tx;
+
+					unsigned int rowSad = 0;
+					for (int x = 0; x < tw; x++) rowSad += std::abs(a[x] - b[x]);
+					sad += rowSad;
+				}
+				isChanged = sad > pam.incSadT * tw * th;
+			}
+			if (!isChanged) continue;
+
+			// the reference keeps what the maps were computed from
+			istats.nDirty++;
+			for (int y = ty; y < ty + th; y++)
+				memcpy(incPrev.ptr<uchar>(y) + tx, gray_src.ptr<uchar>(y) + tx, tw);
+
+			// neighbouring tiles of a row join into one run
+			if (!row.empty() && row.back().x + row.back().width == tx) row.back().width += tw;
+			else row.push_back(cv::Rect(tx, ty, tw, th));
+		}
+
+		// and a run continues the one right above it, if it spans the same columns
+		for (size_t i = 0; i < row.size(); i++)
+		{
+			size_t k = 0;
+			for (; k < runs.size(); k++)
+				if (runs[k].x == row[i].x && runs[k].width == row[i].width && runs[k].y + runs[k].height == ty) break;
+
+			if (k < runs.size()) runs[k].height += th;
+			else runs.push_back(row[i]);
+		}
+	}
+
+	return runs;
+}
+
+void Yun::update_orientation(cv::Mat &gray_src, cv::Rect area)
+{
+	// old edges of the area leave the histogram, the new ones are counted by the kernel
+	for (int h = area.y; h < area.y + area.height; h++)
+	{
+		uchar *oRow = incO.ptr<uchar>(h);
+		for (int w = area.x; w < area.x + area.width; w++)
+		{
+			if (oRow[w] < NUM_ANG) incCnt[oRow[w]]--;
+			oRow[w] = 255;
+		}
+	}
+
+	if (incM.empty()) calc_orientation_area_t<NUM_ANG, false>(gray_src, incM, incO, area, incCnt);
+	else calc_orientation_area_t<NUM_ANG, true>(gray_src, incM, incO, area, incCnt);
+}
+
+cv::Rect Yun::update_saliency(cv::Rect area)
+{
+	const int lbSz = pam.localBlockSz;
+	const int cBlock = (lbSz / 2) + 1;
+	const int nBlockH = (int)incBlock.size() / std::max(1, incBlockW);
+
+	int i0, i1, j0, j1;
+	if (area.empty() || !block_range(area.y, area.height, lbSz, cBlock, nBlockH, i0, i1)
+		|| !block_range(area.x, area.width, lbSz, cBlock, incBlockW, j0, j1)) return cv::Rect();
+
+	for (int i = i0; i <= i1; i++)
+		for (int j = j0; j <= j1; j++)
+			incBlock[i * incBlockW + j] = dispatch_saliency_block(incO, cBlock + i * lbSz, cBlock + j * lbSz);
+
+	// pixels the recomputed blocks are drawn on
+	return cv::Rect(j0 * lbSz, i0 * lbSz, (j1 - j0) * lbSz + 2 * cBlock + 1, (i1 - i0) * lbSz + 2 * cBlock + 1);
+}
+
+void Yun::render_saliency(cv::Rect area)
+{
+	const int lbSz = pam.localBlockSz;
+	const int cBlock = (lbSz / 2) + 1;
+	const int span = 2 * cBlock + 1;
+	const int nBlockH = (int)incBlock.size() / std::max(1, incBlockW);
+
+	if (area.empty()) return;
+
+	for (int h = area.y; h < area.y + area.height; h++)
+		memset(incE.ptr<uchar>(h) + area.x, 0, area.width);
+
+	// windows of neighbouring blocks overlap, the later block wins as in calc_saliency_t
+	int i0, i1, j0, j1;
+	if (!block_range(area.y, area.height, lbSz, cBlock, nBlockH, i0, i1)
+		|| !block_range(area.x, area.width, lbSz, cBlock, incBlockW, j0, j1)) return;
+
+	for (int i = i0; i <= i1; i++)
+	{
+		for (int j = j0; j <= j1; j++)
+		{
+			const int val = incBlock[i * incBlockW + j];
+			if (val < 0) continue;
+
+			cv::Rect rt = cv::Rect(j * lbSz, i * lbSz, span, span) & area;
+			for (int h = rt.y; h < rt.y + rt.height; h++)
+				memset(incE.ptr<uchar>(h) + rt.x, val, rt.width);
+		}
+	}
+}
+
+std::vector<YunCandidate> Yun::process_incremental(cv::Mat &gray_src)
+{
+	YunResult result;
+	process_incremental(gray_src, result);
+	return result.to_vector();
+}
+
+void Yun::process_incremental(cv::Mat &gray_src, YunResult &result)
+{
+	istats.nFrames++;
+
+	if (!can_increment(gray_src.size()))
+	{
+		istats.nFull++;
+		process(gray_src, result);
+		return;
+	}
+
+	isCut = false;
+
+	try{
+		const cv::Size imSz = gray_src.size();
+		const cv::Rect frame(cv::Point(0, 0), imSz);
+		const cv::Rect inner(1, 1, imSz.width - 2, imSz.height - 2);
+		const int cSize = (pam.winSz / 2) + 1;
+
+		if (incPrev.size() != imSz)
+		{
+			istats.nFull++;
+			init_incremental(gray_src);
+		}
+		else
+		{
+			std::vector<cv::Rect> area = find_changed(gray_src);
+			if (area.empty())
+			{
+				result = incResult;
+				return;
+			}
+
+			// a changed pixel moves the orientation of its 3x3 neighbourhood, that the
+			// blocks around it, and those every smoothing window reaching them
+			for (size_t i = 0; i < area.size(); i++)
+			{
+				area[i] = grow_rect(area[i], 1) & inner;
+				update_orientation(gray_src, area[i]);
+			}
+			for (size_t i = 0; i < area.size(); i++) area[i] = update_saliency(area[i]);
+			for (size_t i = 0; i < area.size(); i++) render_saliency(area[i]);
+			for (size_t i = 0; i < area.size(); i++)
+			{
+				if (!area[i].empty()) smooth_area(incE, pam.winSz, grow_rect(area[i], cSize) & frame, incS, incHist);
+			}
+		}
+
+		// threshold, labelling and verification stay global
+		std::vector<YunOrientation> Vmap(NUM_ANG);
+		int nEdge = 0;
+		for (int i = 0; i < NUM_ANG; i++)
+		{
+			Vmap[i].cnt = incCnt[i];
+			nEdge += incCnt[i];
+		}
+		calc_strong(Vmap, nEdge);
+
+		int thr = calc_otsu(incHist, imSz.area());
+
+		YunBlobs &blob = wsBlob;
+		dispatch_ccl(incS, thr, incO, Vmap, blob);
+
+		limit_candidates(blob, false);
+		cstats.nBlobs += blob.size();
+		if (pam.useCascade) calc_cascade(blob, incO);
+
+		calc_candidate(blob, gray_src, incM, incO, incResult);
+	}
+	catch (cv::Exception &e)
+	{
+		std::cerr << "cv::Exception: " << std::endl;
+		std::cerr << e.what() << std::endl;
+
+		// start over with the next frame
+		incPrev.release();
+		incResult.clear();
+	}
+	result = incResult;
+}
+
+int Yun::push(int *stackx, int *stacky, int arr_size, int vx, int vy, int *top)
+{
+	if (*top >= arr_size) return(-1);
+	(*top)++;
+	stackx[*top] = vx;
+	stacky[*top] = vy;
+	return 1;
+}
+
+int Yun::pop(int *stackx, int *stacky, int arr_size, int *vx, int *vy, int *top)
+{
+	if (*top == 0) return(-1);
+	*vx = stackx[*top];
+	*vy = stacky[*top];
+	(*top)--;
+	return 1;
+}
+
+// votes of a blob within NEAR_ANG folded orientations of its dominant one,
+// wrapping around (orientation is circular), so a slightly skewed or curved
+// code keeps its edges. The window spans 3 of the 6 folded orientations (90
+// degree): edges of any direction at random score about 0.5
+static void count_votes(const int *hist, YunLabel &val)
+{
+	val.nEdge = 0;
+	for (int k = 0; k < NUM_ANG; k++) val.nEdge += hist[k];
+
+	val.nNear = 0;
+	if (val.max_orientation < NUM_ANG)
+	{
+		for (int d = -NEAR_ANG; d <= NEAR_ANG; d++)
+			val.nNear += hist[(val.max_orientation + d * ANG_FOLD + NUM_ANG) % NUM_ANG];
+	}
+	val.score = 0;
+}
+
+void Yun::ccl(cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &result)
+{
+	result.clear();
+
+	const cv::Size imSz = src.size();
+	cv::Mat mask(imSz, CV_8UC1); mask.setTo(0);
+
+	int *stackx = new int[imSz.width * imSz.height];
+	int *stacky = new int[imSz.width * imSz.height];
+
+	memset(stackx, 0, imSz.width * imSz.height);
+	memset(stacky, 0, imSz.width * imSz.height);
+
+	int tsize = imSz.width * imSz.height;
+	int r, c, top, label_id = 0;
+
+	cv::Rect rect;
+
+	for (int h = 1; h < imSz.height - 2; h++)
+	{
+		if ((h & 15) == 0 && is_expired()) break;
+
+		for (int w = 1; w < imSz.width - 2; w++)
+		{
+			// skip pixel
+			if (mask.at<uchar>(h, w) != 0 || src.at<uchar>(h, w) <= thr) continue;
+
+			//
+			r = h;
+			c = w;
+			rect = cv::Rect(w, h, 0, 0);
+
+			top = 0;
+			++label_id; if (label_id > 255) label_id = 1;
+
+			int hist[NUM_ANG] = { 0 };
+
+			while (true)
+			{
+			re:
+				for (int m = r - 1; m <= r + 1; m++)
+				{
+					for (int n = c - 1; n <= c + 1; n++)
+					{
+						if ((m < 0) || (m >= imSz.height)) continue;	// height ���� ����
+						if ((n < 0) || (n >= imSz.width)) continue;	// width ���� ����
+
+						if (mask.at<uchar>(m, n) != 0 ||
+							src.at<uchar>(m, n) <= thr) continue;
+
+						int bin = oMap.at<uchar>(m, n);
+						if (bin >= NUM_ANG) continue;
+
+						mask.at<uchar>(m, n) = label_id;
+						hist[bin]++;
+
+						if (push(stackx, stacky, tsize, m, n, &top) == -1) continue;
+
+						r = m; c = n;
+						rect.x = rect.x > c ? c : rect.x;
+						rect.y = rect.y > r ? r : rect.y;
+						rect.width = rect.width > c ? rect.width : c;
+						rect.height = rect.height > r ? rect.height : r;
+						goto re;
+					}
+				}
+
+				if (pop(stackx, stacky, tsize, &r, &c, &top) == -1)
+				{
+					int width = rect.width - rect.x;
+					int height = rect.height - rect.y;
+
+					if (width > 15 && height > 15)
+					{
+						YunLabel val;
+
+						val.roi = cv::Rect(rect.x, rect.y, width, height);
+
+						int max_val = 0;
+						int ori = 255;
+						for (int i = 0; i < NUM_ANG; i++)
+						{
+							if (max_val < hist[i])
+							{
+								max_val = hist[i];
+								ori = i;
+							}
+						}
+						val.max_orientation = ori;
+						val.cnt = max_val;
+						count_votes(hist, val);
+
+						// check Vmap;
+						if (Vmap[ori].isStrong)
+						{
+							push_blob(result, val);
+						}
+					}
+
+					break;
+				}
+			}
+		}
+	}
+
+	delete[]stackx;
+	delete[]stacky;
+}
+
+void Yun::calc_binary_packed(cv::Mat &src, int thr, cv::Mat &oMap, YunBitmap &bMap)
+{
+	const cv::Size imSz = src.size();
+
+	bMap.width = imSz.width;
+	bMap.height = imSz.height;
+	bMap.words = (imSz.width + 63) / 64;
+	bMap.bits.assign((size_t)bMap.words * imSz.height, 0);
+
+	// only pixels ccl can grow through: above threshold and with an orientation
+	for (int h = 0; h < imSz.height; h++)
+	{
+		const uchar *sRow = src.ptr<uchar>(h);
+		const uchar *oRow = oMap.ptr<uchar>(h);
+		uint64_t *row = &bMap.bits[(size_t)h * bMap.words];
+
+		for (int k = 0; k < bMap.words; k++)
+		{
+			const int x0 = k * 64;
+			const int x1 = std::min(x0 + 64, imSz.width);
+
+			uint64_t word = 0;
+			for (int x = x0; x < x1; x++)
+				word |= (uint64_t)(sRow[x] > thr && oRow[x] < NUM_ANG) << (x - x0);
+			row[k] = word;
+		}
+	}
+}
+
+// first pixel at or after x whose bit equals isSet, width if there is none
+static inline int next_bit(const uint64_t *row, int x, int width, bool isSet)
+{
+	const int words = (width + 63) >> 6;
+	int k = x >> 6;
+	if (k >= words) return width;
+
+	uint64_t word = (isSet ? row[k] : ~row[k]) & (~0ULL << (x & 63));
+	while (word == 0)
+	{
+		if (++k >= words) return width;
+		word = isSet ? row[k] : ~row[k];
+	}
+
+	int pos = (k << 6) + __builtin_ctzll(word);
+	return pos < width ? pos : width;
+}
+
+// runs of the bitmap, one per set bit whose left neighbour is clear
+static size_t count_runs(const YunBitmap &bMap)
+{
+	size_t n = 0;
+	for (int h = 0; h < bMap.height; h++)
+	{
+		const uint64_t *row = &bMap.bits[(size_t)h * bMap.words];
+		uint64_t carry = 0;
+		for (int k = 0; k < bMap.words; k++)
+		{
+			n += __builtin_popcountll(row[k] & ~((row[k] << 1) | carry));
+			carry = row[k] >> 63;
+		}
+	}
+	return n;
+}
+
+static inline int find_root(std::vector<int> &parent, int i)
+{
+	while (parent[i] != i)
+	{
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+// run of row y holding x, searched from *p on; *p only moves forward while the
+// columns asked for do not go left of the run it stops at
+static inline int run_at(const std::vector<int> &x0, const std::vector<int> &x1, int *p, int end, int x)
+{
+	while (*p < end && x1[*p] <= x) (*p)++;
+	return (*p < end && x0[*p] <= x) ? *p : -1;
+}
+
+void Yun::ccl_packed(cv::Mat &src, int thr, YunBitmap &bMap, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &result)
+{
+	result.clear();
+
+	// the scratch below is taken from the workspace cap at its exact size and
+	// given back on the way out
+	struct Scratch
+	{
+		size_t &used;
+		size_t n;
+		~Scratch() { used -= n; }
+	} scratch = { wsUsed, 0 };
+
+	const size_t nRuns = count_runs(bMap);
+	const size_t runBytes = (4 * nRuns + bMap.height + 1) * sizeof(int);
+	if (!ws_fits(runBytes)) return;
+	wsUsed += runBytes;
+	scratch.n += runBytes;
+
+	// runs [x0, x1) on row y, rows in order
+	std::vector<int> ry, rx0, rx1;
+	std::vector<int> parent;
+	std::vector<int> rowBegin(bMap.height + 1, 0);
+	ry.reserve(nRuns);
+	rx0.reserve(nRuns);
+	rx1.reserve(nRuns);
+	parent.reserve(nRuns);
+
+	// step 1 runs per row, joined to 8-connected runs of the previous row
+	int prevBegin = 0, prevEnd = 0;
+	for (int h = 0; h < bMap.height; h++)
+	{
+		if ((h & 63) == 0 && is_expired()) return;
+
+		const uint64_t *row = &bMap.bits[(size_t)h * bMap.words];
+		const int curBegin = (int)rx0.size();
+		rowBegin[h] = curBegin;
+
+		for (int x = next_bit(row, 0, bMap.width, true); x < bMap.width; x = next_bit(row, x, bMap.width, true))
+		{
+			const int xe = next_bit(row, x, bMap.width, false);
+			ry.push_back(h);
+			rx0.push_back(x);
+			rx1.push_back(xe);
+			parent.push_back((int)parent.size());
+			x = xe;
+		}
+
+		int p = prevBegin;
+		for (int c = curBegin; c < (int)rx0.size(); c++)
+		{
+			while (p < prevEnd && rx1[p] < rx0[c]) p++;
+			for (int q = p; q < prevEnd && rx0[q] <= rx1[c]; q++)
+			{
+				int a = find_root(parent, q);
+				int b = find_root(parent, c);
+				if (a < b) parent[b] = a;
+				else if (b < a) parent[a] = b;
+			}
+		}
+
+		prevBegin = curBegin;
+		prevEnd = (int)rx0.size();
+	}
+	rowBegin[bMap.height] = (int)rx0.size();
+
+	// step 2 bounding box and orientation histogram per component
+	typedef struct { int left, top, right, bottom; int hist[NUM_ANG]; } Blob;
+
+	size_t nComp = 0;
+	for (size_t i = 0; i < parent.size(); i++)
+		if (parent[i] == (int)i) nComp++;
+
+	const size_t compBytes = nRuns * sizeof(int) + nComp * (sizeof(Blob) + sizeof(int) + 1);
+	if (!ws_fits(compBytes)) return;
+	wsUsed += compBytes;
+	scratch.n += compBytes;
+
+	std::vector<int> comp(rx0.size(), -1);
+	std::vector<Blob> blobs;
+	blobs.reserve(nComp);
+
+	for (int i = 0; i < (int)rx0.size(); i++)
+	{
+		int root = find_root(parent, i);
+		if (comp[root] < 0)
+		{
+			Blob b;
+			b.left = rx0[i]; b.right = rx1[i] - 1;
+			b.top = b.bottom = ry[i];
+			memset(b.hist, 0, sizeof(b.hist));
+
+			comp[root] = (int)blobs.size();
+			blobs.push_back(b);
+		}
+		comp[i] = comp[root];
+
+		Blob &b = blobs[comp[root]];
+		b.left = std::min(b.left, rx0[i]);
+		b.right = std::max(b.right, rx1[i] - 1);
+		b.bottom = std::max(b.bottom, ry[i]);
+
+		const uchar *oRow = oMap.ptr<uchar>(ry[i]);
+		for (int x = rx0[i]; x < rx1[i]; x++) b.hist[oRow[x]]++;
+	}
+
+	// step 3 components in the order the flood fill of ccl reaches them. It
+	// seeds from every pixel above thr in [1, h-3] x [1, w-3], in raster order:
+	// a seed with an orientation labels its own component, one without labels
+	// the component of its first unlabelled neighbour and adds itself to the
+	// top-left of its box. Components no seed reaches are not labelled.
+	std::vector<int> order;
+	std::vector<char> isClaimed(blobs.size(), 0);
+	order.reserve(nComp);
+
+	for (int h = 1; h < bMap.height - 2; h++)
+	{
+		if ((h & 63) == 0 && is_expired()) return;
+
+		const uchar *sRow = src.ptr<uchar>(h);
+		const uint64_t *bits[3];
+		int p[3], end[3];
+		for (int k = 0; k < 3; k++)
+		{
+			bits[k] = &bMap.bits[(size_t)(h - 1 + k) * bMap.words];
+			p[k] = rowBegin[h - 1 + k];
+			end[k] = rowBegin[h + k];
+		}
+
+		for (int w = 1; w < bMap.width - 2; w++)
+		{
+			if (sRow[w] <= thr) continue;
+
+			if ((bits[1][w >> 6] >> (w & 63)) & 1)
+			{
+				// all of its run is one component, labelled from here on
+				const int r = run_at(rx0, rx1, &p[1], end[1], w);
+				if (!isClaimed[comp[r]])
+				{
+					isClaimed[comp[r]] = 1;
+					order.push_back(comp[r]);
+				}
+				w = std::max(w, rx1[r] - 1);
+				continue;
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				int q = p[k];
+				int n;
+				for (n = w - 1; n <= w + 1; n++)
+				{
+					if (!((bits[k][n >> 6] >> (n & 63)) & 1)) continue;
+
+					const int r = run_at(rx0, rx1, &q, end[k], n);
+					if (isClaimed[comp[r]]) continue;
+
+					Blob &b = blobs[comp[r]];
+					b.left = std::min(b.left, w);
+					b.top = std::min(b.top, h);
+					isClaimed[comp[r]] = 1;
+					order.push_back(comp[r]);
+					break;
+				}
+				if (n <= w + 1) break;
+
+				// the next seed looks from column w on
+				run_at(rx0, rx1, &p[k], end[k], w - 1);
+			}
+		}
+	}
+
+	// step 4 same size and orientation checks as ccl
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Blob &b = blobs[order[i]];
+
+		int width = b.right - b.left;
+		int height = b.bottom - b.top;
+		if (width <= 15 || height <= 15) continue;
+
+		YunLabel val;
+		val.roi = cv::Rect(b.left, b.top, width, height);
+
+		int max_val = 0;
+		int ori = 255;
+		for (int k = 0; k < NUM_ANG; k++)
+		{
+			if (max_val < b.hist[k])
+			{
+				max_val = b.hist[k];
+				ori = k;
+			}
+		}
+		val.max_orientation = ori;
+		val.cnt = max_val;
+		count_votes(b.hist, val);
+
+		// check Vmap;
+		if (ori < NUM_ANG && Vmap[ori].isStrong)
+		{
+			push_blob(result, val);
+		}
+	}
+}
+
+void Yun::limit_candidates(YunBlobs &blob, bool isSorted)
+{
+	// candidate budget: keep the blobs with the most supporting edges,
+	// sorted that way anyhow when verification may be cut short
+	const bool isOver = pam.maxCandidates > 0 && (int)blob.size() > pam.maxCandidates;
+	if (!isOver && !isSorted) return;
+
+	std::vector<int> &order = wsOrder;
+	order.resize(blob.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+
+	const std::vector<int> &cnt = blob.cnt;
+	std::stable_sort(order.begin(), order.end(), [&cnt](int a, int b) { return cnt[a] > cnt[b]; });
+	if (isOver) order.resize(pam.maxCandidates);
+
+	blob.select(order);
+}
+
+void Yun::calc_cascade(YunBlobs &blob, cv::Mat &oMap)
+{
+	std::vector<int> &keep = wsOrder;
+	keep.clear();
+
+	// 1 aspect ratio and 2 orientation purity, both from what labelling counted
+	for (size_t i = 0; i < blob.size(); i++)
+	{
+		const cv::Rect &r = blob.roi[i];
+
+		double aspect = (double)std::max(r.width, r.height) / std::max(1, std::min(r.width, r.height));
+		if (aspect > pam.maxAspect) { cstats.nAspect++; continue; }
+
+		if (blob.nNear[i] < pam.minPurity * blob.nEdge[i]) { cstats.nPurity++; continue; }
+
+		keep.push_back((int)i);
+	}
+
+	// 3 edge density, the integral image only built when a blob got this far
+	if (!keep.empty())
+	{
+		cv::Mat iMap = calc_edge_integral(oMap);
+
+		size_t n = 0;
+		for (size_t k = 0; k < keep.size(); k++)
+		{
+			const int i = keep[k];
+			const cv::Rect &r = blob.roi[i];
+
+			int nIn = iMap.at<int>(r.y + r.height, r.x + r.width) - iMap.at<int>(r.y, r.x + r.width)
+				- iMap.at<int>(r.y + r.height, r.x) + iMap.at<int>(r.y, r.x);
+			double density = (double)nIn / ((double)r.width * r.height);
+			if (density < pam.minEdgeDensity) { cstats.nDensity++; continue; }
+
+			// purity, lowered for rectangles with fewer than one edge in two pixels
+			blob.score[i] = (blob.nEdge[i] ? (double)blob.nNear[i] / blob.nEdge[i] : 0) * std::min(1.0, 2.0 * density);
+			keep[n++] = i;
 		}
+		keep.resize(n);
 	}
 
-	// check orientation
-	for (int i = 0; i < NUM_ANG; i++)
+	blob.select(keep);
+}
+
+// edge pixel counts, one row and column larger than oMap (top left sums)
+cv::Mat Yun::calc_edge_integral(cv::Mat &oMap)
+{
+	const cv::Size imSz = oMap.size();
+	cv::Mat result(imSz.height + 1, imSz.width + 1, CV_32SC1, cv::Scalar(0));
+
+	for (int h = 0; h < imSz.height; h++)
 	{
-		if (Vmap[i].cnt > 6000)
+		const uchar *oRow = oMap.ptr<uchar>(h);
+		const int *prev = result.ptr<int>(h);
+		int *row = result.ptr<int>(h + 1);
+
+		int sum = 0;
+		for (int w = 0; w < imSz.width; w++)
 		{
-			Vmap[i].isStrong = true;
+			sum += (oRow[w] < NUM_ANG);
+			row[w + 1] = prev[w + 1] + sum;
 		}
-		else Vmap[i].isStrong = false;
 	}
 
-	return oMap;
+	return result;
 }
 
-cv::Mat Yun::calc_saliency(cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz)
+cv::Mat Yun::calc_saliency_grid(cv::Mat &src, int lbSz, cv::Mat &hMap)
 {
 	const cv::Size imSz = src.size();
 
-	cv::Mat sMap(imSz, CV_8UC1); sMap.setTo(0);
 	const int nMax = lbSz * lbSz * NUM_ANG;
 	const int cBlock = (lbSz / 2) + 1;
 
-	for (int h = cBlock; h < imSz.height - cBlock; h += lbSz)
+	// same block centers as calc_saliency
+	int gh = 0, gw = 0;
+	for (int h = cBlock; h < imSz.height - cBlock; h += lbSz) gh++;
+	for (int w = cBlock; w < imSz.width - cBlock; w += lbSz) gw++;
+
+	cv::Mat gMap(std::max(gh, 1), std::max(gw, 1), CV_8UC1, cv::Scalar(0));
+	hMap = cv::Mat(gMap.rows, gMap.cols * NUM_ANG, CV_32SC1, cv::Scalar(0));
+
+	for (int i = 0; i < gh; i++)
 	{
-		for (int w = cBlock; w < imSz.width - cBlock; w += lbSz)
+		const int h = cBlock + i * lbSz;
+		for (int j = 0; j < gw; j++)
 		{
-			// step 1 local block histogram (orientation)
-			int LocalHisto[NUM_ANG] = { 0 };
+			const int w = cBlock + j * lbSz;
+
+			// step 1 local block histogram (orientation), kept for labelling
+			int *LocalHisto = hMap.ptr<int>(i) + j * NUM_ANG;
 			for (int y = h - cBlock; y <= h + cBlock; y++)
 			{
-				if (y < 0 || y >= imSz.height) continue;
+				const uchar *row = src.ptr<uchar>(y);
 				for (int x = w - cBlock; x <= w + cBlock; x++)
 				{
-					if (x < 0 || x >= imSz.width) continue;
-
-					uchar bin = src.at<uchar>(y, x);
-					if (bin >= NUM_ANG) continue;
-
-					LocalHisto[bin]++;
+					if (row[x] < NUM_ANG) LocalHisto[row[x]]++;
 				}
 			}
 
 			// step 2 find max values
 			int max_val = 0;
-			for (int i = 0; i < NUM_ANG; i++)
-			{
-				if (LocalHisto[i] > max_val)
-					max_val = LocalHisto[i];
-			}
+			for (int k = 0; k < NUM_ANG; k++)
+				max_val = LocalHisto[k] > max_val ? LocalHisto[k] : max_val;
 
-			// step 3 entropy
-			double pim = 0;
-			for (int i = 0; i < NUM_ANG; i++)
-			{
-				pim += std::abs(LocalHisto[i] - max_val);
-			}
-
-			// step 4 check max value
 			if (max_val == 0) continue;
 
-			// step 5 normalization
-			double npim = pim / nMax;
+			// step 3 entropy, step 5 normalization
+			int pim = 0;
+			for (int k = 0; k < NUM_ANG; k++)
+				pim += max_val - LocalHisto[k];
+
+			double npim = (double)pim / nMax;
 			uchar ramp_npim = (npim * 255) > 255 ? 255 : (npim * 255);
 
 			if (npim < 0.6) ramp_npim = 0;
 
-			// step 6 set block
-			for (int y = h - cBlock; y <= h + cBlock; y++)
-			{
-				if (y < 0 || y >= imSz.height) continue;
-				for (int x = w - cBlock; x <= w + cBlock; x++)
-				{
-					if (x < 0 || x >= imSz.width) continue;
-					sMap.at<uchar>(y, x) = ramp_npim;
-				}
-			}
-		}
-	}
-
-	return sMap;
-}
-
-cv::Mat Yun::calc_integral_image(cv::Mat &src)
-{
-	//assert(src.channels() == 1);
-
-	const cv::Size imSz = src.size();
-	cv::Mat result(imSz, CV_32FC1);
-
-	// -1st cols
-	result.at<float>(0, 0) = src.at<uchar>(0, 0);
-	for (int w = 1; w < imSz.width; w++)
-		result.at<float>(0, w) = (float)src.at<uchar>(0, w) + result.at<float>(0, w - 1);
-
-	// -other cols
-	for (int h = 1; h < imSz.height; h++)
-	{
-		float sum = 0.0f;
-		for (int w = 0; w < imSz.width; w++)
-		{
-			sum += src.at<uchar>(h, w);
-			result.at<float>(h, w) = result.at<float>(h - 1, w) + sum;
+			gMap.at<uchar>(i, j) = ramp_npim;
 		}
 	}
 
-	return result;
+	return gMap;
 }
 
-cv::Mat Yun::calc_smooth(cv::Mat &src, int WinSz)
+cv::Mat Yun::calc_smooth_grid(cv::Mat &src, int WinSz, int lbSz, int *hist)
 {
-	const cv::Size imSz = src.size();
+	const cv::Size grSz = src.size();
 
 	const int nSize = WinSz * WinSz;
 	const int cSize = (WinSz / 2) + 1;
-	const int max_height = imSz.height - cSize;
-	const int max_width = imSz.width - cSize;
-	float mean_max = 0.0f;
+	const int half = lbSz / 2;
+
+	// pixels of the (2 * cSize + 1) window of calc_smooth that fall into
+	// the cell k blocks away, so a cell gets the mean the pixel map has
+	// at its block center
+	const int K = cSize / lbSz + 1;
+	std::vector<int> wt(2 * K + 1);
+	for (int k = -K; k <= K; k++)
+	{
+		int lo = std::max(-cSize, k * lbSz - half);
+		int hi = std::min(cSize, k * lbSz + half);
+		wt[k + K] = std::max(0, hi - lo + 1);
+	}
 
-	cv::Mat smooth_map(imSz, CV_8UC1);
+	cv::Mat smooth_map(grSz, CV_8UC1);
 
-	for (int h = 0; h < imSz.height; h++)
+	for (int i = 0; i < grSz.height; i++)
 	{
-		int temp_top = h - cSize;
-		int ntop = (temp_top > max_height) ? max_height : temp_top;
-		int temp_bottom = h + cSize;
-		int nbottom = (temp_bottom >= imSz.height - 1) ? imSz.height - 1 : temp_bottom;
-
-		for (int w = 0; w < imSz.width; w++)
+		for (int j = 0; j < grSz.width; j++)
 		{
-			int temp_left = w - cSize;
-			int nleft = (temp_left > max_width) ? max_width : temp_left;
-			int temp_right = w + cSize;
-			int nright = (temp_right >= imSz.width - 1) ? imSz.width - 1 : temp_right;
+			float sum = 0.0f;
+			for (int m = -K; m <= K; m++)
+			{
+				int y = i + m;
+				if (y < 0 || y >= grSz.height || wt[m + K] == 0) continue;
 
-			// local mean
-			float n1 = (nleft > 0 && ntop > 0) ? src.at<float>(ntop, nleft - 1) : 0;
-			float n2 = (nleft > 0) ? src.at<float>(nbottom, nleft - 1) : 0;
-			float n3 = (ntop > 0) ? src.at<float>(ntop, nright) : 0;
+				const uchar *row = src.ptr<uchar>(y);
+				for (int n = -K; n <= K; n++)
+				{
+					int x = j + n;
+					if (x < 0 || x >= grSz.width) continue;
+					sum += (float)(wt[m + K] * wt[n + K] * row[x]);
+				}
+			}
 
-			float sum = src.at<float>(nbottom, nright) - n3 - n2 + n1;
 			float mean = sum / nSize;
-
-			smooth_map.at<uchar>(h, w) = (mean > 255) ? 255 : mean;
+			uchar val = (mean > 255) ? 255 : mean;
+			smooth_map.at<uchar>(i, j) = val;
+			hist[val]++;
 		}
 	}
 
 	return smooth_map;
 }
 
-int Yun::push(int *stackx, int *stacky, int arr_size, int vx, int vy, int *top)
-{
-	if (*top >= arr_size) return(-1);
-	(*top)++;
-	stackx[*top] = vx;
-	stacky[*top] = vy;
-	return 1;
-}
-
-int Yun::pop(int *stackx, int *stacky, int arr_size, int *vx, int *vy, int *top)
-{
-	if (*top == 0) return(-1);
-	*vx = stackx[*top];
-	*vy = stacky[*top];
-	(*top)--;
-	return 1;
-}
-
-std::vector<YunLabel> Yun::ccl(cv::Mat &src, cv::Mat &oMap, std::vector<YunOrientation> &Vmap)
+void Yun::ccl_grid(cv::Mat &src, int thr, cv::Mat &hMap, std::vector<YunOrientation> &Vmap, int lbSz, cv::Size imSz, YunBlobs &result)
 {
-	std::vector<YunLabel> result;
-
-	const cv::Size imSz = src.size();
-	cv::Mat mask(imSz, CV_8UC1); mask.setTo(0);
+	result.clear();
+
+	const cv::Size grSz = src.size();
+	const int y0 = 1;  // first pixel row/col of cell 0 (cBlock - lbSz / 2)
+
+	// a cell is accepted if it is salient, its dominant orientation is strong
+	// and most of its edges lie within NEAR_ANG folded orientations of it (edges
+	// at random: about half); the dominant bin is kept, so only cells of about
+	// the same orientation are merged below
+	const double minCoherence = 0.8;
+	cv::Mat mask(grSz, CV_8UC1, cv::Scalar(0));
+	cv::Mat dMap(grSz, CV_8UC1, cv::Scalar(NUM_ANG));
+	for (int i = 0; i < grSz.height; i++)
+	{
+		for (int j = 0; j < grSz.width; j++)
+		{
+			if (src.at<uchar>(i, j) <= thr) continue;
 
-	int *stackx = new int[imSz.width * imSz.height];
-	int *stacky = new int[imSz.width * imSz.height];
+			const int *hist = hMap.ptr<int>(i) + j * NUM_ANG;
+			int dom = 0, nEdge = 0;
+			for (int k = 0; k < NUM_ANG; k++)
+			{
+				nEdge += hist[k];
+				if (hist[k] > hist[dom]) dom = k;
+			}
+			if (nEdge == 0 || !Vmap[dom].isStrong) continue;
 
-	memset(stackx, 0, imSz.width * imSz.height);
-	memset(stacky, 0, imSz.width * imSz.height);
+			int nNear = 0;
+			for (int d = -NEAR_ANG; d <= NEAR_ANG; d++) nNear += hist[(dom + d * ANG_FOLD + NUM_ANG) % NUM_ANG];
+			if (nNear < minCoherence * nEdge) continue;
 
-	int tsize = imSz.width * imSz.height;
-	int r, c, top, label_id = 0;
+			mask.at<uchar>(i, j) = 1;
+			dMap.at<uchar>(i, j) = (uchar)dom;
+		}
+	}
 
-	cv::Rect rect;
+	std::vector<cv::Point> stack;
 
-	for (int h = 1; h < imSz.height - 2; h++)
+	for (int i = 0; i < grSz.height; i++)
 	{
-		for (int w = 1; w < imSz.width - 2; w++)
+		for (int j = 0; j < grSz.width; j++)
 		{
-			// skip pixel
-			if (mask.at<uchar>(h, w) != 0 || src.at<uchar>(h, w) < 128) continue;
-
-			//
-			r = h;
-			c = w;
-			rect = cv::Rect(w, h, 0, 0);
-
-			top = 0;
-			++label_id; if (label_id > 255) label_id = 1;
+			if (mask.at<uchar>(i, j) != 1) continue;
 
 			int hist[NUM_ANG] = { 0 };
+			int top = i, bottom = i, left = j, right = j;
 
-			while (true)
+			mask.at<uchar>(i, j) = 2;
+			stack.push_back(cv::Point(j, i));
+
+			while (!stack.empty())
 			{
-			re:
-				for (int m = r - 1; m <= r + 1; m++)
-				{
-					for (int n = c - 1; n <= c + 1; n++)
-					{
-						if ((m < 0) || (m >= imSz.height)) continue;	// height ���� ����
-						if ((n < 0) || (n >= imSz.width)) continue;	// width ���� ����
+				cv::Point pt = stack.back();
+				stack.pop_back();
 
-						if (mask.at<uchar>(m, n) != 0 ||
-							src.at<uchar>(m, n) < 128) continue;
+				const int *cell = hMap.ptr<int>(pt.y) + pt.x * NUM_ANG;
+				for (int k = 0; k < NUM_ANG; k++) hist[k] += cell[k];
 
-						int bin = oMap.at<uchar>(m, n);
-						if (bin >= NUM_ANG) continue;
+				top = std::min(top, pt.y); bottom = std::max(bottom, pt.y);
+				left = std::min(left, pt.x); right = std::max(right, pt.x);
 
-						mask.at<uchar>(m, n) = label_id;
-						hist[bin]++;
+				for (int m = pt.y - 1; m <= pt.y + 1; m++)
+				{
+					if (m < 0 || m >= grSz.height) continue;
+					for (int n = pt.x - 1; n <= pt.x + 1; n++)
+					{
+						if (n < 0 || n >= grSz.width) continue;
+						if (mask.at<uchar>(m, n) != 1) continue;
 
-						if (push(stackx, stacky, tsize, m, n, &top) == -1) continue;
+						// bins apart, either way round
+						const int d = std::abs(dMap.at<uchar>(m, n) - dMap.at<uchar>(pt.y, pt.x));
+						if (std::min(d, NUM_ANG - d) > NEAR_ANG * ANG_FOLD) continue;
 
-						r = m; c = n;
-						rect.x = rect.x > c ? c : rect.x;
-						rect.y = rect.y > r ? r : rect.y;
-						rect.width = rect.width > c ? rect.width : c;
-						rect.height = rect.height > r ? rect.height : r;
-						goto re;
+						mask.at<uchar>(m, n) = 2;
+						stack.push_back(cv::Point(n, m));
 					}
 				}
+			}
 
-				if (pop(stackx, stacky, tsize, &r, &c, &top) == -1)
-				{
-					int width = rect.width - rect.x;
-					int height = rect.height - rect.y;
-
-					if (width > 15 && height > 15)
-					{
-						YunLabel val;
-
-						val.roi = cv::Rect(rect.x, rect.y, width, height);
+			// back to pixels
+			cv::Rect roi(y0 + left * lbSz, y0 + top * lbSz, (right - left + 1) * lbSz, (bottom - top + 1) * lbSz);
+			roi &= cv::Rect(0, 0, imSz.width, imSz.height);
 
-						int max_val = 0;
-						int ori = 255;
-						for (int i = 0; i < NUM_ANG; i++)
-						{
-							if (max_val < hist[i])
-							{
-								max_val = hist[i];
-								ori = i;
-							}
-						}
-						val.max_orientation = ori;
+			if (roi.width <= 15 || roi.height <= 15) continue;
 
-						// check Vmap;
-						if (Vmap[ori].isStrong)
-						{
-							result.push_back(val);
-						}
-					}
+			YunLabel val;
+			val.roi = roi;
 
-					break;
+			int max_val = 0;
+			int ori = 255;
+			for (int k = 0; k < NUM_ANG; k++)
+			{
+				if (max_val < hist[k])
+				{
+					max_val = hist[k];
+					ori = k;
 				}
 			}
+			val.max_orientation = ori;
+			val.cnt = max_val;
+			count_votes(hist, val);
+
+			// check Vmap;
+			if (ori < NUM_ANG && Vmap[ori].isStrong)
+			{
+				push_blob(result, val);
+			}
 		}
 	}
-
-	delete[]stackx;
-	delete[]stacky;
-
-	return result;
 }
 
-std::vector<YunCandidate> Yun::calc_candidate(std::vector<YunLabel> &val, cv::Mat &mMap, cv::Mat &oMap)
+void Yun::calc_candidate(YunBlobs &val, cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap, YunResult &result)
 {
-	std::vector<YunCandidate> result;
+	result.clear();
 
-	for (std::vector<YunLabel>::iterator it = val.begin(); it < val.end(); it++)
+	for (size_t i = 0; i < val.size(); i++)
 	{
-		YunCandidate tmp = sub_candidate(*it, mMap, oMap);
+		// anytime: keep what is verified so far
+		if (is_expired()) break;
+
+		YunCandidate tmp = sub_candidate(val.at(i), src, mMap, oMap);
+		cstats.nVerified++;
 		if (tmp.isBarcode)
 		{
+			cstats.nBarcode++;
+
 			// not include paper
-			YunCandidate new_tmp = calc_region_check(tmp, mMap.size());
+			YunCandidate new_tmp = calc_region_check(tmp, oMap.size());
 
 			if (result.empty())
 			{
@@ -403,10 +2302,11 @@ std::vector<YunCandidate> Yun::calc_candidate(std::vector<YunLabel> &val, cv::Ma
 				cv::Point st = cv::Point(new_tmp.roi.x, new_tmp.roi.y);
 				cv::Point et = cv::Point(new_tmp.roi.x + new_tmp.roi.width, new_tmp.roi.y + new_tmp.roi.height);
 
-				for (std::vector<YunCandidate>::iterator rit = result.begin(); rit < result.end(); rit++)
+				for (size_t k = 0; k < result.size(); k++)
 				{
-					cv::Point rst = cv::Point(rit->roi.x, rit->roi.y);
-					cv::Point ret = cv::Point(rit->roi.x + rit->roi.width, rit->roi.y + rit->roi.height);
+					cv::Rect &rroi = result.roi[k];
+					cv::Point rst = cv::Point(rroi.x, rroi.y);
+					cv::Point ret = cv::Point(rroi.x + rroi.width, rroi.y + rroi.height);
 
 					// compare!
 					//if (new_tmp.roi.contains(rst) || new_tmp.roi.contains(ret) ||
@@ -424,17 +2324,18 @@ std::vector<YunCandidate> Yun::calc_candidate(std::vector<YunLabel> &val, cv::Ma
 						)
 					{
 						// x
-						if (st.x <= rst.x)  rit->roi.x = st.x;
-						if (et.x >= ret.x)  rit->roi.width = et.x;
-						else                rit->roi.width = ret.x;
+						if (st.x <= rst.x)  rroi.x = st.x;
+						if (et.x >= ret.x)  rroi.width = et.x;
+						else                rroi.width = ret.x;
 
 						// y
-						if (st.y <= rst.y)  rit->roi.y = st.y;
-						if (et.y >= ret.y)  rit->roi.height = et.y;
-						else               rit->roi.height = ret.y;
+						if (st.y <= rst.y)  rroi.y = st.y;
+						if (et.y >= ret.y)  rroi.height = et.y;
+						else               rroi.height = ret.y;
 
-						rit->roi.width -= rit->roi.x;
-						rit->roi.height -= rit->roi.y;
+						rroi.width -= rroi.x;
+						rroi.height -= rroi.y;
+						result.score[k] = std::max(result.score[k], new_tmp.score);
 
 						isSave = false;
 						break;
@@ -446,15 +2347,18 @@ std::vector<YunCandidate> Yun::calc_candidate(std::vector<YunLabel> &val, cv::Ma
 		}
 	}
 
-	return result;
+	// boxes of the merged regions
+	for (size_t k = 0; k < result.size(); k++)
+		result.box[k] = calc_box(src, result.roi[k], result.orientation[k]);
 }
 
-YunCandidate Yun::sub_candidate(YunLabel val, cv::Mat &mMap, cv::Mat &oMap)
+YunCandidate Yun::sub_candidate(YunLabel val, cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap)
 {
 	YunCandidate result;
 
 	cv::Rect roi = val.roi;
-	cv::Size imSz = mMap.size();
+	cv::Size imSz = oMap.size();
+	const bool isLazy = mMap.empty();
 
 	// center point
 	cv::Point_<double> cPt = cv::Point(roi.x + (roi.width / 2), roi.y + (roi.height / 2));
@@ -467,12 +2371,13 @@ YunCandidate Yun::sub_candidate(YunLabel val, cv::Mat &mMap, cv::Mat &oMap)
 	cv::Point_<double> step(std::cos(theta), std::sin(theta));
 
 	//
-	static cv::Rect limit_area(10, 10, imSz.width - 20, imSz.height - 20);
+	const cv::Rect limit_area(10, 10, imSz.width - 20, imSz.height - 20);
 	cv::Rect_<int> imgRect(limit_area);
 
 	int Nedge = 0;
 	result.roi = roi;
 	result.orientation = val.max_orientation;
+	result.score = val.score;
 
 	// starting from a Point in the middle
 	// Extend in both directions to find the extend
@@ -490,7 +2395,8 @@ YunCandidate Yun::sub_candidate(YunLabel val, cv::Mat &mMap, cv::Mat &oMap)
 			curPt += step;
 
 			// line check
-			if (mMap.at<uchar>(curPt) > pam.magT)
+			int intensity = isLazy ? calc_magnitude(src, curPt) : mMap.at<uchar>(curPt);
+			if (intensity > pam.magT)
 			{
 				if (oMap.at<uchar>(curPt) == val.max_orientation)
 				{
@@ -539,6 +2445,22 @@ YunCandidate Yun::sub_candidate(YunLabel val, cv::Mat &mMap, cv::Mat &oMap)
 	return result;
 }
 
+int Yun::calc_magnitude(cv::Mat &src, cv::Point pt)
+{
+	// the value calc_orientation would have stored in mMap at pt
+	if (pt.x < 1 || pt.y < 1 || pt.x >= src.cols - 1 || pt.y >= src.rows - 1) return 0;
+
+	const uchar *p0 = src.ptr<uchar>(pt.y - 1) + pt.x;
+	const uchar *p1 = src.ptr<uchar>(pt.y) + pt.x;
+	const uchar *p2 = src.ptr<uchar>(pt.y + 1) + pt.x;
+
+	int dx = p0[-1] + 2 * p1[-1] + p2[-1] - p0[1] - 2 * p1[1] - p2[1];
+	int dy = p0[-1] + 2 * p0[0] + p0[1] - p2[-1] - 2 * p2[0] - p2[1];
+
+	int intensity = std::sqrt((double)(dx * dx + dy * dy));
+	return intensity > 255 ? 255 : intensity;
+}
+
 YunCandidate Yun::calc_region_check(YunCandidate val, cv::Size imSz)
 {
 	YunCandidate new_val = val;
@@ -578,4 +2500,137 @@ YunCandidate Yun::calc_region_check(YunCandidate val, cv::Size imSz)
 	new_val.roi.height -= new_val.roi.y;
 
 	return new_val;
+}
+
+// first bin at which the running count of hist reaches k
+static int hist_quantile(const std::vector<int> &hist, int k)
+{
+	int sum = 0;
+	for (size_t b = 0; b < hist.size(); b++)
+	{
+		sum += hist[b];
+		if (sum >= k) return (int)b;
+	}
+	return (int)hist.size() - 1;
+}
+
+// bins [lo, hi] with at least level counts around the median of hist,
+// gaps of up to maxGap bins between them bridged
+static void hist_extent(const std::vector<int> &hist, int n, int level, int maxGap, int &lo, int &hi)
+{
+	const int m = hist_quantile(hist, (n + 1) / 2);
+
+	lo = hi = m;
+	for (int b = m - 1; b >= 0 && lo - b <= maxGap + 1; b--)
+		if (hist[b] >= level) lo = b;
+	for (int b = m + 1; b < (int)hist.size() && b - hi <= maxGap + 1; b++)
+		if (hist[b] >= level) hi = b;
+}
+
+// fn(w, h, dx, dy) for the pixels of area whose gradient is at least minMag
+// (squared) and within acos(cosBin) of the axis (ct, st), in raster order
+template<typename Fn>
+static void box_edges(cv::Mat &src, cv::Rect area, double ct, double st, double cosBin, int minMag, Fn fn)
+{
+	for (int h = area.y; h < area.y + area.height; h++)
+	{
+		const uchar *p0 = src.ptr<uchar>(h - 1);
+		const uchar *p1 = src.ptr<uchar>(h);
+		const uchar *p2 = src.ptr<uchar>(h + 1);
+
+		for (int w = area.x; w < area.x + area.width; w++)
+		{
+			int dx = p0[w - 1] + 2 * p1[w - 1] + p2[w - 1] - p0[w + 1] - 2 * p1[w + 1] - p2[w + 1];
+			int dy = p0[w - 1] + 2 * p0[w] + p0[w + 1] - p2[w - 1] - 2 * p2[w] - p2[w + 1];
+
+			const int mag = dx * dx + dy * dy;
+			if (mag < minMag) continue;
+
+			// gradient axis, the sign does not matter
+			const double dot = dx * ct + dy * st;
+			if (dot * dot < cosBin * cosBin * mag) continue;
+
+			fn(w, h, dx, dy);
+		}
+	}
+}
+
+cv::RotatedRect Yun::calc_box(cv::Mat &src, cv::Rect roi, int orientation)
+{
+	const cv::Point2f cPt(roi.x + roi.width * 0.5f, roi.y + roi.height * 0.5f);
+	const cv::RotatedRect upright(cPt, cv::Size2f((float)roi.width, (float)roi.height), 0);
+	if (!pam.orientedBox) return upright;
+
+	// the sobel kernel needs one pixel on every side
+	const cv::Rect area = roi & cv::Rect(1, 1, src.cols - 2, src.rows - 2);
+	if (area.empty()) return upright;
+
+	// edges within one integrated bin (30 degree) of the blob orientation,
+	// with the magnitude threshold of calc_orientation
+	const double theta = (CV_PI / NUM_ANG) * orientation;
+	const double ct = std::cos(theta), st = std::sin(theta);
+	const double cosBin = std::cos(CV_PI / 6);
+	const int minMag = (pam.magT + 1) * (pam.magT + 1);
+
+	// the edges are taken twice rather than kept: no list grows with the roi
+	double jxx = 0, jyy = 0, jxy = 0;
+	int nEdge = 0;
+	box_edges(src, area, ct, st, cosBin, minMag, [&](int, int, int dx, int dy)
+	{
+		// structure tensor
+		jxx += (double)dx * dx;
+		jyy += (double)dy * dy;
+		jxy += (double)dx * dy;
+		nEdge++;
+	});
+	if (nEdge < pam.minEdgeT) return upright;
+
+	// refined bar normal
+	const double phi = 0.5 * std::atan2(2.0 * jxy, jxx - jyy);
+	const double cu = std::cos(phi), su = std::sin(phi);
+	const double cosFine = std::cos(CV_PI / 12);
+
+	// edges within 15 degree of it, binned by their distance from the center
+	// across the bars (along the normal) and along them
+	const int half = (int)std::ceil(0.5 * std::sqrt((double)roi.width * roi.width + (double)roi.height * roi.height)) + 1;
+	if (wsHist[0].capacity() < (size_t)(2 * half + 1) && !ws_fits(2 * (2 * half + 1) * sizeof(int))) return upright;
+	wsHist[0].assign(2 * half + 1, 0);
+	wsHist[1].assign(2 * half + 1, 0);
+
+	int n = 0;
+	box_edges(src, area, ct, st, cosBin, minMag, [&](int w, int h, int dx, int dy)
+	{
+		const double dot = dx * cu + dy * su;
+		if (dot * dot < cosFine * cosFine * (dx * dx + dy * dy)) return;
+
+		const double px = w - cPt.x;
+		const double py = h - cPt.y;
+		wsHist[0][half + (int)std::floor(px * cu + py * su + 0.5)]++;
+		wsHist[1][half + (int)std::floor(-px * su + py * cu + 0.5)]++;
+		n++;
+	});
+	if (n < pam.minEdgeT) return upright;
+
+	// across: every bar edge is a peak, the code ends at a gap wider than the
+	// quiet zone test of sub_candidate. along: the bars give a plateau, text and
+	// other clutter in the roi have far fewer edges per bin.
+	const int maxGap = 7;
+	int ext[2][2];
+
+	int peak = 0;
+	for (size_t b = 0; b < wsHist[0].size(); b++) peak = std::max(peak, wsHist[0][b]);
+	hist_extent(wsHist[0], n, std::max(1, peak / 10), maxGap, ext[0][0], ext[0][1]);
+
+	const int q1 = hist_quantile(wsHist[1], n / 4), q3 = hist_quantile(wsHist[1], n - n / 4);
+	const int level = std::max(1, (int)(0.5 * (n / 2) / (q3 - q1 + 1)));
+	hist_extent(wsHist[1], n, level, maxGap, ext[1][0], ext[1][1]);
+
+	// margin of calc_region_check
+	const float margin = 1;
+	const float mAcross = 0.5f * (ext[0][0] + ext[0][1]) - half;
+	const float mAlong = 0.5f * (ext[1][0] + ext[1][1]) - half;
+	const cv::Point2f center(cPt.x + (float)(mAcross * cu - mAlong * su), cPt.y + (float)(mAcross * su + mAlong * cu));
+	const cv::Size2f size((float)(ext[0][1] - ext[0][0] + 1) + 2 * margin, (float)(ext[1][1] - ext[1][0] + 1) + 2 * margin);
+
+	return cv::RotatedRect(center, size, (float)(phi * 180.0 / CV_PI));
 }
\ No newline at end of file
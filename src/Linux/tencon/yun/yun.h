@@ -13,10 +13,27 @@
 *        only localization method! *
 */
 
+#ifndef IY_YUN_H
+#define IY_YUN_H
+
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+#include <string.h>
+
+#include "common/imgproc.h"
+#include "kernel/registry.h"
+#include "pool/pool.h"
+#include "result.h"
 
 #define NUM_ANG  18
+#define ANG_FOLD 3    // bins per folded orientation (30 degree): calc_orientation only writes multiples of it
+#define NEAR_ANG 1    // folded orientations on either side of the dominant one that count as its votes
 
 namespace iy{
 	typedef struct
@@ -25,20 +42,13 @@ namespace iy{
 		bool isStrong;
 	} YunOrientation;
 
+	// binary map, 1 bit per pixel (64 pixels per word, row padded to a word)
 	typedef struct
 	{
-		cv::Rect roi;
-		int max_orientation;
-	} YunLabel;
+		int width, height, words;
+		std::vector<uint64_t> bits;
+	} YunBitmap;
 
-	typedef struct 
-	{
-		cv::Point last_pt, first_pt;
-		cv::Rect roi;
-		int orientation;
-		bool isBarcode;
-	} YunCandidate;
-	
 	typedef struct
 	{
 		int magT;
@@ -46,24 +56,157 @@ namespace iy{
 		int minEdgeT;
 		int localBlockSz;
 		double minDensityEdgeT;
+		double minStrongRatio;  // share of all edge pixels a bin needs to be strong
+		int maxCandidates;      // blob budget handed to candidate verification
+		bool useSpecialized;    // specialized and bit-packed kernels (false: generic reference path)
+		bool blockGrid;         // saliency, smoothing, threshold and labelling on the block grid
+		bool lazyMagnitude;     // no magnitude map, computed on demand during verification
+		bool useCascade;        // cheap rejects before the ray walk, candidates scored
+		double maxAspect;       // cascade 1: longer over shorter blob side
+		double minPurity;       // cascade 2: share of blob edges within NEAR_ANG folded orientations of the dominant one (uniform clutter: 0.5)
+		double minEdgeDensity;  // cascade 3: edge pixels per pixel of the blob rectangle
+		bool orientedBox;       // rotated box per barcode from the structure tensor of its region
+		int incTile;            // incremental mode: side of the tiles compared with the last frame
+		double incSadT;         // incremental mode: mean absolute difference a tile may have and still be kept (0: exact)
 	} YunParams;
 
+	// blobs rejected per cascade stage, counted over all process() calls
+	typedef struct
+	{
+		uint64_t nBlobs;
+		uint64_t nAspect, nPurity, nDensity;
+		uint64_t nVerified, nBarcode;
+	} YunCascadeStats;
+
+	// tiles of process_incremental(), counted over all calls
+	typedef struct
+	{
+		uint64_t nFrames, nFull;  // frames, frames recomputed as a whole
+		uint64_t nTiles, nDirty;  // tiles compared, tiles found changed
+	} YunIncStats;
+
+	typedef struct
+	{
+		size_t maxBytes;        // hard cap of the workspace of all tiles in flight
+		int overlap;            // pixels shared by neighbouring tiles (larger than a barcode)
+		int nThreads;           // tiles processed at once (0: hardware threads or pool workers)
+		ThreadPool *pool;       // runs the tiles on its workers (NULL: threads of their own)
+	} YunTileParams;
+
+	// cooperative deadline and cancellation, polled between stages and candidates
+	class YunToken{
+	private:
+		int64_t deadline;             // tick count, 0: no deadline
+		std::atomic<bool> isCancel;
+
+	public:
+		YunToken() : deadline(0), isCancel(false) {}
+
+		void set_budget(double ms) { deadline = cv::getTickCount() + (int64_t)(ms * cv::getTickFrequency() / 1000.0); }
+		void cancel() { isCancel = true; }   // from any thread
+		bool expired() const
+		{
+			return isCancel.load(std::memory_order_relaxed) || (deadline != 0 && cv::getTickCount() >= deadline);
+		}
+	};
+
 	class Yun{
 	private:
 		// process parameter
 		YunParams pam;
 
+		// deadline of the running process() call (NULL: none), isCut once it expired
+		const YunToken *token;
+		bool isCut;
+		bool is_expired();
+
+		// workspace cap of a tile (0: none). The runs, blob records and box
+		// histograms a call grows are checked against it before they grow; one
+		// that would not fit sets isOverCap and cuts the call like an expired deadline
+		size_t wsCap;
+		size_t wsUsed;          // scratch of the running labelling
+		bool isOverCap;
+		size_t ws_held() const;
+		bool ws_fits(size_t n);
+		void push_blob(YunBlobs &blob, const YunLabel &val);
+
 		cv::Mat calc_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap);
+		cv::Mat calc_orientation_stride(cv::Mat &src, int stride, cv::Mat &mMap, std::vector<YunOrientation> &Vmap);
 		cv::Mat calc_saliency(cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz);
 		cv::Mat calc_integral_image(cv::Mat &src);
-		cv::Mat calc_smooth(cv::Mat &src, int WinSz);
+		cv::Mat calc_integral_rows(cv::Mat &src);
+		cv::Mat calc_smooth(cv::Mat &src, int WinSz, int *hist);
+		void calc_strong(std::vector<YunOrientation> &Vmap, int nEdge);
+
+		// specialized kernels (bin count, block size and window fixed at compile time)
+		template<int NBins, bool StoreMag> cv::Mat calc_orientation_t(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap);
+		template<int NBins, int LbSz> cv::Mat calc_saliency_t(cv::Mat &src);
+		template<int WinSz> cv::Mat calc_smooth_t(cv::Mat &src, int *hist);
+
+		// variant of the kernel registry (reference: generic kernels), the specialized
+		// one only if it is instantiated for the current params; both in verify mode
+		cv::Mat dispatch_orientation(cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap);
+		cv::Mat dispatch_saliency(cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz);
+		cv::Mat dispatch_integral(cv::Mat &src);
+		cv::Mat dispatch_smooth(cv::Mat &src, int WinSz, int *hist);
+		void dispatch_ccl(cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &blob);
+		int select_variant(int k) const;
+		cv::Mat run_orientation(int v, cv::Mat &src, cv::Mat &mMap, std::vector<YunOrientation> &Vmap);
+		cv::Mat run_saliency(int v, cv::Mat &src, std::vector<YunOrientation> &Vmap, int lbSz);
+		cv::Mat run_integral(int v, cv::Mat &src);
+		cv::Mat run_smooth(int v, cv::Mat &src, int WinSz, int *hist);
+		void run_ccl(int v, cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &blob);
 		int push(int *stackx, int *stacky, int arr_size, int vx, int vy, int *top);
 		int pop(int *stackx, int *stacky, int arr_size, int *vx, int *vy, int *top);
-		std::vector<YunLabel> ccl(cv::Mat &src, cv::Mat &oMap, std::vector<YunOrientation> &Vmap);
-		std::vector<YunCandidate> calc_candidate(std::vector<YunLabel> &val, cv::Mat &mMap, cv::Mat &oMap);
-		YunCandidate sub_candidate(YunLabel val, cv::Mat &mMap, cv::Mat &oMap);
+		void ccl(cv::Mat &src, int thr, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &result);
+		void limit_candidates(YunBlobs &blob, bool isSorted);
+
+		// blobs of the running frame and index scratch, kept between frames
+		YunBlobs wsBlob;
+		std::vector<int> wsOrder;
+
+		// early-reject cascade, ordered by cost
+		YunCascadeStats cstats;
+		void calc_cascade(YunBlobs &blob, cv::Mat &oMap);
+		cv::Mat calc_edge_integral(cv::Mat &oMap);
+
+		// bit-packed foreground (salient and edge) and run based labelling
+		void calc_binary_packed(cv::Mat &src, int thr, cv::Mat &oMap, YunBitmap &bMap);
+		void ccl_packed(cv::Mat &src, int thr, YunBitmap &bMap, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunBlobs &result);
+
+		// block grid mode (one cell per lbSz x lbSz block)
+		cv::Mat calc_saliency_grid(cv::Mat &src, int lbSz, cv::Mat &hMap);
+		cv::Mat calc_smooth_grid(cv::Mat &src, int WinSz, int lbSz, int *hist);
+		void ccl_grid(cv::Mat &src, int thr, cv::Mat &hMap, std::vector<YunOrientation> &Vmap, int lbSz, cv::Size imSz, YunBlobs &result);
+		void calc_candidate(YunBlobs &val, cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap, YunResult &result);
+		YunCandidate sub_candidate(YunLabel val, cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap);
+		int calc_magnitude(cv::Mat &src, cv::Point pt);
 		YunCandidate calc_region_check(YunCandidate val, cv::Size imSz);
 
+		// saliency, labelling and verification on the orientation maps of a frame
+		void detect(cv::Mat &gray_src, cv::Mat &mMap, cv::Mat &oMap, std::vector<YunOrientation> &Vmap, YunResult &result);
+
+		// oriented box of the edges in roi, around the dominant gradient direction
+		std::vector<int> wsHist[2];
+		cv::RotatedRect calc_box(cv::Mat &src, cv::Rect roi, int orientation);
+
+		// incremental mode: maps of the last frame, patched where the frame changed
+		cv::Mat incPrev, incO, incM, incE, incS;
+		std::vector<int> incBlock;      // saliency of every block, -1: no edge in it
+		int incBlockW;                  // blocks per row
+		int incCnt[NUM_ANG];            // orientation histogram of incO
+		int incHist[256];               // histogram of incS
+		YunResult incResult;
+		YunIncStats istats;
+		bool can_increment(cv::Size imSz) const;
+		void init_incremental(cv::Mat &gray_src);
+		std::vector<cv::Rect> find_changed(cv::Mat &gray_src);
+		void update_orientation(cv::Mat &gray_src, cv::Rect area);
+		cv::Rect update_saliency(cv::Rect area);
+		void render_saliency(cv::Rect area);
+		int dispatch_saliency_block(cv::Mat &src, int h, int w);
+		template<int NBins, bool StoreMag> void calc_orientation_area_t(cv::Mat &src, cv::Mat &mMap, cv::Mat &oMap, cv::Rect area, int *cnt);
+
 	public:
 		Yun() {
 			// init value
@@ -72,15 +215,78 @@ namespace iy{
 			pam.minEdgeT = 30;
 			pam.localBlockSz = 15;
 			pam.minDensityEdgeT = 0.3;
+			pam.minStrongRatio = 0.1;
+			pam.maxCandidates = 64;
+			pam.useSpecialized = true;
+			pam.blockGrid = false;
+			pam.lazyMagnitude = false;
+			pam.useCascade = false;
+			pam.maxAspect = 10.0;
+			pam.minPurity = 0.8;
+			pam.minEdgeDensity = 0.15;
+			pam.orientedBox = true;
+			pam.incTile = 32;
+			pam.incSadT = 0;
+			token = NULL;
+			resetCascadeStats();
+			resetIncStats();
+			isCut = false;
+			wsCap = 0;
+			wsUsed = 0;
+			isOverCap = false;
+			incBlockW = 0;
 		}
 		~Yun() {}
 
+		YunParams getParams() const { return pam; }
+		void setParams(YunParams pams) { pam = pams; incPrev.release(); }
+
+		YunCascadeStats getCascadeStats() const { return cstats; }
+		void resetCascadeStats() { memset(&cstats, 0, sizeof(cstats)); }
+
+		YunIncStats getIncStats() const { return istats; }
+		void resetIncStats() { memset(&istats, 0, sizeof(istats)); }
+
+		// fills a result owned by the caller: no allocation for blob and result
+		// storage once those arrays are large enough for the frame. The maps
+		// and the scratch of the labelling are allocated on every call
+		void process(cv::Mat &gray_src, YunResult &result);
+
 		std::vector<YunCandidate> process(cv::Mat &gray_src);
 		std::vector<YunCandidate> process(cv::Mat &gray_src, YunParams pams)
 		{
-			pam = pams;
+			setParams(pams);
 			std::vector<YunCandidate> result = process(gray_src);
 			return result;
 		};
+
+		// anytime mode: blobs verified by saliency until the token expires,
+		// isPartial tells whether the result was cut short
+		std::vector<YunCandidate> process(cv::Mat &gray_src, const YunToken &tok, bool &isPartial);
+
+		// presence check on a stride 2 or 4 grid: gradients read from the source
+		// without a resized copy, the later stages on the reduced maps. Regions
+		// are coarse (grid cells in source pixels, upright boxes); true if any
+		// barcode was found
+		bool preview(cv::Mat &gray_src, int stride, YunResult &result);
+
+		// per pixel maps of process() with the current params, an upper bound at
+		// their peak (verify mode runs both variants and is not counted). The runs
+		// and blob records of the labelling grow with the content, not the area;
+		// process_tiled checks them against its cap
+		double bytes_per_pixel() const;
+
+		// overlapping tiles sized to tpam.maxBytes, candidates merged across seams.
+		// A tile that does not fit its share is run again alone with all of the
+		// budget; if that fails too, the call prints an error and returns nothing
+		std::vector<YunCandidate> process_tiled(cv::Mat &gray_src, YunTileParams tpam);
+
+		// static cameras: only tiles that changed since the last call are recomputed,
+		// same result as process() while incSadT is 0
+		void process_incremental(cv::Mat &gray_src, YunResult &result);
+		std::vector<YunCandidate> process_incremental(cv::Mat &gray_src);
+		void reset_incremental() { incPrev.release(); }
 	};
-}
\ No newline at end of file
+}
+
+#endif